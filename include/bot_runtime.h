@@ -0,0 +1,105 @@
+#ifndef BOT_RUNTIME
+#define BOT_RUNTIME
+
+#include <discord_bot.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+/*
+ * Class bot_runtime hosts many bots (tokens or shards) in one process. The bots share
+ * one websocket client, the TLS session cache of tls_context::shared(), one pool of
+ * REST connections and one set of event workers, so each added bot only costs its
+ * connection and its own state (gateway queue, sequence, handlers).
+ *
+ * Connections are read by a few reactor threads instead of one busy loop per bot:
+ * each reactor waits on the sockets of its bots with one select() and only reads the
+ * readable ones. A reactor holds at most FD_SETSIZE bots. The reactors also send the
+ * IDENTIFYs once the scheduler's slots are reached, adding a bot never waits for them.
+ */
+class bot_runtime {
+
+public:
+
+	/**
+	 * @param reactors		   Number of threads reading the connections.
+	 * @param workers		   Number of threads running the event handlers.
+	 * @param rest_connections Number of connections to the REST API.
+	 * @param host			   The host of the REST API.
+	 */
+	bot_runtime(size_t reactors = 1, size_t workers = std::thread::hardware_concurrency(), size_t rest_connections = 4, const std::string& host = "discord.com");
+
+	/**
+	 * Stop the reactors, the bots must be destroyed before the runtime.
+	 */
+	~bot_runtime();
+
+	bot_runtime(const bot_runtime&) = delete;
+
+	/**
+	 * Connect bot and read its HELLO on the calling thread, then hand it to the reactor with
+	 * the fewest bots, which sends its IDENTIFY or RESUME. Thread safe.
+	 *
+	 * @param bot A bot created with this runtime.
+	 */
+	void add(discord_bot& bot);
+
+	/**
+	 * Stop polling bot, called by the destructor of the bot. Returns once the reactor
+	 * of bot is done with its current round. The destructor then drains the dispatches
+	 * of bot from the shared workers, see event_executor::drain.
+	 */
+	void remove(discord_bot& bot);
+
+	/**
+	 * Block the calling thread until stop() is called.
+	 */
+	void join();
+
+	void stop();
+
+	dclient get_client() { return m_client; }
+
+	rest_pool& get_rest() { return m_rest; }
+
+	event_executor& get_executor() { return m_executor; }
+
+	const std::string& get_host() const { return m_host; }
+
+	/*
+	 * How long a reactor waits in select(), it bounds the delay of heartbeats and queued commands.
+	 */
+	static const long POLL_INTERVAL_MS = 50;
+
+	/*
+	 * How long a read waits for more data once select() found its socket readable: none, a
+	 * busy bot never holds up the other bots of its reactor, what is still in flight is read
+	 * in the next round.
+	 */
+	static const long READ_TIMEOUT_MS = 0;
+
+private:
+
+	//The list of bots is only locked to be changed or copied, a round of select() and
+	//polls holds poll_lock on its copy instead
+	struct reactor {
+		std::vector<discord_bot*>	bots;
+		std::mutex					lock;
+		std::vector<discord_bot*>	polled;
+		std::mutex					poll_lock;
+		std::thread					thread;
+	};
+
+	void run(reactor* r);
+
+	std::string				m_host;
+	dclient					m_client;
+	rest_pool				m_rest;
+	event_executor			m_executor;
+	std::vector<reactor*>	m_reactors;
+	std::atomic<bool>		m_stop;
+
+};
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef CACHE_SNAPSHOT
+#define CACHE_SNAPSHOT
+
+#include <entity_cache.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+/*
+ * Class cache_snapshot is a file holding the state of a bot across restarts: the content of
+ * its entity_cache and the session and sequence to RESUME with.
+ *
+ * The file is a header followed by arrays of fixed size records and a pool of strings.
+ * Records refer to each other and to strings by offsets from the start of the file, never
+ * by pointers, so the file is read in place wherever it is mapped. A snapshot is opened by
+ * mapping the file read-only (MapViewOfFile on Windows, mmap elsewhere) and checking the
+ * header, nothing is parsed. Loading it into a cache copies the records out of the mapping,
+ * the file itself is never written to: changes go to the cache and the next save writes a
+ * new file, renamed over the old one.
+ *
+ * A file of an other VERSION or of an other shard is refused.
+ */
+class cache_snapshot {
+
+public:
+
+	static const uint32_t VERSION = 1;
+
+	struct string_ref {
+		uint32_t	offset;
+		uint32_t	length;
+	};
+
+	struct section {
+		uint64_t	offset;
+		uint64_t	count;
+	};
+
+	struct header {
+		char		magic[8];
+		uint32_t	version;
+		uint32_t	header_size;
+		int32_t		shard_id;
+		int32_t		shard_count;
+		int64_t		sequence;
+		uint64_t	created;
+		string_ref	session_id;
+		section		guilds;
+		section		channels;
+		section		overwrites;
+		section		roles;
+		section		members;
+		section		member_roles;
+		section		strings;
+	};
+
+	struct guild_record {
+		uint64_t	id;
+		uint64_t	owner_id;
+		uint32_t	member_count;
+		string_ref	name;
+		uint32_t	reserved;
+	};
+
+	struct channel_record {
+		uint64_t	id;
+		uint64_t	guild_id;
+		uint64_t	parent_id;
+		int32_t		position;
+		uint32_t	type;
+		uint32_t	first_overwrite;
+		uint32_t	overwrite_count;
+		string_ref	name;
+	};
+
+	struct overwrite_record {
+		uint64_t	id;
+		uint64_t	allow;
+		uint64_t	deny;
+		uint32_t	type;
+		uint32_t	reserved;
+	};
+
+	struct role_record {
+		uint64_t	id;
+		uint64_t	guild_id;
+		uint64_t	permissions;
+		uint32_t	color;
+		int32_t		position;
+		string_ref	name;
+	};
+
+	struct member_record {
+		uint64_t	guild_id;
+		uint64_t	user_id;
+		string_ref	username;
+		string_ref	nick;
+		string_ref	avatar;
+		uint32_t	first_role;
+		uint32_t	role_count;
+		uint16_t	discriminator;
+		uint8_t		bot;
+		uint8_t		reserved[5];
+	};
+
+	cache_snapshot();
+
+	~cache_snapshot();
+
+	cache_snapshot(const cache_snapshot&) = delete;
+
+	cache_snapshot& operator=(const cache_snapshot&) = delete;
+
+	/**
+	 * Write a snapshot to path.tmp then rename it to path, a reader never sees half a file.
+	 *
+	 * @param cache		  The cache to save, nullptr to save the session only.
+	 * @param session_id  The session to resume, empty for none.
+	 * @param sequence	  The sequence up to which every event is in the cache, see applied_sequence.
+	 * @return Whether the file was written.
+	 */
+	static bool save(const std::string& path, const entity_cache* cache, const std::string& session_id, int sequence, int shard_id, int shard_count);
+
+	/**
+	 * Map the snapshot at path, closing any open one.
+	 *
+	 * @return False if the file is missing, malformed or of an other version or shard.
+	 */
+	bool open(const std::string& path, int shard_id, int shard_count);
+
+	void close();
+
+	bool is_open() const { return m_data != nullptr; }
+
+	/**
+	 * Copy the snapshot into cache, replacing its content.
+	 */
+	void load(entity_cache& cache) const;
+
+	std::string_view get_session_id() const { return get_string(get_header().session_id); }
+
+	int get_sequence() const { return static_cast<int>(get_header().sequence); }
+
+	const header& get_header() const { return *reinterpret_cast<const header*>(m_data); }
+
+	/**
+	 * @return The records of section s, checked by open.
+	 */
+	template<class T> const T* records(const section& s) const {
+		return reinterpret_cast<const T*>(m_data + s.offset);
+	}
+
+	/**
+	 * @return The string r refers to, empty if it is out of the pool.
+	 */
+	std::string_view get_string(string_ref r) const;
+
+private:
+
+	bool validate(int shard_id, int shard_count) const;
+
+	const char*	m_data;
+	size_t		m_size;
+	void*		m_mapping;
+
+};
+
+/*
+ * Class applied_sequence follows the sequence up to which every event was applied.
+ * The reading thread receives the events in order but the workers finish them in any
+ * order, events of different guilds run in parallel. The applied sequence only moves
+ * past an event once every event before it was finished, so a snapshot never claims
+ * an event the cache does not hold yet and RESUME replays whatever was still pending.
+ */
+class applied_sequence {
+
+public:
+
+	/*
+	 * Finishes an event when the worker is done with it or leaves by an exception, a
+	 * malformed event must not hold the applied sequence back for good.
+	 */
+	class finisher {
+
+	public:
+
+		/**
+		 * @param applied The sequence to finish in, nullptr if it is not tracked.
+		 */
+		finisher(applied_sequence* applied, int sequence) : m_applied(applied), m_sequence(sequence) {}
+
+		~finisher() { finish(); }
+
+		finisher(const finisher&) = delete;
+
+		finisher& operator=(const finisher&) = delete;
+
+		void finish() {
+			if (m_applied != nullptr) m_applied->finish(m_sequence);
+			m_applied = nullptr;
+		}
+
+	private:
+
+		applied_sequence*	m_applied;
+		int					m_sequence;
+
+	};
+
+	applied_sequence();
+
+	/**
+	 * An event was posted to the workers, called by the reading thread in sequence order.
+	 */
+	void start(int sequence);
+
+	/**
+	 * An event was dropped or handled by the reading thread, nothing to wait for.
+	 */
+	void skip(int sequence);
+
+	/**
+	 * A worker is done with an event given to start().
+	 */
+	void finish(int sequence);
+
+	/**
+	 * Start over from sequence, for a new or resumed session. Events still running are forgotten.
+	 */
+	void reset(int sequence);
+
+	int get() const;
+
+private:
+
+	void advance();
+
+	struct pending {
+		int		sequence;
+		bool	finished;
+	};
+
+	std::deque<pending>	m_pending;
+	int					m_applied;
+	mutable std::mutex	m_lock;
+
+};
+
+#endif
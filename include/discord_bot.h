@@ -1,15 +1,31 @@
 #ifndef DISCORD_BOT_IMPL
 #define DISCORD_BOT_IMPL
 
-#include <rest/rest.h>
+#include <rest/rest_pool.h>
 #include <websocketpp/client.cpp>
 #include <websocketpp/tls/client_tls_config.h>
 #include <events.h>
+#include <snowflake.hpp>
+#include <gateway_envelope.hpp>
+#include <gateway_events.hpp>
+#include <discord_objects.hpp>
+#include <event_filter.hpp>
+#include <member_request.h>
+#include <entity_cache.h>
+#include <message_cache.h>
+#include <cache_snapshot.h>
 #include <unordered_map>
 #include <functional>
 #include <sstream>
 #include <chrono>
 #include <rate_limit.h>
+#include <gateway_queue.h>
+#include <gateway_templates.hpp>
+#include <identify_scheduler.h>
+#include <presence_state.h>
+#include <event_executor.h>
+#include <mutex>
+#include <atomic>
 #include <misc/zlib.h>
 
 //Using macros and typedef
@@ -36,12 +52,46 @@ typedef std::function<void(int, std::string, const nlohmann::json&)>	on_message_
 
 typedef std::function<void()>											on_close_handler;
 
+typedef std::function<void(const nlohmann::json&)>						event_handler;
+
+typedef std::function<void(const gateway_envelope&)>					raw_event_handler;
+
+class bot_runtime;
+
+/*
+ * All the shards of a token share one /gateway/bot response, one IDENTIFY scheduler
+ * and one presence.
+ */
+struct shard_group {
+	nlohmann::json		gateway;
+	identify_scheduler*	scheduler;
+	presence_state		presence;
+};
+
 class discord_bot {
 
 public:
 	/**
+	Create a bot (or one shard of a bot) and its gateway connection, listen() connects.
+
+	@param host		   The host of the REST API.
+	@param token	   The bot token.
+	@param shard_id	   The id of this shard.
+	@param shard_count Total number of shards, 0 to connect without sharding.
+	*/
+	discord_bot(std::string host, std::string token, int shard_id = 0, int shard_count = 0);
+
+	/**
+	Create a bot (or one shard of a bot) hosted by runtime. It shares the runtime's
+	websocket client, TLS sessions, REST connections and workers, and is run by
+	bot_runtime::add() instead of listen(). Its gateway rate limit stays its own.
+
+	@param runtime	   The runtime hosting the bot, must outlive it.
+	@param token	   The bot token.
+	@param shard_id	   The id of this shard.
+	@param shard_count Total number of shards, 0 to connect without sharding.
 	*/
-	discord_bot(std::string, std::string);
+	discord_bot(bot_runtime& runtime, std::string token, int shard_id = 0, int shard_count = 0);
 
 	/**
 	*/
@@ -55,12 +105,43 @@ public:
 	discord_bot& on_open(on_open_handler);
 
 	/**
-	Called everytime someone sends a message to the server.
+	Called everytime someone sends a message to the server. Must be called before listen().
 
 	@param on_message_handler A callback method for handling received messages.
 	*/
 	discord_bot& on_message(on_message_handler);
 
+	/**
+	Called everytime the event E is dispatched by the gateway.
+
+	@param event_handler A callback method receiving the "d" field of the event.
+	*/
+	template<event::type E> discord_bot& on(event_handler func) {
+		static_assert(E != event::UNKNOWN, "Cannot subscribe to event::UNKNOWN");
+		m_handlers[E] = func;
+		return *this;
+	}
+
+	/**
+	Called everytime the event E is dispatched by the gateway, with "d" decoded into
+	the struct of event_traits<E> without building a JSON object.
+	The struct points into the received frame and is only valid during the call.
+
+	@param func A callback method receiving the decoded event.
+	*/
+	template<event::type E> discord_bot& on_typed(std::function<void(const typename event_traits<E>::type&)> func) {
+		m_raw_handlers[E] = [func](const gateway_envelope& env) {
+			typename event_traits<E>::type decoded;
+			if (event_decoder::decode(env, decoded)) func(decoded);
+		};
+		return *this;
+	}
+
+	/**
+	@return Whether a handler is registered for e, by on<e>(), on_typed<e>() or on_message().
+	*/
+	bool is_subscribed(event::type e) const;
+
 	/**
 	Called once when the bot closes the connection to the gateway.
 
@@ -69,8 +150,93 @@ public:
 	discord_bot& on_close(on_close_handler);
 
 	/**
+	Set the number of worker threads running the event handlers. Events of one guild
+	are handled in order, events of different guilds are handled in parallel.
+	Must be called before listen(), a bot of a bot_runtime uses the runtime's workers.
+
+	@param threads Number of worker threads.
+	*/
+	discord_bot& set_worker_count(size_t threads);
+
+	/**
+	@return Queue depth and handler latency of the event workers.
+	*/
+	event_executor::stats get_worker_stats() const;
+
+	/**
+	Set the events dropped by a byte scan of the frame before any parsing.
+	Without it, listen() drops every event nobody is subscribed to.
+
+	@param filter The events to drop.
+	*/
+	discord_bot& set_event_filter(const event_filter& filter);
+
+	/**
+	Select the encoding of the gateway payloads. ETF is binary, smaller and cheaper
+	to decode, the handlers receive the same objects with either encoding.
+	Must be called before listen().
+
+	@param e The encoding, gateway_encoding::JSON by default.
 	*/
-	discord_bot& set_bot_status(int, std::string);
+	discord_bot& set_encoding(gateway_encoding::type e);
+
+	/**
+	Keep the guilds, channels, roles and members sent by the gateway in an entity_cache.
+	Adds the GUILDS and GUILD_MEMBERS intents to IDENTIFY, GUILD_MEMBERS must be enabled
+	for the bot. Must be called before listen().
+
+	@param member_memory_limit Bytes the cached members may use before the least recently
+	used are evicted, 0 for no limit.
+	*/
+	discord_bot& enable_cache(size_t member_memory_limit = 0);
+
+	/**
+	@return The entity cache, nullptr unless enable_cache() was called.
+	*/
+	const entity_cache* get_cache() const;
+
+	/**
+	Keep the latest messages of every channel in a message_cache, so that MESSAGE_UPDATE
+	and MESSAGE_DELETE handlers can look up the message before the change. The cache is
+	updated after the handlers of an event ran. Must be called before listen().
+
+	@param memory_budget		Bytes of message content, rings and index kept across all channels.
+	@param messages_per_channel Messages kept per channel.
+	*/
+	discord_bot& enable_message_cache(size_t memory_budget = 16 * 1024 * 1024, uint32_t messages_per_channel = 64);
+
+	/**
+	@return The message cache, nullptr unless enable_message_cache() was called.
+	*/
+	const message_cache* get_message_cache() const;
+
+	/**
+	Start from a cache_snapshot: when listen() connects, the snapshot at path fills the
+	entity cache and its session is RESUMEd instead of sending IDENTIFY, the gateway then
+	replays only the events missed since. If the session is no longer valid the bot
+	identifies as usual. Must be called before listen(), after enable_cache().
+
+	@param path The snapshot file, one per shard.
+	*/
+	discord_bot& set_snapshot_path(std::string path);
+
+	/**
+	Write the entity cache and the session to the snapshot path, e.g. before a deploy.
+	Safe to call from a handler.
+
+	@return Whether the snapshot was written.
+	*/
+	bool save_snapshot();
+
+	/**
+	Set the game and status of the bot on all its shards. Rapid updates are coalesced,
+	each shard sends the latest one at most once per presence_state::PRESENCE_WINDOW.
+
+	@param type	  The activity type, 0 for "Playing".
+	@param name	  The activity name.
+	@param status One of "online", "dnd", "idle", "invisible".
+	*/
+	discord_bot& set_bot_status(int type, std::string name, std::string status = "online");
 
 	/**
 	Create a message msg and send it to channel_id
@@ -78,13 +244,35 @@ public:
 	@param msg		  A message to send.
 	@param channel_id A guild channel's id that the bot is in to send message to.
 	*/
-	discord_bot& create_message(std::string msg, std::string channel_id);
+	discord_bot& create_message(std::string msg, snowflake channel_id);
+
+	/**
+	Add the GUILD_MEMBERS intent to IDENTIFY so that request_guild_members() can ask for
+	every member of a guild, enable_cache() adds it too. GUILD_MEMBERS must be enabled for
+	the bot. Must be called before listen().
+	*/
+	discord_bot& enable_member_requests();
+
+	/**
+	Request the members of a guild (opcode 8) and collect the GUILD_MEMBERS_CHUNK
+	events answering it. Members are streamed into a compact member_list as the chunks arrive.
+	Requesting every member needs the GUILD_MEMBERS intent, without it the future fails right
+	away. The future also fails when no chunk arrived for member_request::CHUNK_TIMEOUT.
+
+	@param guild_id The guild to request members from.
+	@param query	Only members whose username starts with query, empty for all of them.
+	@param limit	Maximum number of members, 0 for no limit.
+	@param on_chunk Optional callback called after each chunk.
+	@return A future set once the last chunk arrived.
+	*/
+	std::future<member_list> request_guild_members(snowflake guild_id, const std::string& query = "", int limit = 0, member_request::chunk_handler on_chunk = nullptr);
 
 	/**
 	*/
 	discord_bot& dispatch_event(event::type);
 
 	/**
+	Connect, IDENTIFY and keep reading the gateway on the calling thread, never returns.
 	*/
 	discord_bot& listen();
 
@@ -107,6 +295,53 @@ protected:
 
 private:
 
+	friend class bot_runtime;
+
+	/*
+	Request the gateway once per token and create the connection.
+	*/
+	void init_connection();
+
+	/*
+	Serialize the heartbeat and IDENTIFY payloads once, their variable fields as slots.
+	*/
+	void init_templates();
+
+	/*
+	Create a websocket client calling the forwarders, one per bot or one per bot_runtime.
+	*/
+	static dclient create_client();
+
+	/*
+	Connect and read HELLO, which sends RESUME if a snapshot gave a session and schedules IDENTIFY otherwise.
+	*/
+	void start();
+
+	/*
+	Reserve an IDENTIFY slot from the scheduler, poll() sends IDENTIFY once it is reached.
+	*/
+	void schedule_identify();
+
+	/*
+	Send IDENTIFY, its slot was reached.
+	*/
+	void send_identify();
+
+	/*
+	Send RESUME with the session and sequence of the snapshot.
+	*/
+	void send_resume();
+
+	/*
+	One step of the connection: heartbeat, IDENTIFY once its slot is reached, queued commands
+	and, if the socket is readable, the received frames.
+	*/
+	void poll(bool readable);
+
+	hsocket get_socket() const;
+
+	void set_read_timeout(long ms);
+
 	/**
 	*/
 	void on_open_internal(dconnection_hdl);
@@ -123,6 +358,52 @@ private:
 	*/
 	void send_heartbeat();
 
+	/*
+	Queue p for the gateway in the selected encoding. Heartbeat, IDENTIFY and RESUME
+	jump the queue, other commands are paced by the gateway rate limit.
+	*/
+	void send_payload(const payload& p);
+
+	/*
+	Queue a rendered template for the gateway in the selected encoding.
+	*/
+	void send_payload(payload_template& t, gateway_queue::priority priority);
+
+	/*
+	Send the queued commands the rate limit allows, only called from the thread reading the connection.
+	*/
+	void flush_outbound();
+
+	/*
+	Fail and forget the member requests the gateway stopped answering.
+	*/
+	void expire_member_requests();
+
+	/*
+	@return The intents sent in IDENTIFY.
+	*/
+	int get_intents() const;
+
+	/*
+	Queue the latest presence of the shard group if it changed and the window allows it.
+	*/
+	void flush_presence();
+
+	/*
+	Run the bot's own consumers and then the handlers of a dispatched event, on a worker.
+	*/
+	void on_dispatch(const gateway_envelope& env, event::type e);
+
+	/*
+	Route a GUILD_MEMBERS_CHUNK to its member_request by nonce.
+	*/
+	void on_members_chunk(const gateway_envelope& env);
+
+	/*
+	@return Whether the bot itself consumes e, such events are never filtered out.
+	*/
+	bool is_internal(event::type e) const;
+
 	/*
 	*/
 	static void on_open_forwarder(dconnection_hdl);
@@ -139,34 +420,85 @@ private:
 	std::string			m_host;
 	std::string			m_token;
 	std::string			m_ws_route;
+	gateway_encoding::type m_encoding;
 	std::string			m_session_id;
+	std::mutex			m_session_lock;
+	std::string			m_snapshot_path;
 	std::string			m_rest_route;
 
 	nlohmann::json		m_gateway;
-	rest*				m_rest;
+	shard_group*		m_shard_group;
+	int					m_shard_id;
+	int					m_shard_count;
+	bot_runtime*		m_runtime;
+	rest_pool*			m_rest;
 	rate_limit*			m_ratelimit;
+	event_executor*		m_executor;
+	//The dispatches of this bot on m_executor, drained by the destructor
+	event_executor::group m_tasks;
+	size_t				m_worker_count;
 	dclient				m_client;
 	dconnection			m_connection;
 	dconnection_hdl		m_hdl;
+	gateway_queue		m_outbound;
 
-	payload				m_heartbeat;
+	payload_template	m_heartbeat;
+	payload_template	m_identify;
+	identify_scheduler::clock::time_point m_identify_at;
+	bool				m_identify_pending;
 	milliseconds		m_heartbeat_interval;
 	time_point			m_timepoint;
-	int					m_sequence;
+	std::atomic<int>	m_sequence;
+	applied_sequence	m_applied;
+
+	uint64_t			m_presence_version;
+	time_point			m_presence_sent;
 
 	on_open_handler		m_on_open;
 	on_message_handler	m_on_message;
-	on_message_handler	m_on_message_orig;
 	on_close_handler	m_on_close;
 
-	bool m_initialized;
+	std::array<event_handler, event::UNKNOWN> m_handlers;
+	std::array<raw_event_handler, event::UNKNOWN> m_raw_handlers;
+	event_filter		m_filter;
+	entity_cache*		m_cache;
+	message_cache*		m_messages;
+	bool				m_has_filter;
+
+	std::unordered_map<std::string, std::shared_ptr<member_request>> m_member_requests;
+	std::mutex			m_member_requests_lock;
+	uint64_t			m_nonce;
+	bool				m_member_intent;
+
+	/*
+	Where the session is, only changed by the thread reading the connection.
+	*/
+	enum session_state {
+
+		CONNECTING		,	//Waiting for HELLO
+
+		IDENTIFYING		,	//IDENTIFY scheduled or sent, waiting for READY
+
+		RESUMING		,	//RESUME sent, the replayed events are dispatched until RESUMED
+
+		READY
+	};
+
+	std::atomic<session_state> m_state;
 
 };
 
 inline std::unordered_map<void*, discord_bot*> hdl_map;
 
+inline std::mutex hdl_map_lock;
+
+inline std::unordered_map<std::string, shard_group*> shard_map;
+
+inline std::mutex shard_map_lock;
+
 inline discord_bot* bot_look_up(dconnection_hdl hdl) {
 	void* raw_hdl = hdl.lock().get();
+	std::lock_guard<std::mutex> guard(hdl_map_lock);
 	if (hdl_map.count(raw_hdl)) {
 		return hdl_map.at(raw_hdl);
 	}
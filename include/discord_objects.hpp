@@ -0,0 +1,304 @@
+#ifndef DISCORD_OBJECTS
+#define DISCORD_OBJECTS
+
+#include <gateway_events.hpp>
+#include <json_scanner.hpp>
+#include <snowflake.hpp>
+#include <misc/json.hpp>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/*
+ * The typed Discord objects: user, role, emoji, member, channel, message and guild, as
+ * declared in discord_objects.def. The preprocessor expands the schema into the structs
+ * and, for each of them:
+ *
+ *	read_object(S&, T&, event_strings&)			decodes the raw "d" with json_scanner or etf::scanner
+ *	from_json(const nlohmann::json&, T&)			decodes a DOM, also used by json::get<T>()
+ *	to_json(std::string&, const T&)					appends the compact JSON of the object
+ *
+ * Like the structs of gateway_events.hpp, strings are views into what they were decoded
+ * from, or into the event_strings when they had escape sequences. A null string is a view
+ * with no data, a null id is snowflake(0). Decoding only allocates for the arrays and the
+ * escaped strings.
+ */
+namespace discord {
+
+	/*
+	 * The kinds of values a field can have: the C++ type, how to read and write it.
+	 */
+	namespace kind {
+
+		struct id {
+			typedef snowflake type;
+
+			template<class S> static bool read(S& s, snowflake& v, event_strings&) {
+				return event_decoder::read_id(s, v);
+			}
+
+			static void read_dom(const nlohmann::json& j, snowflake& v) {
+				v = j.is_string() ? snowflake(j.get_ref<const std::string&>()) : snowflake();
+			}
+
+			static void write(std::string& out, snowflake v) {
+				if (!v) {
+					out += "null";
+					return;
+				}
+				out += '"';
+				v.append_to(out);
+				out += '"';
+			}
+		};
+
+		struct text {
+			typedef std::string_view type;
+
+			template<class S> static bool read(S& s, std::string_view& v, event_strings& strings) {
+				return event_decoder::read_text(s, v, strings);
+			}
+
+			static void read_dom(const nlohmann::json& j, std::string_view& v) {
+				v = j.is_string() ? std::string_view(j.get_ref<const std::string&>()) : std::string_view();
+			}
+
+			static void write(std::string& out, std::string_view v) {
+				static const char* HEX = "0123456789abcdef";
+				if (v.data() == nullptr) {
+					out += "null";
+					return;
+				}
+				out += '"';
+				for (char c : v) {
+					if (c == '"' || c == '\\') {
+						out += '\\';
+						out += c;
+					}
+					else if (static_cast<unsigned char>(c) < 0x20) {
+						out += "\\u00";
+						out += HEX[(c >> 4) & 0xF];
+						out += HEX[c & 0xF];
+					}
+					else {
+						out += c;
+					}
+				}
+				out += '"';
+			}
+		};
+
+		struct integer {
+			typedef int64_t type;
+
+			template<class S> static bool read(S& s, int64_t& v, event_strings&) {
+				if (s.read_null()) return true;
+				return s.read_int(v);
+			}
+
+			static void read_dom(const nlohmann::json& j, int64_t& v) {
+				if (j.is_number()) v = j.get<int64_t>();
+			}
+
+			static void write(std::string& out, int64_t v) {
+				char digits[24];
+				std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), v);
+				out.append(digits, r.ptr - digits);
+			}
+		};
+
+		struct boolean {
+			typedef bool type;
+
+			template<class S> static bool read(S& s, bool& v, event_strings&) {
+				if (s.read_null()) return true;
+				return s.read_bool(v);
+			}
+
+			static void read_dom(const nlohmann::json& j, bool& v) {
+				if (j.is_boolean()) v = j.get<bool>();
+			}
+
+			static void write(std::string& out, bool v) {
+				out += v ? "true" : "false";
+			}
+		};
+
+		struct ids {
+			typedef std::vector<snowflake> type;
+
+			template<class S> static bool read(S& s, std::vector<snowflake>& v, event_strings&) {
+				snowflake item;
+				if (s.read_null()) return true;
+				if (!s.enter_array()) return false;
+				while (s.next_element()) {
+					if (!event_decoder::read_id(s, item)) return false;
+					v.push_back(item);
+				}
+				return s.ok();
+			}
+
+			static void read_dom(const nlohmann::json& j, std::vector<snowflake>& v) {
+				if (!j.is_array()) return;
+				v.reserve(j.size());
+				for (const nlohmann::json& item : j) {
+					v.emplace_back();
+					id::read_dom(item, v.back());
+				}
+			}
+
+			static void write(std::string& out, const std::vector<snowflake>& v) {
+				out += '[';
+				for (size_t i = 0; i < v.size(); i++) {
+					if (i > 0) out += ',';
+					id::write(out, v[i]);
+				}
+				out += ']';
+			}
+		};
+
+	}
+
+	//The structs
+
+#define DISCORD_OBJECT(T)				struct T {
+#define DISCORD_FIELD(K, F)				kind::K::type F{};
+#define DISCORD_OBJECT_FIELD(T, F)		discord::T F;
+#define DISCORD_LIST_FIELD(T, F)		std::vector<discord::T> F;
+#define DISCORD_END(T)					};
+#include <discord_objects.def>
+#undef DISCORD_OBJECT
+#undef DISCORD_FIELD
+#undef DISCORD_OBJECT_FIELD
+#undef DISCORD_LIST_FIELD
+#undef DISCORD_END
+
+	//Decoders of the raw "d" of either encoding, a null object is left as it is
+
+	template<class S, class T> bool read_list(S& s, std::vector<T>& v, event_strings& strings);
+
+#define DISCORD_OBJECT(T)																		\
+	template<class S> bool read_object(S& s, T& out, event_strings& strings) {				\
+		std::string_view key;																	\
+		if (s.read_null()) return true;															\
+		if (!s.enter_object()) return false;													\
+		while (s.next_key(key)) {																\
+			bool ok;																			\
+			if (false) ok = false;
+#define DISCORD_FIELD(K, F)				else if (key == #F) ok = kind::K::read(s, out.F, strings);
+#define DISCORD_OBJECT_FIELD(T, F)		else if (key == #F) ok = read_object(s, out.F, strings);
+#define DISCORD_LIST_FIELD(T, F)		else if (key == #F) ok = read_list(s, out.F, strings);
+#define DISCORD_END(T)																			\
+			else ok = s.skip_value();															\
+			if (!ok) return false;																\
+		}																						\
+		return s.ok();																			\
+	}
+#include <discord_objects.def>
+#undef DISCORD_OBJECT
+#undef DISCORD_FIELD
+#undef DISCORD_OBJECT_FIELD
+#undef DISCORD_LIST_FIELD
+#undef DISCORD_END
+
+	template<class S, class T> bool read_list(S& s, std::vector<T>& v, event_strings& strings) {
+		if (s.read_null()) return true;
+		if (!s.enter_array()) return false;
+		while (s.next_element()) {
+			v.emplace_back();
+			if (!read_object(s, v.back(), strings)) return false;
+		}
+		return s.ok();
+	}
+
+	/**
+	 * Decode an object from its raw text.
+	 */
+	template<class T> bool from_json(std::string_view raw, T& out, event_strings& strings) {
+		json_scanner s(raw);
+		return read_object(s, out, strings) && s.ok();
+	}
+
+	//Decoders of a DOM, the strings point into it
+
+#define DISCORD_OBJECT(T)																		\
+	inline void from_json(const nlohmann::json& j, T& out) {									\
+		if (!j.is_object()) return;																\
+		nlohmann::json::const_iterator it;
+#define DISCORD_FIELD(K, F)				if ((it = j.find(#F)) != j.end()) kind::K::read_dom(*it, out.F);
+#define DISCORD_OBJECT_FIELD(T, F)		if ((it = j.find(#F)) != j.end()) from_json(*it, out.F);
+#define DISCORD_LIST_FIELD(T, F)																\
+		if ((it = j.find(#F)) != j.end() && it->is_array()) {									\
+			out.F.resize(it->size());															\
+			for (size_t i = 0; i < it->size(); i++) from_json((*it)[i], out.F[i]);				\
+		}
+#define DISCORD_END(T)					}
+#include <discord_objects.def>
+#undef DISCORD_OBJECT
+#undef DISCORD_FIELD
+#undef DISCORD_OBJECT_FIELD
+#undef DISCORD_LIST_FIELD
+#undef DISCORD_END
+
+	//Encoders, every field is written, an absent one as its null or zero value
+
+#define DISCORD_OBJECT(T)																		\
+	inline void to_json(std::string& out, const T& v) {										\
+		char separator = '{';
+#define DISCORD_KEY(F)																			\
+		out += separator;																		\
+		separator = ',';																		\
+		out += "\"" #F "\":";
+#define DISCORD_FIELD(K, F)				DISCORD_KEY(F) kind::K::write(out, v.F);
+#define DISCORD_OBJECT_FIELD(T, F)		DISCORD_KEY(F) to_json(out, v.F);
+#define DISCORD_LIST_FIELD(T, F)																\
+		DISCORD_KEY(F)																			\
+		out += '[';																				\
+		for (size_t i = 0; i < v.F.size(); i++) {												\
+			if (i > 0) out += ',';																\
+			to_json(out, v.F[i]);																\
+		}																						\
+		out += ']';
+#define DISCORD_END(T)																			\
+		if (separator == '{') out += '{';														\
+		out += '}';																				\
+	}
+#include <discord_objects.def>
+#undef DISCORD_OBJECT
+#undef DISCORD_KEY
+#undef DISCORD_FIELD
+#undef DISCORD_OBJECT_FIELD
+#undef DISCORD_LIST_FIELD
+#undef DISCORD_END
+
+	/*
+	 * An object decoded from a gateway event, with the strings it could not point to.
+	 */
+	template<class T> struct decoded {
+		T				value;
+		event_strings	strings;
+	};
+
+	template<class S, class T> bool read_event(S& s, decoded<T>& e) {
+		return read_object(s, e.value, e.strings);
+	}
+
+}
+
+/*
+ * Events handled typed through the object model.
+ */
+
+template<> struct event_traits<event::CHANNEL_CREATE>	{ typedef discord::decoded<discord::channel> type; };
+
+template<> struct event_traits<event::CHANNEL_UPDATE>	{ typedef discord::decoded<discord::channel> type; };
+
+template<> struct event_traits<event::CHANNEL_DELETE>	{ typedef discord::decoded<discord::channel> type; };
+
+template<> struct event_traits<event::GUILD_CREATE>		{ typedef discord::decoded<discord::guild> type; };
+
+template<> struct event_traits<event::GUILD_UPDATE>		{ typedef discord::decoded<discord::guild> type; };
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef ENTITY_CACHE
+#define ENTITY_CACHE
+
+#include <flat_map.hpp>
+#include <member_store.h>
+#include <rcu_map.hpp>
+#include <permission_cache.h>
+#include <snowflake.hpp>
+#include <events.h>
+#include <misc/json.hpp>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Compact copies of the entities the gateway sends, only the fields the bot uses.
+ */
+
+struct cached_role {
+	snowflake			id;
+	snowflake			guild_id;
+	uint64_t			permissions = 0;
+	uint32_t			color = 0;
+	int32_t				position = 0;
+	std::string			name;
+};
+
+struct permission_overwrite {
+
+	enum target {
+
+		ROLE	,
+
+		MEMBER
+	};
+
+	snowflake			id;
+	uint64_t			allow = 0;
+	uint64_t			deny = 0;
+	target				type = ROLE;
+};
+
+struct cached_channel {
+	snowflake			id;
+	snowflake			guild_id;
+	snowflake			parent_id;
+	int32_t				position = 0;
+	uint8_t				type = 0;
+	std::string			name;
+	std::vector<permission_overwrite> overwrites;
+};
+
+struct cached_guild {
+	snowflake				id;
+	snowflake				owner_id;
+	std::string				name;
+	uint32_t				member_count = 0;
+	std::vector<snowflake>	channels;
+	std::vector<snowflake>	roles;
+};
+
+/*
+ * Class entity_cache keeps the guilds, channels, roles and members the gateway
+ * sends (GUILD_CREATE, CHANNEL_*, GUILD_ROLE_*, GUILD_MEMBER_*, GUILD_MEMBERS_CHUNK)
+ * so that handlers read them here instead of over REST.
+ * Guilds, channels and roles are kept in rcu_maps keyed by snowflake, members in a
+ * member_store which interns their strings and role sets and can be bounded in memory.
+ *
+ * Handlers read far more often than events change the cache. visit_guild, visit_channel
+ * and visit_role take no lock, they read under an rcu::read_guard while an event publishes
+ * new versions of what it changes. Events are applied one at a time under an exclusive
+ * lock, which visit_member holds shared since members are changed in place.
+ * The visit_ methods call f inside the read section, f must not keep references to what
+ * it is given.
+ */
+class entity_cache {
+
+public:
+
+	struct memory_stats {
+		size_t		guilds;
+		size_t		channels;
+		size_t		roles;
+		size_t		members;
+		uint64_t	evicted_members;
+		size_t		guild_bytes;
+		size_t		channel_bytes;
+		size_t		role_bytes;
+		size_t		member_bytes;
+
+		size_t total_bytes() const { return guild_bytes + channel_bytes + role_bytes + member_bytes; }
+
+		/**
+		 * @return Bytes per cached member, the interned strings and role sets shared out.
+		 */
+		double bytes_per_member() const { return members ? double(member_bytes) / members : 0; }
+
+		/**
+		 * @return Bytes per cached guild, its channels and roles included but not its members.
+		 */
+		double bytes_per_guild() const { return guilds ? double(guild_bytes + channel_bytes + role_bytes) / guilds : 0; }
+	};
+
+	/**
+	 * Bound the memory of the members, the least recently used are evicted past it.
+	 *
+	 * @param bytes The limit, 0 for none (the default).
+	 */
+	void set_member_memory_limit(size_t bytes);
+
+	/**
+	 * Forget every entity and cached permission, for a session whose events will not be replayed.
+	 */
+	void clear();
+
+	/**
+	 * @return Whether the cache consumes e.
+	 */
+	static bool is_cached(event::type e);
+
+	/**
+	 * Apply a dispatched event.
+	 *
+	 * @param e The event.
+	 * @param d The "d" of the event.
+	 */
+	void update(event::type e, const nlohmann::json& d);
+
+	template<class F> bool visit_guild(snowflake id, F f) const {
+		rcu::read_guard guard;
+		const cached_guild* g = m_guilds.find(id);
+		if (g == nullptr) return false;
+		f(*g);
+		return true;
+	}
+
+	template<class F> bool visit_channel(snowflake id, F f) const {
+		rcu::read_guard guard;
+		const cached_channel* c = m_channels.find(id);
+		if (c == nullptr) return false;
+		f(*c);
+		return true;
+	}
+
+	template<class F> bool visit_role(snowflake id, F f) const {
+		rcu::read_guard guard;
+		const cached_role* r = m_roles.find(id);
+		if (r == nullptr) return false;
+		f(*r);
+		return true;
+	}
+
+	/**
+	 * f is given a const member_view&, false if the member is not cached or was evicted.
+	 */
+	template<class F> bool visit_member(snowflake guild_id, snowflake user_id, F f) const {
+		std::shared_lock<std::shared_mutex> lock(m_lock);
+		member_view m;
+		if (!m_members.find(guild_id, user_id, m)) return false;
+		f(static_cast<const member_view&>(m));
+		return true;
+	}
+
+	/**
+	 * Permissions of a member, computed from the roles and overwrites in the cache as Discord
+	 * does and cached until an event changes the guild's roles, the channel or the member.
+	 *
+	 * @param channel_id The channel, 0 for the base permissions in the guild.
+	 * @return The permission bits, permission::ALL for the owner and administrators, 0 if the
+	 * guild, the channel or the member is not cached.
+	 */
+	uint64_t get_permissions(snowflake guild_id, snowflake user_id, snowflake channel_id = snowflake()) const;
+
+	/**
+	 * @return Whether the member has every bit of perms in the channel (or the guild if channel_id is 0).
+	 */
+	bool has_permissions(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t perms) const {
+		return (get_permissions(guild_id, user_id, channel_id) & perms) == perms;
+	}
+
+	/**
+	 * Walks every table, meant for monitoring rather than for every event.
+	 */
+	memory_stats get_memory_stats() const;
+
+private:
+
+	friend class cache_snapshot;
+
+	void on_guild(const nlohmann::json& d, bool create);
+
+	void on_guild_delete(snowflake id);
+
+	/*
+	 * Add or update a channel.
+	 *
+	 * @param link Whether to add a new channel to its guild's list, on_guild makes the list itself.
+	 * @return Whether the channel is new.
+	 */
+	bool on_channel(const nlohmann::json& d, snowflake guild_id, bool link);
+
+	void on_channel_delete(snowflake id);
+
+	bool on_role(const nlohmann::json& d, snowflake guild_id, bool link);
+
+	void on_role_delete(snowflake guild_id, snowflake id);
+
+	void on_member(const nlohmann::json& d, snowflake guild_id);
+
+	void on_member_remove(snowflake guild_id, snowflake user_id);
+
+	/*
+	 * Publish a copy of a guild changed by f, if the guild is cached.
+	 */
+	template<class F> void update_guild(snowflake id, F f) {
+		const cached_guild* g = m_guilds.find(id);
+		if (g == nullptr) return;
+		cached_guild copy = *g;
+		f(copy);
+		m_guilds.assign(id, std::move(copy));
+	}
+
+	static uint64_t to_permissions(const nlohmann::json& j);
+
+	/*
+	 * Compute permissions under the locks, without the permission cache.
+	 *
+	 * @return Whether the member is cached, perms is only set if it is.
+	 */
+	bool compute_permissions(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t& perms) const;
+
+	/*
+	 * Invalidate the cached permissions an event changes.
+	 */
+	void invalidate_permissions(event::type e, const nlohmann::json& d);
+
+	mutable std::shared_mutex					m_lock;
+	rcu_map<snowflake, cached_guild>			m_guilds;
+	rcu_map<snowflake, cached_channel>			m_channels;
+	rcu_map<snowflake, cached_role>				m_roles;
+	member_store								m_members;
+	mutable permission_cache					m_permissions;
+
+};
+
+#endif
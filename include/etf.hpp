@@ -0,0 +1,664 @@
+#ifndef DISCORD_ETF
+#define DISCORD_ETF
+
+#include <misc/json.hpp>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+
+/*
+ * Erlang External Term Format, the binary encoding of the gateway (encoding=etf).
+ * Class scanner walks a term in place like json_scanner does a JSON text, so the envelope
+ * and the typed events are read without building a DOM. Class decoder converts a term to
+ * nlohmann::json for the handlers that want one, they see the same objects as with
+ * encoding=json:
+ *
+ *	atoms nil, true, false	<-> null, true, false
+ *	other atoms, binaries	<-> strings
+ *	maps					<-> objects
+ *	lists, tuples			<-> arrays
+ *	string lists			 -> arrays of numbers, Erlang sends lists of bytes such as
+ *							    "shard":[0,1] as STRING_EXT
+ *	integers of id fields	 -> strings, snowflakes are sent as integers over ETF while
+ *							    the JSON gateway sends them as strings (see is_id_key())
+ */
+namespace etf {
+
+	enum tag {
+		NEW_FLOAT_EXT		= 70,
+		SMALL_INTEGER_EXT	= 97,
+		INTEGER_EXT			= 98,
+		FLOAT_EXT			= 99,
+		ATOM_EXT			= 100,
+		SMALL_TUPLE_EXT		= 104,
+		LARGE_TUPLE_EXT		= 105,
+		NIL_EXT				= 106,
+		STRING_EXT			= 107,
+		LIST_EXT			= 108,
+		BINARY_EXT			= 109,
+		SMALL_BIG_EXT		= 110,
+		LARGE_BIG_EXT		= 111,
+		MAP_EXT				= 116,
+		SMALL_ATOM_EXT		= 115,
+		ATOM_UTF8_EXT		= 118,
+		SMALL_ATOM_UTF8_EXT	= 119,
+		FORMAT_VERSION		= 131
+	};
+
+	/**
+	 * @return Whether the integers of a field are ids: "id", "..._id", "..._ids" and the
+	 * role lists, "roles" and "mention_roles".
+	 */
+	inline bool is_id_key(std::string_view key) {
+		auto ends_with = [key](std::string_view suffix) {
+			return key.size() >= suffix.size() && key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0;
+		};
+		return key == "id" || ends_with("_id") || ends_with("_ids") || key == "roles" || key == "mention_roles";
+	}
+
+	/*
+	 * Bounds checked big endian reads, shared by the scanner and the decoder.
+	 * Reading past the end puts the reader in a failed state, see ok().
+	 */
+	class reader {
+
+	public:
+
+		reader(const char* data, size_t len) :
+			m_p(reinterpret_cast<const uint8_t*>(data)),
+			m_end(reinterpret_cast<const uint8_t*>(data) + len),
+			m_ok(true)
+		{}
+
+		bool ok() const { return m_ok; }
+
+	protected:
+
+		bool fail() {
+			m_ok = false;
+			return false;
+		}
+
+		bool has(uint64_t n) {
+			if (static_cast<uint64_t>(m_end - m_p) >= n) return true;
+			return fail();
+		}
+
+		bool advance(uint64_t n) {
+			if (!has(n)) return false;
+			m_p += n;
+			return true;
+		}
+
+		uint8_t u8() {
+			return has(1) ? *m_p++ : 0;
+		}
+
+		uint16_t u16() {
+			if (!has(2)) return 0;
+			uint16_t v = (m_p[0] << 8) | m_p[1];
+			m_p += 2;
+			return v;
+		}
+
+		uint32_t u32() {
+			if (!has(4)) return 0;
+			uint32_t v = (uint32_t(m_p[0]) << 24) | (uint32_t(m_p[1]) << 16) | (uint32_t(m_p[2]) << 8) | m_p[3];
+			m_p += 4;
+			return v;
+		}
+
+		uint64_t u64() {
+			uint64_t high = u32();
+			return (high << 32) | u32();
+		}
+
+		std::string_view view(uint64_t n) {
+			if (!has(n)) return std::string_view();
+			std::string_view v(reinterpret_cast<const char*>(m_p), static_cast<size_t>(n));
+			m_p += n;
+			return v;
+		}
+
+		/**
+		 * Read the integer of a tag that was just consumed.
+		 *
+		 * @return False if tag is not an integer or it does not fit in 64 bits.
+		 */
+		bool integer(uint8_t tag, uint64_t& magnitude, bool& negative) {
+			uint32_t n;
+			switch (tag) {
+			case SMALL_INTEGER_EXT:
+				magnitude = u8();
+				negative = false;
+				return m_ok;
+			case INTEGER_EXT: {
+				int32_t v = static_cast<int32_t>(u32());
+				negative = v < 0;
+				magnitude = negative ? 0 - static_cast<uint64_t>(static_cast<int64_t>(v)) : static_cast<uint64_t>(v);
+				return m_ok;
+			}
+			case SMALL_BIG_EXT:
+				n = u8();
+				break;
+			case LARGE_BIG_EXT:
+				n = u32();
+				break;
+			default:
+				return false;
+			}
+			negative = u8() != 0;
+			if (n > 8 || !has(n)) return fail();
+			magnitude = 0;
+			for (uint32_t i = 0; i < n; i++) magnitude |= static_cast<uint64_t>(m_p[i]) << (8 * i);
+			m_p += n;
+			return true;
+		}
+
+		static bool is_atom(uint8_t tag) {
+			return tag == ATOM_EXT || tag == ATOM_UTF8_EXT || tag == SMALL_ATOM_EXT || tag == SMALL_ATOM_UTF8_EXT;
+		}
+
+		/**
+		 * Read the name of an atom whose tag was just consumed.
+		 */
+		std::string_view atom_name(uint8_t tag) {
+			return view(tag == ATOM_EXT || tag == ATOM_UTF8_EXT ? u16() : u8());
+		}
+
+		const uint8_t*	m_p;
+		const uint8_t*	m_end;
+		bool			m_ok;
+
+	};
+
+	/*
+	 * Class scanner walks a term in place without building a DOM, with the interface of
+	 * json_scanner so the same decoders read either encoding. Strings are views into the
+	 * data and never escaped, values that are not needed are skipped as a whole or
+	 * returned as a raw span to be decoded later. A term is read without its version byte.
+	 */
+	class scanner : public reader {
+
+	public:
+
+		scanner(std::string_view term) : reader(term.data(), term.size()), m_depth(0), m_byte(false) {}
+
+		/**
+		 * Consume the header of a map.
+		 */
+		bool enter_object() {
+			if (m_byte || u8() != MAP_EXT) return fail();
+			return push(MAP_EXT, u32());
+		}
+
+		/**
+		 * Move to the next key of the current map.
+		 *
+		 * @param key Set to the key, an atom or a binary.
+		 * @return False when the map has no more keys.
+		 */
+		bool next_key(std::string_view& key) {
+			if (!m_ok || m_depth == 0) return false;
+			level& l = m_levels[m_depth - 1];
+			if (l.tag != MAP_EXT) return fail();
+			if (l.remaining == 0) {
+				m_depth--;
+				return false;
+			}
+			l.remaining--;
+			bool escaped;
+			return read_string(key, escaped);
+		}
+
+		/**
+		 * Consume the header of a list or a tuple, the empty list included.
+		 */
+		bool enter_array() {
+			if (m_byte) return fail();
+			uint8_t tag = u8();
+			switch (tag) {
+			case NIL_EXT:
+				return push(NIL_EXT, 0);
+			case LIST_EXT:
+				return push(LIST_EXT, u32());
+			case SMALL_TUPLE_EXT:
+				return push(SMALL_TUPLE_EXT, u8());
+			case LARGE_TUPLE_EXT:
+				return push(SMALL_TUPLE_EXT, u32());
+			case STRING_EXT:
+				return push(STRING_EXT, u16());
+			default:
+				return fail();
+			}
+		}
+
+		/**
+		 * Move to the next element of the current array.
+		 *
+		 * @return False when the array has no more elements.
+		 */
+		bool next_element() {
+			if (!m_ok || m_depth == 0) return false;
+			level& l = m_levels[m_depth - 1];
+			if (l.tag == MAP_EXT) return fail();
+			if (l.remaining == 0) {
+				m_depth--;
+				//Proper lists end with NIL_EXT
+				if (l.tag == LIST_EXT && u8() != NIL_EXT) return fail();
+				return false;
+			}
+			l.remaining--;
+			//The elements of a string list are bare bytes
+			m_byte = l.tag == STRING_EXT;
+			return true;
+		}
+
+		/**
+		 * @param raw	  Set to the binary or the name of the atom.
+		 * @param escaped Always false, ETF strings have no escape sequences.
+		 */
+		bool read_string(std::string_view& raw, bool& escaped) {
+			if (m_byte) return fail();
+			escaped = false;
+			uint8_t tag = u8();
+			if (tag == BINARY_EXT) raw = view(u32());
+			else if (is_atom(tag)) raw = atom_name(tag);
+			else return fail();
+			return m_ok;
+		}
+
+		bool read_int(int64_t& value) {
+			uint64_t magnitude;
+			bool negative;
+			if (!read_integer(magnitude, negative)) return false;
+			if (magnitude > static_cast<uint64_t>(INT64_MAX) + negative) return fail();
+			value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+			return true;
+		}
+
+		/**
+		 * Read a non negative integer, such as a snowflake.
+		 */
+		bool read_uint(uint64_t& value) {
+			bool negative;
+			if (!read_integer(value, negative)) return false;
+			return !negative || fail();
+		}
+
+		bool read_bool(bool& value) {
+			std::string_view name;
+			bool escaped;
+			if (!is_atom(peek()) || !read_string(name, escaped)) return fail();
+			if (name == "true") value = true;
+			else if (name == "false") value = false;
+			else return fail();
+			return true;
+		}
+
+		/**
+		 * Consume a nil atom if it is the next value.
+		 */
+		bool read_null() {
+			if (m_byte || !is_atom(peek())) return false;
+			const uint8_t* p = m_p;
+			uint8_t tag = u8();
+			std::string_view name = atom_name(tag);
+			if (m_ok && (name == "nil" || name == "null")) return true;
+			m_p = p;
+			return false;
+		}
+
+		/**
+		 * @return The tag of the next value without consuming it, 0 at the end.
+		 */
+		uint8_t peek() const {
+			if (m_byte) return SMALL_INTEGER_EXT;
+			return m_p < m_end ? *m_p : 0;
+		}
+
+		/**
+		 * Skip the next value, nested terms included.
+		 *
+		 * @param span If not null, set to the raw bytes of the term.
+		 */
+		bool skip_value(std::string_view* span = nullptr) {
+			const uint8_t* begin = m_p;
+			if (m_byte) {
+				m_byte = false;
+				if (!advance(1)) return false;
+				if (span != nullptr) *span = std::string_view(reinterpret_cast<const char*>(begin), 1);
+				return true;
+			}
+			//Terms still to skip, containers add their elements
+			uint64_t pending = 1;
+			while (pending > 0 && m_ok) {
+				pending--;
+				switch (u8()) {
+				case SMALL_INTEGER_EXT: advance(1); break;
+				case INTEGER_EXT: advance(4); break;
+				case NEW_FLOAT_EXT: advance(8); break;
+				case FLOAT_EXT: advance(31); break;
+				case ATOM_EXT:
+				case ATOM_UTF8_EXT: advance(u16()); break;
+				case SMALL_ATOM_EXT:
+				case SMALL_ATOM_UTF8_EXT: advance(u8()); break;
+				case SMALL_TUPLE_EXT: pending += u8(); break;
+				case LARGE_TUPLE_EXT: pending += u32(); break;
+				case NIL_EXT: break;
+				case STRING_EXT: advance(u16()); break;
+				case LIST_EXT: pending += static_cast<uint64_t>(u32()) + 1; break;
+				case BINARY_EXT: advance(u32()); break;
+				case SMALL_BIG_EXT: advance(static_cast<uint64_t>(u8()) + 1); break;
+				case LARGE_BIG_EXT: advance(static_cast<uint64_t>(u32()) + 1); break;
+				case MAP_EXT: pending += 2 * static_cast<uint64_t>(u32()); break;
+				default: return fail();
+				}
+			}
+			if (!m_ok) return false;
+			if (span != nullptr) *span = std::string_view(reinterpret_cast<const char*>(begin), m_p - begin);
+			return true;
+		}
+
+		/**
+		 * Find key among the keys of a map.
+		 *
+		 * @param object The raw bytes of a map.
+		 * @param key	 The key to look for.
+		 * @return The raw bytes of its value, empty if there is no such key.
+		 */
+		static std::string_view find_key(std::string_view object, std::string_view key) {
+			scanner s(object);
+			std::string_view k, value;
+			if (!s.enter_object()) return {};
+			while (s.next_key(k)) {
+				if (!s.skip_value(&value)) return {};
+				if (k == key) return value;
+			}
+			return {};
+		}
+
+	private:
+
+		//Containers deeper than this are rejected, the gateway's objects are a few levels deep
+		static const size_t MAX_DEPTH = 32;
+
+		struct level {
+			uint8_t		tag;
+			uint32_t	remaining;
+		};
+
+		bool push(uint8_t tag, uint32_t remaining) {
+			if (!m_ok || m_depth == MAX_DEPTH) return fail();
+			m_levels[m_depth++] = { tag, remaining };
+			return true;
+		}
+
+		bool read_integer(uint64_t& magnitude, bool& negative) {
+			if (m_byte) {
+				m_byte = false;
+				negative = false;
+				magnitude = u8();
+				return m_ok;
+			}
+			return integer(u8(), magnitude, negative) || fail();
+		}
+
+		level	m_levels[MAX_DEPTH];
+		size_t	m_depth;
+		bool	m_byte;
+
+	};
+
+	class decoder : public reader {
+
+	public:
+
+		decoder(const char* data, size_t len) : reader(data, len) {}
+
+		/**
+		 * Decode a whole term, starting with its version byte.
+		 *
+		 * @return The term as JSON, null if the data is not valid ETF (see ok()).
+		 */
+		nlohmann::json decode() {
+			if (u8() != FORMAT_VERSION) {
+				m_ok = false;
+				return nullptr;
+			}
+			return decode_term();
+		}
+
+		/**
+		 * Decode a term without its version byte, such as a span of the scanner.
+		 */
+		nlohmann::json decode_term() {
+			nlohmann::json j = term(false);
+			return m_ok ? j : nlohmann::json();
+		}
+
+	private:
+
+		/**
+		 * @param id Whether the term is the value of an id field, its integers are strings.
+		 */
+		nlohmann::json term(bool id) {
+			uint8_t tag = u8();
+			switch (tag) {
+			case SMALL_INTEGER_EXT:
+			case INTEGER_EXT:
+			case SMALL_BIG_EXT:
+			case LARGE_BIG_EXT: {
+				uint64_t magnitude;
+				bool negative;
+				if (!integer(tag, magnitude, negative)) return nullptr;
+				if (id) return negative ? "-" + std::to_string(magnitude) : std::to_string(magnitude);
+				if (!negative) return magnitude;
+				if (magnitude <= static_cast<uint64_t>(INT64_MAX) + 1) return static_cast<int64_t>(0 - magnitude);
+				return -static_cast<double>(magnitude);
+			}
+			case NEW_FLOAT_EXT: {
+				uint64_t bits = u64();
+				double d;
+				std::memcpy(&d, &bits, sizeof(d));
+				return d;
+			}
+			case FLOAT_EXT: {
+				std::string s(view(31));
+				return std::strtod(s.c_str(), nullptr);
+			}
+			case ATOM_EXT:
+			case ATOM_UTF8_EXT:
+			case SMALL_ATOM_EXT:
+			case SMALL_ATOM_UTF8_EXT:
+				return atom(atom_name(tag));
+			case SMALL_TUPLE_EXT:
+				return elements(u8(), id);
+			case LARGE_TUPLE_EXT:
+				return elements(u32(), id);
+			case NIL_EXT:
+				return nlohmann::json::array();
+			case STRING_EXT:
+				return string_list(u16());
+			case LIST_EXT: {
+				nlohmann::json list = elements(u32(), id);
+				//Proper lists end with NIL_EXT
+				if (u8() != NIL_EXT) m_ok = false;
+				return list;
+			}
+			case BINARY_EXT:
+				return std::string(view(u32()));
+			case MAP_EXT: {
+				uint32_t arity = u32();
+				nlohmann::json map = nlohmann::json::object();
+				for (uint32_t i = 0; i < arity && m_ok; i++) {
+					nlohmann::json key = term(false);
+					std::string name = key.is_string() ? key.get<std::string>() : key.dump();
+					map[name] = term(is_id_key(name));
+				}
+				return map;
+			}
+			default:
+				m_ok = false;
+				return nullptr;
+			}
+		}
+
+		nlohmann::json atom(std::string_view name) {
+			if (name == "nil" || name == "null") return nullptr;
+			if (name == "true") return true;
+			if (name == "false") return false;
+			return std::string(name);
+		}
+
+		nlohmann::json elements(uint32_t n, bool id) {
+			nlohmann::json list = nlohmann::json::array();
+			for (uint32_t i = 0; i < n && m_ok; i++) list.push_back(term(id));
+			return list;
+		}
+
+		nlohmann::json string_list(uint16_t n) {
+			nlohmann::json list = nlohmann::json::array();
+			if (!has(n)) return list;
+			for (uint16_t i = 0; i < n; i++) list.push_back(m_p[i]);
+			m_p += n;
+			return list;
+		}
+
+	};
+
+	class encoder {
+
+	public:
+
+		/**
+		 * Encode j as a term, starting with the version byte.
+		 */
+		std::string encode(const nlohmann::json& j) {
+			m_out.clear();
+			m_out += static_cast<char>(FORMAT_VERSION);
+			term(j);
+			return m_out;
+		}
+
+	private:
+
+		void term(const nlohmann::json& j) {
+			switch (j.type()) {
+			case nlohmann::json::value_t::null:
+				atom("nil");
+				break;
+			case nlohmann::json::value_t::boolean:
+				atom(j.get<bool>() ? "true" : "false");
+				break;
+			case nlohmann::json::value_t::number_integer:
+				integer(j.get<int64_t>());
+				break;
+			case nlohmann::json::value_t::number_unsigned: {
+				uint64_t v = j.get<uint64_t>();
+				if (v <= INT32_MAX) integer(static_cast<int64_t>(v));
+				else big(v, false);
+				break;
+			}
+			case nlohmann::json::value_t::number_float: {
+				double d = j.get<double>();
+				uint64_t bits;
+				std::memcpy(&bits, &d, sizeof(d));
+				u8(NEW_FLOAT_EXT);
+				u32(static_cast<uint32_t>(bits >> 32));
+				u32(static_cast<uint32_t>(bits));
+				break;
+			}
+			case nlohmann::json::value_t::string:
+				binary(j.get_ref<const std::string&>());
+				break;
+			case nlohmann::json::value_t::array:
+				if (!j.empty()) {
+					u8(LIST_EXT);
+					u32(static_cast<uint32_t>(j.size()));
+					for (const nlohmann::json& e : j) term(e);
+				}
+				u8(NIL_EXT);
+				break;
+			case nlohmann::json::value_t::object:
+				u8(MAP_EXT);
+				u32(static_cast<uint32_t>(j.size()));
+				for (auto& i : j.items()) {
+					binary(i.key());
+					term(i.value());
+				}
+				break;
+			default:
+				atom("nil");
+				break;
+			}
+		}
+
+		void integer(int64_t v) {
+			if (v >= 0 && v <= 255) {
+				u8(SMALL_INTEGER_EXT);
+				u8(static_cast<uint8_t>(v));
+			}
+			else if (v >= INT32_MIN && v <= INT32_MAX) {
+				u8(INTEGER_EXT);
+				u32(static_cast<uint32_t>(static_cast<int32_t>(v)));
+			}
+			else {
+				big(v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v), v < 0);
+			}
+		}
+
+		void big(uint64_t v, bool negative) {
+			uint8_t n = 0;
+			char digits[8];
+			while (v) {
+				digits[n++] = static_cast<char>(v & 0xFF);
+				v >>= 8;
+			}
+			u8(SMALL_BIG_EXT);
+			u8(n);
+			u8(negative ? 1 : 0);
+			m_out.append(digits, n);
+		}
+
+		void atom(const char* name) {
+			size_t n = std::strlen(name);
+			u8(SMALL_ATOM_UTF8_EXT);
+			u8(static_cast<uint8_t>(n));
+			m_out.append(name, n);
+		}
+
+		void binary(const std::string& s) {
+			u8(BINARY_EXT);
+			u32(static_cast<uint32_t>(s.size()));
+			m_out += s;
+		}
+
+		void u8(uint8_t v) {
+			m_out += static_cast<char>(v);
+		}
+
+		void u32(uint32_t v) {
+			u8(static_cast<uint8_t>(v >> 24));
+			u8(static_cast<uint8_t>(v >> 16));
+			u8(static_cast<uint8_t>(v >> 8));
+			u8(static_cast<uint8_t>(v));
+		}
+
+		std::string m_out;
+
+	};
+
+	inline nlohmann::json decode(const std::string& data) {
+		return decoder(data.data(), data.size()).decode();
+	}
+
+	inline std::string encode(const nlohmann::json& j) {
+		return encoder().encode(j);
+	}
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef EVENT_EXECUTOR
+#define EVENT_EXECUTOR
+
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <snowflake.hpp>
+#include <cstdint>
+
+/*
+ * Class event_executor runs event handlers on a pool of worker threads.
+ * Every task is posted with a key (the guild id of the event), tasks sharing a key
+ * form a strand and run one at a time in the order they were posted, while
+ * strands of different keys run in parallel on the workers.
+ */
+class event_executor {
+
+public:
+
+	typedef std::function<void()>			task;
+
+	typedef std::chrono::steady_clock		clock;
+
+	/*
+	 * The tasks of one owner, a bot sharing the executor with others. drain() drops those
+	 * still queued and waits for the running ones, so the owner can go.
+	 */
+	class group {
+
+	public:
+
+		group() {}
+
+		group(const group&) = delete;
+
+	private:
+
+		friend class event_executor;
+
+		size_t	pending = 0;
+		bool	drained = false;
+
+	};
+
+	struct stats {
+		size_t		queue_depth;
+		size_t		max_queue_depth;
+		size_t		strands;
+		uint64_t	executed;
+		uint64_t	average_wait_us;
+		uint64_t	average_run_us;
+		uint64_t	max_run_us;
+	};
+
+	/**
+	 * @param threads Number of worker threads, at least one is started.
+	 */
+	event_executor(size_t threads);
+
+	/**
+	 * Run the tasks left in the queue then join the workers.
+	 */
+	~event_executor();
+
+	event_executor(const event_executor&) = delete;
+
+	/**
+	 * Queue t behind the other tasks of the strand key.
+	 *
+	 * @param key The strand to run t on.
+	 * @param t	  The task.
+	 */
+	void post(snowflake key, task t);
+
+	/**
+	 * Queue t for the owner g, dropped if g is drained before it runs.
+	 */
+	void post(snowflake key, task t, group& g);
+
+	/**
+	 * Drop the queued tasks of g and wait for those running, the tasks g posts later are
+	 * dropped too. Must not be called from a task of g.
+	 */
+	void drain(group& g);
+
+	/**
+	 * @return Queue depth and handler latency measured so far.
+	 */
+	stats get_stats() const;
+
+private:
+
+	struct job {
+		task				t;
+		clock::time_point	queued;
+		group*				owner;
+	};
+
+	struct strand {
+		std::deque<job>		jobs;
+		bool				active = false;
+	};
+
+	void push(snowflake key, job j);
+
+	void run();
+
+	mutable std::mutex						m_lock;
+	std::condition_variable					m_cv;
+	std::condition_variable					m_drained;
+	std::unordered_map<snowflake, strand>	m_strands;
+	std::deque<snowflake>					m_ready;
+	std::vector<std::thread>				m_workers;
+	bool									m_stop;
+
+	size_t									m_depth;
+	size_t									m_max_depth;
+	uint64_t								m_executed;
+	uint64_t								m_wait_total_us;
+	uint64_t								m_run_total_us;
+	uint64_t								m_max_run_us;
+
+};
+
+#endif
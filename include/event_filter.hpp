@@ -0,0 +1,123 @@
+#ifndef EVENT_FILTER
+#define EVENT_FILTER
+
+#include <events.h>
+#include <bitset>
+#include <cstring>
+#include <string_view>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define EVENT_FILTER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/*
+ * Class event_filter drops dispatch events by name before any JSON parsing.
+ * The gateway sends compact JSON where op, s and t come before "d", so the "t" and "s"
+ * of a frame can be found with a substring scan of the bytes in front of the first "d":
+ * key. Nothing in front of it can be nested, so a match there is always a top level key.
+ * A frame that does not have this layout is left to the envelope decoder.
+ */
+class event_filter {
+
+public:
+
+	void drop(event::type e) {
+		if (e != event::UNKNOWN) m_dropped.set(e);
+	}
+
+	void keep(event::type e) {
+		if (e != event::UNKNOWN) m_dropped.reset(e);
+	}
+
+	bool is_dropped(event::type e) const {
+		return e != event::UNKNOWN && m_dropped.test(e);
+	}
+
+	bool empty() const {
+		return m_dropped.none();
+	}
+
+	/**
+	 * Scan a frame for its event name and decide if it is dropped.
+	 * The sequence is only read (and only valid) for a dropped frame, it must still
+	 * be tracked for heartbeats and RESUME.
+	 *
+	 * @param frame	   The raw (inflated) JSON text of the payload.
+	 * @param sequence Set to the "s" of a dropped frame.
+	 * @return Whether the frame can be dropped.
+	 */
+	bool try_drop(std::string_view frame, int& sequence) const {
+		if (m_dropped.none()) return false;
+
+		const char* begin = frame.data();
+		const char* end = begin + frame.size();
+		const char* d = find(begin, end, "\"d\":");
+		const char* t = find(begin, d, "\"t\":\"");
+		if (t == d) return false;
+
+		t += 5;
+		const char* t_end = static_cast<const char*>(std::memchr(t, '"', d - t));
+		if (t_end == nullptr) return false;
+		if (!is_dropped(event::from_name(std::string_view(t, t_end - t)))) return false;
+
+		const char* s = find(begin, d, "\"s\":");
+		if (s == d) return false;
+		s += 4;
+		int n = 0;
+		if (s >= d || *s < '0' || *s > '9') return false;
+		while (s < d && *s >= '0' && *s <= '9') n = n * 10 + (*s++ - '0');
+		sequence = n;
+		return true;
+	}
+
+	/**
+	 * Find needle in [p, end) comparing 16 positions at a time on the first and last
+	 * character of the needle, then checking the candidates.
+	 *
+	 * @return The start of the first match, end if there is none.
+	 */
+	static const char* find(const char* p, const char* end, std::string_view needle) {
+		size_t n = needle.size();
+		if (n == 0 || static_cast<size_t>(end - p) < n) return end;
+#ifdef EVENT_FILTER_SSE2
+		const __m128i first = _mm_set1_epi8(needle.front());
+		const __m128i last = _mm_set1_epi8(needle.back());
+		for (; p + n - 1 + 16 <= end; p += 16) {
+			__m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+			unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+			while (mask != 0) {
+				unsigned int bit = lowest_bit(mask);
+				if (n <= 2 || std::memcmp(p + bit + 1, needle.data() + 1, n - 2) == 0) return p + bit;
+				mask &= mask - 1;
+			}
+		}
+#endif
+		std::string_view rest(p, end - p);
+		size_t i = rest.find(needle);
+		return i == std::string_view::npos ? end : p + i;
+	}
+
+private:
+
+#ifdef EVENT_FILTER_SSE2
+	static unsigned int lowest_bit(unsigned int mask) {
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, mask);
+		return i;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+#endif
+
+	std::bitset<event::UNKNOWN> m_dropped;
+
+};
+
+#endif
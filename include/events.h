@@ -2,6 +2,9 @@
 #define DISCORD_EVENTS
 
 #include <payload.hpp>
+#include <array>
+#include <string_view>
+#include <cstdint>
 
 namespace intent {
 
@@ -37,6 +40,17 @@ namespace intent {
 
 }
 
+namespace gateway_encoding {
+
+	enum type {
+
+		JSON	,
+
+		ETF
+	};
+
+}
+
 namespace event {
 
 	enum type {
@@ -117,89 +131,141 @@ namespace event {
 
 		 VOICE_SERVER_UPDATE			,
 
-		 WEBHOOKS_UPDATE				
+		 WEBHOOKS_UPDATE				,
+
+		 UNKNOWN
 	};
-	
+
+	/*
+	 * Names of the events as sent in the "t" field, in the same order as event::type.
+	 */
+	inline constexpr const char* names[UNKNOWN] = {
+		"HELLO", "READY", "RESUMED", "RECONNECT", "INVALID_SESSION",
+		"CHANNEL_CREATE", "CHANNEL_UPDATE", "CHANNEL_DELETE", "CHANNEL_PINS_UPDATE",
+		"GUILD_CREATE", "GUILD_UPDATE", "GUILD_DELETE", "GUILD_BAN_ADD", "GUILD_BAN_REMOVE",
+		"GUILD_EMOJIS_UPDATE", "GUILD_INTEGRATIONS_UPDATE", "GUILD_MEMBER_ADD", "GUILD_MEMBER_REMOVE",
+		"GUILD_MEMBER_UPDATE", "GUILD_MEMBERS_CHUNK", "GUILD_ROLE_CREATE", "GUILD_ROLE_UPDATE",
+		"GUILD_ROLE_DELETE", "INVITE_CREATE", "INVITE_DELETE", "MESSAGE_CREATE", "MESSAGE_UPDATE",
+		"MESSAGE_DELETE", "MESSAGE_DELETE_BULK", "MESSAGE_REACTION_ADD", "MESSAGE_REACTION_REMOVE",
+		"MESSAGE_REACTION_REMOVE_ALL", "MESSAGE_REACTION_REMOVE_EMOJI", "PRESENCE_UPDATE", "TYPING_START",
+		"USER_UPDATE", "VOICE_STATE_UPDATE", "VOICE_SERVER_UPDATE", "WEBHOOKS_UPDATE"
+	};
+
+	/*
+	 * FNV-1a with a seed chosen so that every event name lands in its own slot of
+	 * the lookup table, which makes from_name() one hash, one load and one compare.
+	 */
+	inline constexpr uint32_t HASH_SEED = 2166136266u;
+
+	inline constexpr size_t TABLE_SIZE = 256;
+
+	constexpr uint32_t hash(std::string_view name) {
+		uint32_t h = HASH_SEED;
+		for (char c : name) {
+			h ^= static_cast<unsigned char>(c);
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	constexpr std::array<int, TABLE_SIZE> make_table() {
+		std::array<int, TABLE_SIZE> table{};
+		for (size_t i = 0; i < TABLE_SIZE; i++) table[i] = -1;
+		for (int e = 0; e < UNKNOWN; e++) {
+			size_t slot = hash(names[e]) % TABLE_SIZE;
+			table[slot] = table[slot] == -1 ? e : UNKNOWN;
+		}
+		return table;
+	}
+
+	inline constexpr std::array<int, TABLE_SIZE> table = make_table();
+
+	constexpr bool is_perfect() {
+		for (int e = 0; e < UNKNOWN; e++) {
+			if (table[hash(names[e]) % TABLE_SIZE] != e) return false;
+		}
+		return true;
+	}
+
+	static_assert(is_perfect(), "event::HASH_SEED no longer gives a collision free table, pick another seed");
+
+	/**
+	 * Map the "t" field of a dispatch payload to its event::type.
+	 *
+	 * @param name The event name.
+	 * @return The event type, event::UNKNOWN if the name is not known.
+	 */
+	inline type from_name(std::string_view name) {
+		int e = table[hash(name) % TABLE_SIZE];
+		if (e < 0 || e == UNKNOWN || name != names[e]) return UNKNOWN;
+		return static_cast<type>(e);
+	}
 
 }
 
 
+/*
+ * Templates of the payloads the bot sends, built once and never modified: a sender copies
+ * one, or reads it into a per call builder, so senders on any thread share nothing mutable.
+ */
 namespace event_payload {
 
 	//For Gateway
 
-	inline payload identify(opcode::gateway::identify);
-
-	inline payload presence(opcode::gateway::presence_update);
+	inline const payload identify = [] {
+		payload p(opcode::gateway::identify);
+		p.set_data_key<std::string>("token", "");
+		p.set_data_key<bool>("compress", true);
+		p.set_data_key<bool>("guild_subscriptions", false);
+		p.set_data_key<int>("intents", 0);
+		p.set_data_key<nlohmann::json>("properties", 
+		nlohmann::json(
+		{ 
+			{"$os", "window"}, 
+			{"$browser", "Abby"}, 
+			{"$device", "Abby"} 
+		}));
+		p.set_data_key<nlohmann::json>("presence", nlohmann::json({ 
+			{"since", {}},
+			{"game", {{"name", "with SASANQUA <3"}, {"type", 0}, {"created_at", 0}} },
+			{"status", "online"},
+			{"afk", false}
+		}));
+		return p;
+	}();
+
+	inline const payload presence = [] {
+		payload p(opcode::gateway::presence_update);
+		p.set_data_key<nlohmann::json>("since", nullptr);
+		p.set_data_key<nlohmann::json>("game", 
+		nlohmann::json({ 
+			{"name", "with SASANQUA <3"},
+			{"type", 0}
+		}));
+		p.set_data_key<std::string>("status", "online");
+		p.set_data_key<bool>("afk", false);
+		return p;
+	}();
 
 	//For Rest API
 
-	inline payload message;
-	inline payload message_headers;
-	
-
-}
+	inline const payload message = [] {
+		payload p;
+		p.set_data_key<std::string>("content", "");
+		return p;
+	}();
+
+	inline const payload message_headers = [] {
+		payload p;
+		p.set_data_key<std::string>("Accept", "*/*");
+		p.set_data_key<std::string>("Authorization", "");
+		p.set_data_key<std::string>("User-Agent", "Abby (https://github.com/sasanquaa, 1)");
+		p.set_data_key<std::string>("Connection", "keep-alive");
+		p.set_data_key<std::string>("Content-Type", "application/json");
+		p.set_data_key<int>("Content-Length", 0);
+		return p;
+	}();
 
-//Payload initialization
-
-namespace {
-
-	using namespace std;
-	using namespace nlohmann;
-	using namespace event_payload;
-
-	struct _identify {
-		_identify() {
-			identify.set_data_key<string>("token", "");
-			identify.set_data_key<bool>("compress", true);
-			identify.set_data_key<bool>("guild_subscriptions", false);
-			identify.set_data_key<int>("intents", 0);
-			identify.set_data_key<json>("properties", 
-			json(
-			{ 
-				{"$os", "window"}, 
-				{"$browser", "Abby"}, 
-				{"$device", "Abby"} 
-			}));
-			identify.set_data_key<json>("presence", json({ 
-				{"since", {}},
-				{"game", {{"name", "with SASANQUA <3"}, {"type", 0}, {"created_at", 0}} },
-				{"status", "online"},
-				{"afk", false}
-			}));
-		}
-	} identify_;
-
-	struct _message {
-		_message() {
-
-			message_headers.set_data_key<string>("Accept", "*/*");
-			message_headers.set_data_key<string>("Authorization", "");
-			message_headers.set_data_key<string>("User-Agent", "Abby (https://github.com/sasanquaa, 1)");
-			message_headers.set_data_key<string>("Connection", "keep-alive");
-			message_headers.set_data_key<string>("Content-Type", "application/json");
-			message_headers.set_data_key<int>("Content-Length", 0);
-		
-			message.set_data_key<string>("content", "");
-		}
-	} message_;
-
-	struct _presence {
-		_presence() {
-			presence.set_data_key<json>("user",
-			json({
-				{"id", ""},
-				{"username", ""},
-				{"discriminator", ""}
-			}));
-			presence.set_data_key<json>("game", 
-			json({ 
-				{"name", "with SASANQUA <3"},
-				{"type", 0},
-				{"created_at", 0}
-			}));
-		}
-	} presence_;
 }
 
 #endif
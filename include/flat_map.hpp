@@ -0,0 +1,159 @@
+#ifndef FLAT_MAP
+#define FLAT_MAP
+
+#include <snowflake.hpp>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+/*
+ * Class flat_map is an open addressing hash map with linear probing, made for ids:
+ * keys and values sit in one array, a lookup is one hash and a short scan of
+ * neighbouring slots, and no node is allocated per element.
+ * The default constructed key (snowflake(0) for ids) marks an empty slot and can not
+ * be stored. Erasing shifts the following entries back instead of leaving tombstones,
+ * so lookups stay short after many erasures.
+ * Pointers to values are invalidated by any insertion or erasure.
+ */
+template<class K, class V, class Hash = std::hash<K>> class flat_map {
+
+public:
+
+	typedef std::pair<K, V> slot;
+
+	flat_map() : m_size(0), m_mask(0) {}
+
+	size_t size() const { return m_size; }
+
+	bool empty() const { return m_size == 0; }
+
+	size_t capacity() const { return m_slots.size(); }
+
+	/**
+	 * @return Bytes held by the slot array, not counting what the values allocate.
+	 */
+	size_t memory_usage() const { return m_slots.capacity() * sizeof(slot); }
+
+	V* find(const K& key) {
+		if (m_size == 0 || key == K()) return nullptr;
+		for (size_t i = index(key); ; i = (i + 1) & m_mask) {
+			if (m_slots[i].first == key) return &m_slots[i].second;
+			if (m_slots[i].first == K()) return nullptr;
+		}
+	}
+
+	const V* find(const K& key) const {
+		return const_cast<flat_map*>(this)->find(key);
+	}
+
+	bool contains(const K& key) const {
+		return find(key) != nullptr;
+	}
+
+	/**
+	 * @return The value of key, inserted default constructed if it was not there.
+	 */
+	V& operator[](const K& key) {
+		if ((m_size + 1) * 4 > m_slots.size() * 3) grow();
+		size_t i = index(key);
+		for (; m_slots[i].first != K(); i = (i + 1) & m_mask) {
+			if (m_slots[i].first == key) return m_slots[i].second;
+		}
+		m_slots[i].first = key;
+		m_size++;
+		return m_slots[i].second;
+	}
+
+	/**
+	 * @return Whether key was there.
+	 */
+	bool erase(const K& key) {
+		if (m_size == 0 || key == K()) return false;
+		size_t i = index(key);
+		for (; m_slots[i].first != key; i = (i + 1) & m_mask) {
+			if (m_slots[i].first == K()) return false;
+		}
+		//Backward shift: move each following entry into the hole unless it is already
+		//at or after its home slot relative to the hole
+		for (size_t j = (i + 1) & m_mask; m_slots[j].first != K(); j = (j + 1) & m_mask) {
+			size_t home = index(m_slots[j].first);
+			if (((j - home) & m_mask) >= ((j - i) & m_mask)) {
+				m_slots[i] = std::move(m_slots[j]);
+				i = j;
+			}
+		}
+		m_slots[i] = slot();
+		m_size--;
+		return true;
+	}
+
+	void clear() {
+		m_slots.clear();
+		m_slots.shrink_to_fit();
+		m_size = 0;
+		m_mask = 0;
+	}
+
+	/**
+	 * Make room for n elements without rehashing.
+	 */
+	void reserve(size_t n) {
+		size_t capacity = 8;
+		while (capacity * 3 < n * 4) capacity *= 2;
+		if (capacity > m_slots.size()) rehash(capacity);
+	}
+
+	/**
+	 * Call f(key, value) for every element.
+	 */
+	template<class F> void for_each(F f) {
+		for (slot& s : m_slots) {
+			if (s.first != K()) f(s.first, s.second);
+		}
+	}
+
+	template<class F> void for_each(F f) const {
+		for (const slot& s : m_slots) {
+			if (s.first != K()) f(s.first, s.second);
+		}
+	}
+
+	/**
+	 * Number of slots, for walking the table by position (see slot_at).
+	 */
+	size_t slot_count() const { return m_slots.size(); }
+
+	/**
+	 * @return The element in slot i, nullptr if the slot is empty.
+	 */
+	slot* slot_at(size_t i) {
+		return m_slots[i].first != K() ? &m_slots[i] : nullptr;
+	}
+
+private:
+
+	size_t index(const K& key) const {
+		return Hash()(key) & m_mask;
+	}
+
+	void grow() {
+		rehash(m_slots.empty() ? 8 : m_slots.size() * 2);
+	}
+
+	void rehash(size_t capacity) {
+		std::vector<slot> old(capacity);
+		old.swap(m_slots);
+		m_mask = capacity - 1;
+		m_size = 0;
+		for (slot& s : old) {
+			if (s.first != K()) (*this)[s.first] = std::move(s.second);
+		}
+	}
+
+	std::vector<slot>	m_slots;
+	size_t				m_size;
+	size_t				m_mask;
+
+};
+
+#endif
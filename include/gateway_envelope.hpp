@@ -0,0 +1,118 @@
+#ifndef GATEWAY_ENVELOPE
+#define GATEWAY_ENVELOPE
+
+#include <json_scanner.hpp>
+#include <etf.hpp>
+#include <misc/json.hpp>
+#include <string_view>
+
+/*
+ * The envelope of a gateway payload: {"op": ..., "d": ..., "s": ..., "t": ...}.
+ * peek() only reads op, s and t and keeps "d" as a raw span of the frame, so
+ * a payload nobody handles is dropped without ever being parsed.
+ * The spans point into the frame, which must outlive the envelope.
+ *
+ * An ETF frame is read the same way with etf::scanner, "d" is then a span of the
+ * binary term and etf is set.
+ */
+struct gateway_envelope {
+
+	int					op = -1;
+	bool				has_sequence = false;
+	int					sequence = 0;
+	std::string_view	t;
+	std::string_view	d;
+	bool				etf = false;
+
+	/**
+	 * Read the envelope of a frame.
+	 *
+	 * @param frame The raw text of the payload.
+	 * @param env	The envelope to fill.
+	 * @return False if the frame is not a valid payload.
+	 */
+	static bool peek(std::string_view frame, gateway_envelope& env) {
+		json_scanner s(frame);
+		std::string_view key, value;
+		bool escaped;
+		int64_t n;
+
+		if (!s.enter_object()) return false;
+		while (s.next_key(key)) {
+			if (key == "op") {
+				if (!s.read_int(n)) return false;
+				env.op = static_cast<int>(n);
+			}
+			else if (key == "s") {
+				if (s.read_null()) continue;
+				if (!s.read_int(n)) return false;
+				env.has_sequence = true;
+				env.sequence = static_cast<int>(n);
+			}
+			else if (key == "t") {
+				if (s.read_null()) continue;
+				if (!s.read_string(env.t, escaped)) return false;
+			}
+			else if (key == "d") {
+				if (!s.skip_value(&env.d)) return false;
+			}
+			else if (!s.skip_value()) {
+				return false;
+			}
+		}
+		return s.ok() && env.op >= 0;
+	}
+
+	/**
+	 * Read the envelope of an ETF frame.
+	 *
+	 * @param frame The binary payload.
+	 * @param env	The envelope to fill.
+	 * @return False if the frame is not a valid payload.
+	 */
+	static bool peek_etf(std::string_view frame, gateway_envelope& env) {
+		if (frame.empty() || static_cast<uint8_t>(frame[0]) != etf::FORMAT_VERSION) return false;
+		etf::scanner s(frame.substr(1));
+		std::string_view key;
+		bool escaped;
+		int64_t n;
+
+		env.etf = true;
+		if (!s.enter_object()) return false;
+		while (s.next_key(key)) {
+			if (key == "op") {
+				if (!s.read_int(n)) return false;
+				env.op = static_cast<int>(n);
+			}
+			else if (key == "s") {
+				if (s.read_null()) continue;
+				if (!s.read_int(n)) return false;
+				env.has_sequence = true;
+				env.sequence = static_cast<int>(n);
+			}
+			else if (key == "t") {
+				if (s.read_null()) continue;
+				if (!s.read_string(env.t, escaped)) return false;
+			}
+			else if (key == "d") {
+				if (!s.skip_value(&env.d)) return false;
+			}
+			else if (!s.skip_value()) {
+				return false;
+			}
+		}
+		return s.ok() && env.op >= 0;
+	}
+
+	/**
+	 * Parse "d" into a JSON object, only call it when a handler needs it.
+	 */
+	nlohmann::json data() const {
+		if (d.empty()) return nullptr;
+		if (etf) return etf::decoder(d.data(), d.size()).decode_term();
+		return nlohmann::json::parse(d.begin(), d.end());
+	}
+
+};
+
+#endif
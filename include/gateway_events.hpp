@@ -0,0 +1,262 @@
+#ifndef GATEWAY_EVENTS
+#define GATEWAY_EVENTS
+
+#include <json_scanner.hpp>
+#include <gateway_envelope.hpp>
+#include <events.h>
+#include <snowflake.hpp>
+#include <deque>
+#include <vector>
+
+/*
+ * Typed structs for the hot gateway events, decoded straight from the raw "d" of the
+ * envelope with json_scanner instead of going through a DOM.
+ * Strings are views into the frame, a string that has escape sequences is decoded
+ * into the struct's own storage instead. A struct is only valid as long as the frame
+ * it was decoded from, which is the duration of the handler call. Ids are parsed into
+ * snowflakes, a missing or null id is snowflake(0).
+ * The decoders are templates over the scanner, with encoding=etf they walk the binary
+ * term with etf::scanner the same way and the ids come as integers.
+ */
+
+/*
+ * Storage for the strings that could not point into the frame.
+ */
+struct event_strings {
+
+	std::deque<std::string> owned;
+
+	std::string_view view(std::string_view raw, bool escaped) {
+		if (!escaped) return raw;
+		owned.push_back(json_scanner::unescape(raw));
+		return owned.back();
+	}
+
+};
+
+struct user_view {
+	snowflake			id;
+	std::string_view	username;
+	std::string_view	discriminator;
+	std::string_view	avatar;
+	bool				bot = false;
+};
+
+struct message_event {
+	snowflake			id;
+	snowflake			channel_id;
+	snowflake			guild_id;
+	std::string_view	content;
+	std::string_view	timestamp;
+	user_view			author;
+	event_strings		strings;
+};
+
+struct member_event {
+	snowflake						guild_id;
+	std::string_view				nick;
+	std::string_view				joined_at;
+	std::vector<snowflake>			roles;
+	user_view						user;
+	event_strings					strings;
+};
+
+struct reaction_event {
+	snowflake			user_id;
+	snowflake			channel_id;
+	snowflake			message_id;
+	snowflake			guild_id;
+	snowflake			emoji_id;
+	std::string_view	emoji_name;
+	event_strings		strings;
+};
+
+/*
+ * The struct an event is decoded into, only the events listed here can be handled typed.
+ */
+template<event::type E> struct event_traits;
+
+template<> struct event_traits<event::MESSAGE_CREATE>			{ typedef message_event type; };
+
+template<> struct event_traits<event::MESSAGE_UPDATE>			{ typedef message_event type; };
+
+template<> struct event_traits<event::GUILD_MEMBER_ADD>			{ typedef member_event type; };
+
+template<> struct event_traits<event::GUILD_MEMBER_UPDATE>		{ typedef member_event type; };
+
+template<> struct event_traits<event::MESSAGE_REACTION_ADD>		{ typedef reaction_event type; };
+
+template<> struct event_traits<event::MESSAGE_REACTION_REMOVE>	{ typedef reaction_event type; };
+
+namespace event_decoder {
+
+	/**
+	 * Read a string or null into out.
+	 */
+	template<class S> bool read_text(S& s, std::string_view& out, event_strings& strings) {
+		if (s.read_null()) {
+			out = std::string_view();
+			return true;
+		}
+		std::string_view raw;
+		bool escaped;
+		if (!s.read_string(raw, escaped)) return false;
+		out = strings.view(raw, escaped);
+		return true;
+	}
+
+	/**
+	 * Read an id string or null into out.
+	 */
+	inline bool read_id(json_scanner& s, snowflake& out) {
+		if (s.read_null()) {
+			out = snowflake();
+			return true;
+		}
+		std::string_view raw;
+		bool escaped;
+		if (!s.read_string(raw, escaped)) return false;
+		snowflake::parse(raw, out);
+		return true;
+	}
+
+	/**
+	 * Read an id integer, string or nil into out.
+	 */
+	inline bool read_id(etf::scanner& s, snowflake& out) {
+		if (s.read_null()) {
+			out = snowflake();
+			return true;
+		}
+		if (s.peek() == etf::BINARY_EXT) {
+			std::string_view raw;
+			bool escaped;
+			if (!s.read_string(raw, escaped)) return false;
+			snowflake::parse(raw, out);
+			return true;
+		}
+		uint64_t v;
+		if (!s.read_uint(v)) return false;
+		out = snowflake(v);
+		return true;
+	}
+
+	template<class S> bool decode_user(S& s, user_view& user, event_strings& strings) {
+		std::string_view key;
+		if (s.read_null()) return true;
+		if (!s.enter_object()) return false;
+		while (s.next_key(key)) {
+			bool ok;
+			if (key == "id") ok = read_id(s, user.id);
+			else if (key == "username") ok = read_text(s, user.username, strings);
+			else if (key == "discriminator") ok = read_text(s, user.discriminator, strings);
+			else if (key == "avatar") ok = read_text(s, user.avatar, strings);
+			else if (key == "bot") ok = s.read_bool(user.bot);
+			else ok = s.skip_value();
+			if (!ok) return false;
+		}
+		return s.ok();
+	}
+
+	template<class S> bool read_event(S& s, message_event& m) {
+		std::string_view key;
+		if (!s.enter_object()) return false;
+		while (s.next_key(key)) {
+			bool ok;
+			if (key == "id") ok = read_id(s, m.id);
+			else if (key == "channel_id") ok = read_id(s, m.channel_id);
+			else if (key == "guild_id") ok = read_id(s, m.guild_id);
+			else if (key == "content") ok = read_text(s, m.content, m.strings);
+			else if (key == "timestamp") ok = read_text(s, m.timestamp, m.strings);
+			else if (key == "author") ok = decode_user(s, m.author, m.strings);
+			else ok = s.skip_value();
+			if (!ok) return false;
+		}
+		return s.ok();
+	}
+
+	template<class S> bool read_event(S& s, member_event& m) {
+		std::string_view key;
+		snowflake role;
+		if (!s.enter_object()) return false;
+		while (s.next_key(key)) {
+			bool ok = true;
+			if (key == "guild_id") ok = read_id(s, m.guild_id);
+			else if (key == "nick") ok = read_text(s, m.nick, m.strings);
+			else if (key == "joined_at") ok = read_text(s, m.joined_at, m.strings);
+			else if (key == "user") ok = decode_user(s, m.user, m.strings);
+			else if (key == "roles") {
+				ok = s.enter_array();
+				while (ok && s.next_element()) {
+					ok = read_id(s, role);
+					m.roles.push_back(role);
+				}
+				ok = ok && s.ok();
+			}
+			else ok = s.skip_value();
+			if (!ok) return false;
+		}
+		return s.ok();
+	}
+
+	template<class S> bool read_event(S& s, reaction_event& r) {
+		std::string_view key, emoji_key;
+		if (!s.enter_object()) return false;
+		while (s.next_key(key)) {
+			bool ok = true;
+			if (key == "user_id") ok = read_id(s, r.user_id);
+			else if (key == "channel_id") ok = read_id(s, r.channel_id);
+			else if (key == "message_id") ok = read_id(s, r.message_id);
+			else if (key == "guild_id") ok = read_id(s, r.guild_id);
+			else if (key == "emoji") {
+				ok = s.enter_object();
+				while (ok && s.next_key(emoji_key)) {
+					if (emoji_key == "id") ok = read_id(s, r.emoji_id);
+					else if (emoji_key == "name") ok = read_text(s, r.emoji_name, r.strings);
+					else ok = s.skip_value();
+				}
+				ok = ok && s.ok();
+			}
+			else ok = s.skip_value();
+			if (!ok) return false;
+		}
+		return s.ok();
+	}
+
+	/**
+	 * Decode the raw JSON text of a "d".
+	 */
+	template<class T> bool decode(std::string_view d, T& decoded) {
+		json_scanner s(d);
+		return read_event(s, decoded) && s.ok();
+	}
+
+	/**
+	 * Decode the raw "d" of an envelope, whichever encoding it came with.
+	 */
+	template<class T> bool decode(const gateway_envelope& env, T& decoded) {
+		if (!env.etf) return decode(env.d, decoded);
+		etf::scanner s(env.d);
+		return read_event(s, decoded) && s.ok();
+	}
+
+	/**
+	 * Read an id among the top level keys of the "d" of an envelope.
+	 *
+	 * @return The id, snowflake(0) if there is no such key.
+	 */
+	inline snowflake find_id(const gateway_envelope& env, std::string_view key) {
+		snowflake id;
+		if (env.etf) {
+			etf::scanner s(etf::scanner::find_key(env.d, key));
+			if (s.peek() != 0) read_id(s, id);
+		}
+		else {
+			snowflake::parse(json_scanner::find_key(env.d, key), id);
+		}
+		return id;
+	}
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef GATEWAY_QUEUE
+#define GATEWAY_QUEUE
+
+#include <rate_limit.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <chrono>
+
+/*
+ * Class gateway_queue holds the commands sent to one gateway connection.
+ * The gateway closes a connection with 4008 (rate_limited) after 120 commands in
+ * 60 seconds, so commands are taken out of the queue under a sliding window of
+ * LIMIT commands per PERIOD, heartbeats sent directly included.
+ * Heartbeats, IDENTIFY and RESUME keep the connection alive: they go out before
+ * any other command and RESERVED commands of the window are kept for them, the rest
+ * (presence, voice state, member requests) is paced and waits for room in the window.
+ */
+class gateway_queue {
+
+public:
+
+	enum priority {
+
+		HIGH	,
+
+		NORMAL
+	};
+
+	struct command {
+		std::string	data;
+		bool		binary;
+	};
+
+	/**
+	 * @param limit	   Commands allowed per period.
+	 * @param period   The period of the limit.
+	 * @param reserved Commands of the window only HIGH commands can use.
+	 */
+	gateway_queue(unsigned int limit = LIMIT, std::chrono::milliseconds period = PERIOD, unsigned int reserved = RESERVED);
+
+	/**
+	 * Queue a command, thread safe.
+	 */
+	void push(std::string data, bool binary, priority p);
+
+	/**
+	 * Take the next command the limit allows, thread safe.
+	 *
+	 * @param c Set to the command.
+	 * @return False if the queue is empty or the next command has to wait.
+	 */
+	bool pop(command& c);
+
+	/**
+	 * Count a HIGH command sent right away instead of queued, thread safe.
+	 *
+	 * @return False if HIGH commands are already waiting or the limit is reached, the command is queued then.
+	 */
+	bool take_direct();
+
+	/**
+	 * @return Number of queued commands.
+	 */
+	size_t size();
+
+	/**
+	 * Drop every queued command, for a new connection.
+	 */
+	void clear();
+
+	static const unsigned int				LIMIT = 120;
+
+	static constexpr std::chrono::milliseconds PERIOD = std::chrono::milliseconds(60000);
+
+	static const unsigned int				RESERVED = 5;
+
+private:
+
+	std::deque<command>	m_high;
+	std::deque<command>	m_normal;
+	sliding_window		m_window;
+	unsigned int		m_reserved;
+	std::mutex			m_lock;
+
+};
+
+#endif
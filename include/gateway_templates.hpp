@@ -0,0 +1,52 @@
+#ifndef DISCORD_GATEWAY_TEMPLATES
+#define DISCORD_GATEWAY_TEMPLATES
+
+#include <events.h>
+#include <payload_template.hpp>
+
+/*
+ * The gateway payloads a bot sends on every connection or heartbeat, serialized once as
+ * payload templates. Each bot builds its own since a template is not thread safe.
+ */
+namespace gateway_templates {
+
+	//Slots of heartbeat()
+	enum heartbeat_slot {
+
+		HEARTBEAT_SEQUENCE
+	};
+
+	//Slots of identify()
+	enum identify_slot {
+
+		IDENTIFY_TOKEN,
+
+		IDENTIFY_INTENTS,
+
+		IDENTIFY_CREATED_AT,
+
+		IDENTIFY_SHARD
+	};
+
+	inline payload_template heartbeat() {
+		payload p(opcode::gateway::heartbeat);
+		p.set_data(payload_template::slot(HEARTBEAT_SEQUENCE));
+		return payload_template(p);
+	}
+
+	/**
+	 * @param sharded Whether IDENTIFY carries the shard, else IDENTIFY_SHARD is not a slot.
+	 */
+	inline payload_template identify(bool sharded) {
+		nlohmann::json envelope = event_payload::identify.get_gateway_json();
+		nlohmann::json& d = envelope["d"];
+		d[payload_field::token::name] = payload_template::slot(IDENTIFY_TOKEN);
+		d[payload_field::intents::name] = payload_template::slot(IDENTIFY_INTENTS);
+		d["presence"]["game"]["created_at"] = payload_template::slot(IDENTIFY_CREATED_AT);
+		if (sharded) d[payload_field::shard::name] = payload_template::slot(IDENTIFY_SHARD);
+		return payload_template(envelope);
+	}
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef IDENTIFY_SCHEDULER
+#define IDENTIFY_SCHEDULER
+
+#include <misc/json.hpp>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+/*
+ * From Discord:
+ * "max_concurrency: The number of identify requests allowed per 5 seconds".
+ * Shards are grouped into buckets by shard_id % max_concurrency, each bucket
+ * may send one IDENTIFY per 5 seconds and every bucket runs independently.
+ *
+ * Class identify_scheduler hands out IDENTIFY slots for all the shards of a token.
+ * A slot is a point in time: the shard reserves it once HELLO is read and keeps
+ * polling its connection, heartbeats included, until the slot is reached. Nothing
+ * blocks while waiting, so the shards of a bucket can wait for minutes without
+ * being closed and the buckets are released in parallel.
+ */
+class identify_scheduler {
+
+public:
+
+	typedef std::chrono::steady_clock clock;
+
+	/**
+	 * @param session_start_limit The "session_start_limit" object of the /gateway/bot response.
+	 */
+	identify_scheduler(const nlohmann::json& session_start_limit);
+
+	/**
+	 * Reserve the next slot of the bucket of shard_id, without waiting for it.
+	 * The caller sends its IDENTIFY once the returned time is reached.
+	 *
+	 * @param shard_id The id of the shard about to identify.
+	 * @return When the IDENTIFY may be sent.
+	 */
+	clock::time_point reserve_slot(int shard_id);
+
+	int get_max_concurrency() const;
+
+	int get_remaining() const;
+
+private:
+
+	static const std::chrono::milliseconds	IDENTIFY_WINDOW;
+
+	static const std::chrono::milliseconds	SESSION_RESET_WINDOW;
+
+	mutable std::mutex				m_lock;
+	std::vector<clock::time_point>	m_next_slot;
+	clock::time_point				m_reset_at;
+	int								m_max_concurrency;
+	int								m_remaining;
+	int								m_total;
+
+};
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef JSON_SCANNER
+#define JSON_SCANNER
+
+#include <string_view>
+#include <string>
+#include <cstdint>
+
+/*
+ * Class json_scanner walks a JSON text in place without building a DOM.
+ * Strings are returned as raw views into the text (still escaped), values that are
+ * not needed can be skipped as a whole or returned as a raw span to be parsed later.
+ * Any syntax error puts the scanner in a failed state, see ok().
+ */
+class json_scanner {
+
+public:
+
+	json_scanner(std::string_view text) :
+		m_p(text.data()),
+		m_end(text.data() + text.size()),
+		m_ok(true)
+	{}
+
+	bool ok() const { return m_ok; }
+
+	/**
+	 * @return The next non whitespace character without consuming it, 0 at the end.
+	 */
+	char peek() {
+		skip_ws();
+		return m_p < m_end ? *m_p : 0;
+	}
+
+	/**
+	 * Consume the '{' of an object.
+	 */
+	bool enter_object() {
+		return expect('{');
+	}
+
+	/**
+	 * Move to the next key of the current object and consume its ':'.
+	 *
+	 * @param key Set to the raw key.
+	 * @return False when the closing '}' was consumed instead.
+	 */
+	bool next_key(std::string_view& key) {
+		if (!m_ok) return false;
+		if (peek() == '}') {
+			m_p++;
+			return false;
+		}
+		if (peek() == ',') m_p++;
+		bool escaped;
+		if (!read_string(key, escaped)) return false;
+		return expect(':');
+	}
+
+	/**
+	 * Consume the '[' of an array.
+	 */
+	bool enter_array() {
+		return expect('[');
+	}
+
+	/**
+	 * Move to the next element of the current array.
+	 *
+	 * @return False when the closing ']' was consumed instead.
+	 */
+	bool next_element() {
+		if (!m_ok) return false;
+		if (peek() == ']') {
+			m_p++;
+			return false;
+		}
+		if (peek() == ',') m_p++;
+		return m_ok;
+	}
+
+	/**
+	 * @param raw	  Set to the content between the quotes, escapes are left as they are.
+	 * @param escaped Set to whether raw contains an escape sequence.
+	 */
+	bool read_string(std::string_view& raw, bool& escaped) {
+		if (!expect('"')) return false;
+		const char* begin = m_p;
+		escaped = false;
+		while (m_p < m_end && *m_p != '"') {
+			if (*m_p == '\\') {
+				escaped = true;
+				m_p++;
+			}
+			m_p++;
+		}
+		if (m_p >= m_end) return fail();
+		raw = std::string_view(begin, m_p - begin);
+		m_p++;
+		return true;
+	}
+
+	bool read_int(int64_t& value) {
+		skip_ws();
+		bool negative = m_p < m_end && *m_p == '-';
+		if (negative) m_p++;
+		if (m_p >= m_end || *m_p < '0' || *m_p > '9') return fail();
+		uint64_t v = 0;
+		while (m_p < m_end && *m_p >= '0' && *m_p <= '9') v = v * 10 + (*m_p++ - '0');
+		value = negative ? -static_cast<int64_t>(v) : static_cast<int64_t>(v);
+		return true;
+	}
+
+	bool read_bool(bool& value) {
+		skip_ws();
+		if (literal("true")) value = true;
+		else if (literal("false")) value = false;
+		else return fail();
+		return true;
+	}
+
+	/**
+	 * Consume a null if it is the next value.
+	 */
+	bool read_null() {
+		skip_ws();
+		return literal("null");
+	}
+
+	/**
+	 * Skip the next value, nested objects and arrays included.
+	 *
+	 * @param span If not null, set to the raw text of the value.
+	 */
+	bool skip_value(std::string_view* span = nullptr) {
+		skip_ws();
+		const char* begin = m_p;
+		int depth = 0;
+		std::string_view str;
+		bool escaped;
+		while (m_p < m_end) {
+			char c = *m_p;
+			if (c == '"') {
+				if (!read_string(str, escaped)) return false;
+				if (depth == 0) break;
+			}
+			else if (c == '{' || c == '[') {
+				depth++;
+				m_p++;
+			}
+			else if (c == '}' || c == ']') {
+				//A scalar at the top ends at the bracket of its enclosing container
+				if (depth == 0) break;
+				m_p++;
+				if (--depth == 0) break;
+			}
+			else if (depth == 0 && (c == ',' || is_ws(c))) {
+				break;
+			}
+			else {
+				m_p++;
+			}
+		}
+		if (depth != 0 || m_p == begin) return fail();
+		if (span != nullptr) *span = std::string_view(begin, m_p - begin);
+		return true;
+	}
+
+	/**
+	 * Find key among the top level keys of an object.
+	 *
+	 * @param object The raw text of an object.
+	 * @param key	 The key to look for.
+	 * @return The raw text of its value, empty if there is no such key.
+	 */
+	static std::string_view find_key(std::string_view object, std::string_view key) {
+		json_scanner s(object);
+		std::string_view k, value;
+		if (!s.enter_object()) return {};
+		while (s.next_key(k)) {
+			if (!s.skip_value(&value)) return {};
+			if (k == key) return value;
+		}
+		return {};
+	}
+
+	/**
+	 * Decode the escape sequences of a raw string, \u escapes are written as UTF-8.
+	 */
+	static std::string unescape(std::string_view raw) {
+		std::string out;
+		out.reserve(raw.size());
+		for (size_t i = 0; i < raw.size(); i++) {
+			if (raw[i] != '\\' || i + 1 >= raw.size()) {
+				out += raw[i];
+				continue;
+			}
+			char c = raw[++i];
+			switch (c) {
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			case 'r': out += '\r'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'u': {
+				uint32_t cp = hex4(raw, i + 1);
+				i += 4;
+				//Surrogate pair
+				if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u') {
+					uint32_t low = hex4(raw, i + 3);
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					i += 6;
+				}
+				append_utf8(out, cp);
+				break;
+			}
+			default: out += c; break;
+			}
+		}
+		return out;
+	}
+
+private:
+
+	static bool is_ws(char c) {
+		return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+	}
+
+	void skip_ws() {
+		while (m_p < m_end && is_ws(*m_p)) m_p++;
+	}
+
+	bool expect(char c) {
+		if (peek() != c) return fail();
+		m_p++;
+		return true;
+	}
+
+	bool literal(std::string_view word) {
+		if (std::string_view(m_p, m_end - m_p).substr(0, word.size()) != word) return false;
+		m_p += word.size();
+		return true;
+	}
+
+	bool fail() {
+		m_ok = false;
+		return false;
+	}
+
+	static uint32_t hex4(std::string_view raw, size_t i) {
+		uint32_t v = 0;
+		for (size_t k = i; k < i + 4 && k < raw.size(); k++) {
+			char c = raw[k];
+			v <<= 4;
+			if (c >= '0' && c <= '9') v |= c - '0';
+			else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+		}
+		return v;
+	}
+
+	static void append_utf8(std::string& out, uint32_t cp) {
+		if (cp < 0x80) {
+			out += static_cast<char>(cp);
+		}
+		else if (cp < 0x800) {
+			out += static_cast<char>(0xC0 | (cp >> 6));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000) {
+			out += static_cast<char>(0xE0 | (cp >> 12));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+		else {
+			out += static_cast<char>(0xF0 | (cp >> 18));
+			out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+	}
+
+	const char*	m_p;
+	const char*	m_end;
+	bool		m_ok;
+
+};
+
+#endif
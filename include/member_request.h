@@ -0,0 +1,143 @@
+#ifndef MEMBER_REQUEST
+#define MEMBER_REQUEST
+
+#include <gateway_envelope.hpp>
+#include <snowflake.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*
+ * Members of a guild in a compact layout: one fixed size record per member,
+ * with all the names in one string buffer and all the role ids in one array.
+ */
+class member_list {
+
+public:
+
+	struct record {
+		snowflake	id;
+		uint32_t	username_offset;
+		uint32_t	nick_offset;
+		uint32_t	roles_offset;
+		uint16_t	username_length;
+		uint16_t	nick_length;
+		uint16_t	role_count;
+		bool		bot;
+	};
+
+	size_t size() const { return m_records.size(); }
+
+	const record& at(size_t i) const { return m_records[i]; }
+
+	snowflake id(size_t i) const { return m_records[i].id; }
+
+	std::string_view username(size_t i) const {
+		return std::string_view(m_strings).substr(m_records[i].username_offset, m_records[i].username_length);
+	}
+
+	std::string_view nick(size_t i) const {
+		return std::string_view(m_strings).substr(m_records[i].nick_offset, m_records[i].nick_length);
+	}
+
+	const snowflake* roles(size_t i) const { return m_roles.data() + m_records[i].roles_offset; }
+
+	size_t role_count(size_t i) const { return m_records[i].role_count; }
+
+	/**
+	 * @return Bytes held by the list.
+	 */
+	size_t memory_usage() const {
+		return m_records.capacity() * sizeof(record) + m_strings.capacity() + m_roles.capacity() * sizeof(snowflake);
+	}
+
+	void add(snowflake id, std::string_view username, std::string_view nick, const std::vector<snowflake>& roles, bool bot);
+
+private:
+
+	std::vector<record>		m_records;
+	std::string				m_strings;
+	std::vector<snowflake>	m_roles;
+
+};
+
+/*
+ * Class member_request collects the GUILD_MEMBERS_CHUNK events answering one
+ * opcode 8 (Request Guild Members) by its nonce. Members are streamed into the
+ * member_list as each chunk arrives, the chunk is never built as a JSON array.
+ *
+ * The gateway may never answer (missing intent, closed connection), so a request
+ * expires when no chunk arrived for CHUNK_TIMEOUT and its future fails then.
+ */
+class member_request {
+
+public:
+
+	typedef std::chrono::steady_clock clock;
+
+	static constexpr std::chrono::seconds CHUNK_TIMEOUT = std::chrono::seconds(30);
+
+	/*
+	 * Called after every chunk with the list and the index of the first member of the chunk.
+	 */
+	typedef std::function<void(const member_list&, size_t)> chunk_handler;
+
+	member_request(chunk_handler on_chunk);
+
+	/**
+	 * @return The future set with the whole list once the last chunk arrived.
+	 */
+	std::future<member_list> get_future();
+
+	/**
+	 * Read the nonce of a GUILD_MEMBERS_CHUNK, a string or a number in either encoding.
+	 *
+	 * @param env	The envelope of the chunk.
+	 * @param nonce Set to the nonce as sent, escapes decoded.
+	 * @return False if the chunk has no readable nonce.
+	 */
+	static bool find_nonce(const gateway_envelope& env, std::string& nonce);
+
+	/**
+	 * Add the members of a GUILD_MEMBERS_CHUNK. A chunk that can not be read fails the
+	 * future, the members of the request are incomplete.
+	 *
+	 * @param env The envelope of the chunk.
+	 * @return True if this was the last chunk or it could not be read, the request is over.
+	 */
+	bool on_chunk(const gateway_envelope& env);
+
+	/**
+	 * @return Whether no chunk arrived for CHUNK_TIMEOUT.
+	 */
+	bool expired(clock::time_point now) const;
+
+	/**
+	 * Fail the future with reason, unless the last chunk already set it.
+	 */
+	void fail(const std::string& reason);
+
+private:
+
+	/**
+	 * Read the "d" of a chunk with json_scanner or etf::scanner.
+	 */
+	template<class S> bool parse_chunk(S& s);
+
+	template<class S> static bool read_nonce(std::string_view value, std::string& nonce);
+
+	member_list					m_members;
+	std::promise<member_list>	m_promise;
+	chunk_handler				m_on_chunk;
+	int							m_chunk_count;
+	int							m_chunks_received;
+	std::atomic<clock::rep>		m_deadline;
+	std::atomic<bool>			m_done;
+
+};
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef MEMBER_STORE
+#define MEMBER_STORE
+
+#include <flat_map.hpp>
+#include <snowflake.hpp>
+#include <misc/json.hpp>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Class intern_table stores each distinct value once and hands out 32 bit ids for it,
+ * reference counted. Id 0 is the empty value and is never stored.
+ * The index is open addressing over the ids, a value is only hashed once when interned.
+ */
+template<class T, class Hash = std::hash<T>> class intern_table {
+
+public:
+
+	intern_table() : m_bytes(0), m_live(0) {}
+
+	/**
+	 * @return The id of value, with one more reference.
+	 */
+	uint32_t intern(const T& value) {
+		if (value.empty()) return 0;
+		uint32_t hash = static_cast<uint32_t>(Hash()(value));
+		if ((m_live + 1) * 4 > m_index.size() * 3) rehash(m_index.empty() ? 16 : m_index.size() * 2);
+
+		size_t mask = m_index.size() - 1;
+		size_t i = hash & mask;
+		for (; m_index[i] != 0; i = (i + 1) & mask) {
+			entry& e = m_entries[m_index[i] - 1];
+			if (e.hash == hash && e.value == value) {
+				e.refs++;
+				return m_index[i];
+			}
+		}
+
+		uint32_t id;
+		if (!m_free.empty()) {
+			id = m_free.back();
+			m_free.pop_back();
+		}
+		else {
+			m_entries.emplace_back();
+			id = static_cast<uint32_t>(m_entries.size());
+		}
+		entry& e = m_entries[id - 1];
+		e.value = value;
+		e.hash = hash;
+		e.refs = 1;
+		m_index[i] = id;
+		m_bytes += heap_bytes(e.value);
+		m_live++;
+		return id;
+	}
+
+	/**
+	 * Drop one reference of id, the value is freed with its last reference.
+	 */
+	void release(uint32_t id) {
+		if (id == 0) return;
+		entry& e = m_entries[id - 1];
+		if (--e.refs > 0) return;
+		unindex(id);
+		m_bytes -= heap_bytes(e.value);
+		e.value = T();
+		m_free.push_back(id);
+		m_live--;
+	}
+
+	/**
+	 * Intern value then release id, for a field that changes from id to value.
+	 *
+	 * @return The id of value.
+	 */
+	uint32_t replace(uint32_t id, const T& value) {
+		uint32_t n = intern(value);
+		release(id);
+		return n;
+	}
+
+	const T& get(uint32_t id) const {
+		static const T empty;
+		return id == 0 ? empty : m_entries[id - 1].value;
+	}
+
+	/**
+	 * Change the value of every entry for which f(value) returns true, f changes the value in place.
+	 */
+	template<class F> void update_all(F f) {
+		for (size_t i = 0; i < m_entries.size(); i++) {
+			entry& e = m_entries[i];
+			if (e.refs == 0) continue;
+			uint32_t id = static_cast<uint32_t>(i + 1);
+			size_t before = heap_bytes(e.value);
+			unindex(id);
+			if (!f(e.value)) {
+				index(id);
+				continue;
+			}
+			m_bytes = m_bytes - before + heap_bytes(e.value);
+			e.hash = static_cast<uint32_t>(Hash()(e.value));
+			//An entry that became equal to another one stays a separate id
+			index(id);
+		}
+	}
+
+	size_t size() const { return m_live; }
+
+	size_t memory_usage() const {
+		return m_entries.capacity() * sizeof(entry) + m_index.capacity() * sizeof(uint32_t) + m_free.capacity() * sizeof(uint32_t) + m_bytes;
+	}
+
+private:
+
+	struct entry {
+		T			value;
+		uint32_t	hash = 0;
+		uint32_t	refs = 0;
+	};
+
+	static size_t heap_bytes(const std::string& s) { return s.capacity() > 15 ? s.capacity() + 1 : 0; }
+
+	template<class V> static size_t heap_bytes(const std::vector<V>& v) { return v.capacity() * sizeof(V); }
+
+	void index(uint32_t id) {
+		size_t mask = m_index.size() - 1;
+		size_t i = m_entries[id - 1].hash & mask;
+		while (m_index[i] != 0) i = (i + 1) & mask;
+		m_index[i] = id;
+	}
+
+	void unindex(uint32_t id) {
+		size_t mask = m_index.size() - 1;
+		size_t i = m_entries[id - 1].hash & mask;
+		while (m_index[i] != id) i = (i + 1) & mask;
+		for (size_t j = (i + 1) & mask; m_index[j] != 0; j = (j + 1) & mask) {
+			size_t home = m_entries[m_index[j] - 1].hash & mask;
+			if (((j - home) & mask) >= ((j - i) & mask)) {
+				m_index[i] = m_index[j];
+				i = j;
+			}
+		}
+		m_index[i] = 0;
+	}
+
+	void rehash(size_t capacity) {
+		m_index.assign(capacity, 0);
+		for (size_t i = 0; i < m_entries.size(); i++) {
+			if (m_entries[i].refs > 0) index(static_cast<uint32_t>(i + 1));
+		}
+	}
+
+	std::vector<entry>		m_entries;
+	std::vector<uint32_t>	m_index;
+	std::vector<uint32_t>	m_free;
+	size_t					m_bytes;
+	size_t					m_live;
+
+};
+
+/*
+ * Hash of a role set, the roles are kept sorted so equal sets hash the same.
+ */
+struct role_set_hash {
+	size_t operator()(const std::vector<snowflake>& roles) const {
+		size_t h = roles.size();
+		for (snowflake r : roles) h = h * 31 + r.hash();
+		return h;
+	}
+};
+
+/*
+ * Guild and user of a member, the key of the member table.
+ */
+struct member_key {
+	snowflake guild_id;
+	snowflake user_id;
+
+	bool operator==(const member_key& o) const { return guild_id == o.guild_id && user_id == o.user_id; }
+
+	bool operator!=(const member_key& o) const { return !(*this == o); }
+};
+
+struct member_key_hash {
+	size_t operator()(const member_key& k) const {
+		return snowflake(k.guild_id.value() * 0x9E3779B97F4A7C15ULL ^ k.user_id.value()).hash();
+	}
+};
+
+/*
+ * A member as read from the store. The views point into the store and are only valid
+ * while the cache is locked, that is during the visit call.
+ */
+struct member_view {
+	snowflake			user_id;
+	std::string_view	username;
+	std::string_view	nick;
+	std::string_view	avatar;
+	const snowflake*	roles = nullptr;
+	size_t				role_count = 0;
+	uint16_t			discriminator = 0;
+	bool				bot = false;
+};
+
+/*
+ * Class member_store holds the members of every guild in one table of fixed size records.
+ * Names, nicknames and avatars are interned: a user in many guilds or a nickname used by
+ * many members is stored once. Role lists are interned as whole sets, most members of a
+ * guild share one of a few role sets.
+ *
+ * With a memory limit, members are evicted with the CLOCK algorithm (an approximation of
+ * LRU): a read or update marks a member, the clock hand clears marks and evicts the
+ * first unmarked member it finds. Evicted members come back with their next
+ * GUILD_MEMBER_UPDATE, GUILD_MEMBERS_CHUNK or on a request_guild_members.
+ *
+ * Not thread safe by itself, entity_cache locks it: updates under an exclusive lock,
+ * reads under a shared one (the read mark is atomic).
+ */
+class member_store {
+
+public:
+
+	member_store();
+
+	/**
+	 * Evict members while the store uses more than bytes, 0 for no limit.
+	 */
+	void set_memory_limit(size_t bytes);
+
+	/**
+	 * Add or update a member from a guild member object ("user", "nick", "roles").
+	 *
+	 * @return Whether the member was not in the store.
+	 */
+	bool update(snowflake guild_id, const nlohmann::json& member);
+
+	/**
+	 * Add or replace a member with every field of m, as when loading a snapshot.
+	 */
+	void restore(snowflake guild_id, const member_view& m);
+
+	bool remove(snowflake guild_id, snowflake user_id);
+
+	void remove_guild(snowflake guild_id);
+
+	/**
+	 * Remove every member, the memory limit is kept.
+	 */
+	void clear();
+
+	/**
+	 * Remove a deleted role from every member who had it.
+	 */
+	void remove_role(snowflake role_id);
+
+	/**
+	 * @return Whether the member is in the store, view is set if it is.
+	 */
+	bool find(snowflake guild_id, snowflake user_id, member_view& view) const;
+
+	/**
+	 * Call f(guild_id, const member_view&) for every member.
+	 */
+	template<class F> void for_each(F f) const {
+		m_members.for_each([this, &f](const member_key& key, const record& r) {
+			member_view view;
+			fill(key.user_id, r, view);
+			f(key.guild_id, static_cast<const member_view&>(view));
+		});
+	}
+
+	size_t size() const { return m_members.size(); }
+
+	/**
+	 * @return Bytes held by the table, the strings and the role sets.
+	 */
+	size_t memory_usage() const;
+
+	uint64_t get_evicted() const { return m_evicted; }
+
+private:
+
+	struct record {
+		uint32_t					username = 0;
+		uint32_t					nick = 0;
+		uint32_t					avatar = 0;
+		uint32_t					roles = 0;
+		uint16_t					discriminator = 0;
+		bool						bot = false;
+		mutable std::atomic<bool>	referenced{ false };
+
+		record() = default;
+
+		record(const record& o) { *this = o; }
+
+		record& operator=(const record& o) {
+			username = o.username;
+			nick = o.nick;
+			avatar = o.avatar;
+			roles = o.roles;
+			discriminator = o.discriminator;
+			bot = o.bot;
+			referenced.store(o.referenced.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			return *this;
+		}
+	};
+
+	void release(record& r);
+
+	void fill(snowflake user_id, const record& r, member_view& view) const;
+
+	void evict();
+
+	/*
+	 * Bytes in use, the table counted by its elements rather than its capacity
+	 * so that the limit can be reached by evicting.
+	 */
+	size_t live_bytes() const;
+
+	flat_map<member_key, record, member_key_hash>		m_members;
+	intern_table<std::string>							m_strings;
+	intern_table<std::vector<snowflake>, role_set_hash>	m_role_sets;
+	std::vector<snowflake>								m_roles_buffer;
+	size_t												m_limit;
+	size_t												m_hand;
+	uint64_t											m_evicted;
+
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef MESSAGE_CACHE
+#define MESSAGE_CACHE
+
+#include <flat_map.hpp>
+#include <snowflake.hpp>
+#include <events.h>
+#include <misc/json.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * A message as read from the cache.
+ */
+struct cached_message {
+	snowflake			id;
+	snowflake			channel_id;
+	snowflake			guild_id;
+	snowflake			author_id;
+	std::string			content;
+};
+
+/*
+ * Class message_cache keeps the latest messages of every channel so that MESSAGE_UPDATE and
+ * MESSAGE_DELETE handlers can read the message as it was.
+ *
+ * Each channel has a ring of a fixed number of slots, a new message replaces the oldest.
+ * Contents are stored in an arena of fixed size blocks, allocated a chunk at a time and
+ * recycled through a free list: once warm, inserting a message allocates nothing.
+ * An index from message id to ring slot makes lookups O(1).
+ *
+ * A global budget bounds the content blocks in use, the rings and the index together. Past
+ * it the cache first drops channels left without messages, then evicts the oldest messages
+ * of the channels holding more than their fair share, so a busy channel can not push the
+ * history of the quiet ones out. The arena keeps the blocks it freed for reuse, it never
+ * grows past the most the budget let content take.
+ *
+ * Messages of different guilds are applied on different workers, the cache has its own lock.
+ */
+class message_cache {
+
+public:
+
+	/*
+	 * Bytes of content per arena block and blocks per arena chunk.
+	 */
+	static constexpr size_t BLOCK_SIZE = 64;
+	static constexpr size_t BLOCKS_PER_CHUNK = 1024;
+
+	struct stats {
+		size_t		channels;
+		size_t		messages;
+		size_t		arena_bytes;
+		size_t		used_bytes;
+		//Rings and index, counted against the budget with used_bytes
+		size_t		overhead_bytes;
+		uint64_t	evicted;
+	};
+
+	/**
+	 * @param memory_budget		   Bytes of content, rings and index the cache may hold, at least one chunk.
+	 * @param messages_per_channel Slots in the ring of each channel.
+	 */
+	message_cache(size_t memory_budget = 16 * 1024 * 1024, uint32_t messages_per_channel = 64);
+
+	/**
+	 * @return Whether the cache consumes e.
+	 */
+	static bool is_cached(event::type e);
+
+	/**
+	 * Apply a dispatched event.
+	 *
+	 * @param e The event.
+	 * @param d The "d" of the event.
+	 */
+	void update(event::type e, const nlohmann::json& d);
+
+	/**
+	 * @param id  The message id.
+	 * @param out Set to the message if it is cached, its content reuses the capacity of out.
+	 * @return Whether the message is cached.
+	 */
+	bool find(snowflake id, cached_message& out) const;
+
+	stats get_stats() const;
+
+private:
+
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	struct entry {
+		snowflake	id;
+		snowflake	author_id;
+		uint32_t	block = NONE;
+		uint32_t	length = 0;
+	};
+
+	struct channel {
+		snowflake			id;
+		snowflake			guild_id;
+		std::vector<entry>	ring;
+		uint32_t			head = 0;
+		uint32_t			count = 0;
+		//Slots of the ring still holding a message, deleted ones keep their slot
+		uint32_t			messages = 0;
+		size_t				blocks = 0;
+	};
+
+	struct location {
+		snowflake	channel_id;
+		uint32_t	slot = 0;
+	};
+
+	//A flat_map is between 3/8 and 3/4 full, an element takes about two slots
+	static constexpr size_t INDEX_BYTES = 2 * sizeof(flat_map<snowflake, location>::slot);
+
+	void on_create(const nlohmann::json& d);
+
+	void on_update(const nlohmann::json& d);
+
+	void on_delete(snowflake id);
+
+	void drop_channel(snowflake id);
+
+	/*
+	 * Copy content into newly taken blocks, growing the arena as needed: make_room() must
+	 * have made room for them.
+	 *
+	 * @return The first block, NONE if the content is empty.
+	 */
+	uint32_t store(const std::string& content);
+
+	/*
+	 * Evict until bytes more fit in the budget.
+	 *
+	 * @param keep A channel that is not dropped even once empty, the one being written.
+	 * @return False if they can not fit.
+	 */
+	bool make_room(size_t bytes, snowflake keep);
+
+	/*
+	 * Bytes counted against the budget.
+	 */
+	size_t footprint() const {
+		return m_used * BLOCK_SIZE + m_channels.size() * m_channel_bytes + m_index.size() * INDEX_BYTES;
+	}
+
+	void free_blocks(channel& c, entry& e);
+
+	void pop_oldest(channel& c);
+
+	/*
+	 * Drop a channel without messages other than keep, else evict the oldest message of a
+	 * channel over its fair share.
+	 */
+	bool evict(snowflake keep);
+
+	char* block_data(uint32_t block) const {
+		return m_chunks[block / BLOCKS_PER_CHUNK].get() + (block % BLOCKS_PER_CHUNK) * BLOCK_SIZE;
+	}
+
+	static size_t blocks_for(size_t length) { return (length + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+
+	mutable std::mutex						m_lock;
+	flat_map<snowflake, channel>			m_channels;
+	flat_map<snowflake, location>			m_index;
+	std::vector<std::unique_ptr<char[]>>	m_chunks;
+	std::vector<uint32_t>					m_next;
+	uint32_t								m_free;
+	size_t									m_free_count;
+	size_t									m_used;
+	size_t									m_budget;
+	uint32_t								m_ring_size;
+	//A channel's ring and its slot of m_channels
+	size_t									m_channel_bytes;
+	size_t									m_hand;
+	uint64_t								m_evicted;
+
+};
+
+#endif
@@ -6,8 +6,8 @@
 #define DISCORD_PAYLOAD
 
 #include <opcode.hpp>
+#include <payload_schema.hpp>
 #include <misc/json.hpp>
-#include <stack>
 #include <vector>
 
 typedef std::error_code payload_type;
@@ -19,53 +19,10 @@ Resource fields that are optional have names that are suffixed with a question m
 */
 
 /*
- * This defines the required fields in a specific payload type. 
- * Specifically the field "d" or "data" of a Discord payload for a certain opcode requires 
- * some field to be defined. These constant JSON are used to check the validity (existence) of such field(s) (key(s))
- * by using the validate() method.
+ * The required fields of each command are declared in payload_schema.hpp, validate() checks
+ * the one of the payload opcode against the data in place.
  */
 
-static const nlohmann::json IDENTIFY = 
-{ 
-	{"token", {}},
-	{"properties", {"$os", "$browser", "$device"} } 
-};
-
-static const nlohmann::json RESUME =
-{
-	{"token", {}},
-	{"session_id", {}},
-	{"seq", {}}
-};
-
-static const nlohmann::json HEARTBEAT =
-{};
-
-
-static const nlohmann::json REQUEST_GUILDS_MEMBERS =
-{
-	{"guild_id", {}},
-	{"limit", {}}
-};
-
-static const nlohmann::json UPDATE_VOICE_STATE =
-{
-	{"guild_id", {}},
-	{"channel_id", {}},
-	{"self_mute", {}},
-	{"self_deaf", {}}
-
-};
-
-static const nlohmann::json UPDATE_STATUS =
-{
-	{"since", {}},
-	{"game", {}},
-	{"status", {}},
-	{"afk", {}}
-};
-
-
 //Use for both Gateway and Rest API
 
 class payload {
@@ -105,6 +62,18 @@ public:
 		return value;
 	}
 
+	/**
+	 * Set a field declared in payload_schema.hpp, by its type rather than its name.
+	 */
+	template<class F> payload& set(const typename F::type& value) {
+		m_data[F::name] = value;
+		return *this;
+	}
+
+	void set_data(const nlohmann::json& d) {
+		m_data = d;
+	}
+
 	void set_sequence(const nlohmann::json& s) {
 		m_s = s;
 	}
@@ -113,92 +82,53 @@ public:
 		m_t = t;
 	}
 
-	const std::string get_gateway_payload(int indent = 0) {
+	nlohmann::json get_gateway_json() const {
 		nlohmann::json p;
 		p["op"] = m_type.value();
 		p["d"] = m_data;
 		p["s"] = m_s;
 		p["t"] = m_t;
-		return p.dump(indent);
+		return p;
+	}
+
+	const std::string get_gateway_payload(int indent = 0) {
+		return get_gateway_json().dump(indent);
 	}
 
 	const std::string get_payload(int indent = 0) {
 		return m_data.dump(indent);
 	}
 
-	const nlohmann::json& get_data() { return m_data; }
+	const nlohmann::json& get_data() const { return m_data; }
 
 	const bool& is_valid() {
 		return m_valid;
 	}
 
 	void validate() {
-		nlohmann::json j;
-
 		switch (m_type.value()) {
 		case opcode::identify:
-			j = IDENTIFY;
+			m_valid = payload_schema::identify::validate(m_data);
 			break;
 		case opcode::resume:
-			j = RESUME;
+			m_valid = payload_schema::resume::validate(m_data);
 			break;
 		case opcode::heartbeat:
-			j = HEARTBEAT;
+			m_valid = payload_schema::heartbeat::validate(m_data);
 			break;
 		case opcode::request_guild_members:
-			j = REQUEST_GUILDS_MEMBERS;
+			m_valid = payload_schema::request_guild_members::validate(m_data);
 			break;
 		case opcode::voice_state_update:
-			j = UPDATE_VOICE_STATE;
+			m_valid = payload_schema::voice_state_update::validate(m_data);
 			break;
 		case opcode::presence_update:
-			j = UPDATE_STATUS;
+			m_valid = payload_schema::presence_update::validate(m_data);
 			break;
 		default:
-			j = nullptr;
+			m_valid = true;
 			break;
 		}
-
-		std::stack<nlohmann::json::iterator> q;
-		std::stack<int> levels;
-		std::vector<std::string> parents;
-
-		for (nlohmann::json::iterator it = j.begin(); it != j.end(); it++) q.push(it);
-
-		while (!q.empty()) {
-			nlohmann::json::iterator it = q.top();
-			nlohmann::json parent_json = m_data;
-			q.pop();
-			for (std::string s : parents) {parent_json = parent_json[s];}
-			if (!levels.empty()) {
-				levels.top() -= 1;
-				if (levels.top() == 0) {
-					levels.pop();
-					parents.pop_back();
-				}
-			}
-			std::string p = it.key();
-			if (!parent_json.count(p)) {
-				m_valid = false;
-				return;
-			}
-			if (!it.value().is_null()) {
-				if (it.value().is_array() || it.value().is_string()) {
-					for (std::string i : it.value()) {
-						if (!parent_json[p].count(i)) {
-							m_valid = false;
-							return;
-						}	
-					}
-				}
-				else if (it.value().is_object()) {
-					parents.push_back(p);
-					levels.push(it.value().size());
-					for (nlohmann::json::iterator itx = it.value().begin(); itx != it.value().end(); itx++) {q.push(itx);}
-				}
-			}
-		}
-		m_valid = true;
 	}
 
 private:
@@ -212,4 +142,23 @@ private:
 };
 
 
-#endif 
\ No newline at end of file
+/*
+ * A payload of a command known at compile time, setting a field the command does not have
+ * does not compile.
+ */
+template<class Schema> class typed_payload : public payload {
+
+public:
+
+	typed_payload() : payload(Schema::op) {}
+
+	template<class F> typed_payload& set(const typename F::type& value) {
+		static_assert(Schema::template has<F>(), "The field is not part of this payload");
+		payload::set<F>(value);
+		return *this;
+	}
+
+};
+
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef DISCORD_PAYLOAD_SCHEMA
+#define DISCORD_PAYLOAD_SCHEMA
+
+#include <opcode.hpp>
+#include <snowflake.hpp>
+#include <misc/json.hpp>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+/*
+ * The fields of the gateway commands as types. A field is named once here, builders and
+ * validation refer to the type, so a misspelled field does not compile.
+ *
+ * A field with children is an object requiring those keys.
+ */
+template<class Tag, class T, class... Children> struct payload_field_of {
+
+	typedef T type;
+
+	/**
+	 * @return Whether d has the field and the field has its children.
+	 */
+	static bool present(const nlohmann::json& d) {
+		if (!d.is_object()) return false;
+		auto it = d.find(Tag::name);
+		if (it == d.end()) return false;
+		return (Children::present(*it) && ... && true);
+	}
+
+};
+
+namespace payload_field {
+
+	struct os : payload_field_of<os, std::string> { static constexpr const char* name = "$os"; };
+
+	struct browser : payload_field_of<browser, std::string> { static constexpr const char* name = "$browser"; };
+
+	struct device : payload_field_of<device, std::string> { static constexpr const char* name = "$device"; };
+
+	struct token : payload_field_of<token, std::string> { static constexpr const char* name = "token"; };
+
+	struct properties : payload_field_of<properties, nlohmann::json, os, browser, device> { static constexpr const char* name = "properties"; };
+
+	struct compress : payload_field_of<compress, bool> { static constexpr const char* name = "compress"; };
+
+	struct intents : payload_field_of<intents, int> { static constexpr const char* name = "intents"; };
+
+	struct shard : payload_field_of<shard, nlohmann::json> { static constexpr const char* name = "shard"; };
+
+	struct presence : payload_field_of<presence, nlohmann::json> { static constexpr const char* name = "presence"; };
+
+	struct session_id : payload_field_of<session_id, std::string> { static constexpr const char* name = "session_id"; };
+
+	struct seq : payload_field_of<seq, int> { static constexpr const char* name = "seq"; };
+
+	struct guild_id : payload_field_of<guild_id, snowflake> { static constexpr const char* name = "guild_id"; };
+
+	struct channel_id : payload_field_of<channel_id, nlohmann::json> { static constexpr const char* name = "channel_id"; };
+
+	struct query : payload_field_of<query, std::string> { static constexpr const char* name = "query"; };
+
+	struct limit : payload_field_of<limit, int> { static constexpr const char* name = "limit"; };
+
+	struct nonce : payload_field_of<nonce, std::string> { static constexpr const char* name = "nonce"; };
+
+	struct self_mute : payload_field_of<self_mute, bool> { static constexpr const char* name = "self_mute"; };
+
+	struct self_deaf : payload_field_of<self_deaf, bool> { static constexpr const char* name = "self_deaf"; };
+
+	struct since : payload_field_of<since, nlohmann::json> { static constexpr const char* name = "since"; };
+
+	struct game : payload_field_of<game, nlohmann::json> { static constexpr const char* name = "game"; };
+
+	struct status : payload_field_of<status, std::string> { static constexpr const char* name = "status"; };
+
+	struct afk : payload_field_of<afk, bool> { static constexpr const char* name = "afk"; };
+
+}
+
+/*
+ * The "d" of a gateway command: its opcode, the fields it may have and those it requires.
+ * Validation is one lookup per required field, unrolled at compile time.
+ */
+template<opcode::gateway Op, class Required, class Optional = std::tuple<>> struct payload_schema_of;
+
+template<opcode::gateway Op, class... Required, class... Optional> struct payload_schema_of<Op, std::tuple<Required...>, std::tuple<Optional...>> {
+
+	static constexpr opcode::gateway op = Op;
+
+	/**
+	 * @return Whether F is a field of the command.
+	 */
+	template<class F> static constexpr bool has() {
+		return (std::is_same<F, Required>::value || ...) || (std::is_same<F, Optional>::value || ...);
+	}
+
+	static bool validate(const nlohmann::json& d) {
+		return (Required::present(d) && ... && true);
+	}
+
+};
+
+namespace payload_schema {
+
+	typedef payload_schema_of<opcode::gateway::identify, std::tuple<payload_field::token, payload_field::properties>, std::tuple<payload_field::compress, payload_field::intents, payload_field::shard, payload_field::presence>> identify;
+
+	typedef payload_schema_of<opcode::gateway::resume, std::tuple<payload_field::token, payload_field::session_id, payload_field::seq>> resume;
+
+	//The "d" of a heartbeat is the sequence itself
+	typedef payload_schema_of<opcode::gateway::heartbeat, std::tuple<>> heartbeat;
+
+	typedef payload_schema_of<opcode::gateway::request_guild_members, std::tuple<payload_field::guild_id, payload_field::limit>, std::tuple<payload_field::query, payload_field::nonce>> request_guild_members;
+
+	typedef payload_schema_of<opcode::gateway::voice_state_update, std::tuple<payload_field::guild_id, payload_field::channel_id, payload_field::self_mute, payload_field::self_deaf>> voice_state_update;
+
+	typedef payload_schema_of<opcode::gateway::presence_update, std::tuple<payload_field::since, payload_field::game, payload_field::status, payload_field::afk>> presence_update;
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef DISCORD_PAYLOAD_TEMPLATE
+#define DISCORD_PAYLOAD_TEMPLATE
+
+#include <payload.hpp>
+#include <misc/json.hpp>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+
+/*
+ * Class payload_template is a gateway payload serialized once, with slots for the values
+ * that change from one send to the next.
+ *
+ * The template is built from a payload whose variable fields hold slot(i) markers. It is
+ * dumped once and cut at the markers, a send only writes the slot values and copies the
+ * constant parts around them into a buffer kept between sends. Once the buffer and the
+ * values reached their size, rendering allocates nothing.
+ *
+ * Not thread safe, each sender keeps its own templates.
+ */
+class payload_template {
+
+public:
+
+	payload_template() {}
+
+	explicit payload_template(const payload& p) : payload_template(p.get_gateway_json()) {}
+
+	/**
+	 * @param envelope The whole payload, op and d included, its slots set to slot(i).
+	 */
+	explicit payload_template(const nlohmann::json& envelope) {
+		std::string text = envelope.dump();
+		size_t from = 0, at;
+		while ((at = text.find(MARKER, from)) != std::string::npos) {
+			size_t begin = at + MARKER.size();
+			size_t end = text.find('"', begin);
+			size_t index = std::stoul(text.substr(begin, end - begin));
+			m_parts.push_back(part{ text.substr(from, at - from), index });
+			if (index >= m_values.size()) m_values.resize(index + 1, "null");
+			from = end + 1;
+		}
+		m_tail = text.substr(from);
+		m_buffer.reserve(text.size());
+	}
+
+	/**
+	 * @return The marker of slot i, to put in place of a variable value.
+	 */
+	static std::string slot(size_t i) {
+		return "\x01" + std::to_string(i);
+	}
+
+	size_t slot_count() const { return m_values.size(); }
+
+	template<class T, std::enable_if_t<std::is_integral<T>::value, int> = 0> void set(size_t i, T value) {
+		char digits[24];
+		std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+		m_values[i].assign(digits, r.ptr - digits);
+	}
+
+	/**
+	 * Set slot i to value as a JSON string.
+	 */
+	void set(size_t i, std::string_view value) {
+		static const char* HEX = "0123456789abcdef";
+		std::string& v = m_values[i];
+		v.assign(1, '"');
+		for (char c : value) {
+			if (c == '"' || c == '\\') {
+				v.push_back('\\');
+				v.push_back(c);
+			}
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				v.append("\\u00");
+				v.push_back(HEX[(c >> 4) & 0xF]);
+				v.push_back(HEX[c & 0xF]);
+			}
+			else {
+				v.push_back(c);
+			}
+		}
+		v.push_back('"');
+	}
+
+	void set(size_t i, const char* value) {
+		set(i, std::string_view(value));
+	}
+
+	void set(size_t i, const std::string& value) {
+		set(i, std::string_view(value));
+	}
+
+	/**
+	 * Set slot i to already serialized JSON.
+	 */
+	void set_raw(size_t i, std::string_view json) {
+		m_values[i].assign(json.data(), json.size());
+	}
+
+	void set_null(size_t i) {
+		m_values[i].assign("null");
+	}
+
+	/**
+	 * @return The payload with the current slot values, valid until the next render.
+	 */
+	const std::string& render() {
+		m_buffer.clear();
+		for (const part& p : m_parts) {
+			m_buffer.append(p.text);
+			m_buffer.append(m_values[p.slot]);
+		}
+		m_buffer.append(m_tail);
+		return m_buffer;
+	}
+
+private:
+
+	//A marker string as dump() escapes it, opening quote included
+	static inline const std::string MARKER = "\"\\u0001";
+
+	struct part {
+		std::string	text;
+		size_t		slot;
+	};
+
+	std::vector<part>			m_parts;
+	std::string					m_tail;
+	std::vector<std::string>	m_values;
+	std::string					m_buffer;
+
+};
+
+#endif
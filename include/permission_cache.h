@@ -0,0 +1,242 @@
+#ifndef PERMISSION_CACHE
+#define PERMISSION_CACHE
+
+#include <member_store.h>
+#include <snowflake.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Permission bits, from Discord.
+ */
+namespace permission {
+
+	inline const uint64_t CREATE_INSTANT_INVITE		= 1ULL << 0;
+
+	inline const uint64_t KICK_MEMBERS				= 1ULL << 1;
+
+	inline const uint64_t BAN_MEMBERS				= 1ULL << 2;
+
+	inline const uint64_t ADMINISTRATOR				= 1ULL << 3;
+
+	inline const uint64_t MANAGE_CHANNELS			= 1ULL << 4;
+
+	inline const uint64_t MANAGE_GUILD				= 1ULL << 5;
+
+	inline const uint64_t ADD_REACTIONS				= 1ULL << 6;
+
+	inline const uint64_t VIEW_AUDIT_LOG			= 1ULL << 7;
+
+	inline const uint64_t VIEW_CHANNEL				= 1ULL << 10;
+
+	inline const uint64_t SEND_MESSAGES				= 1ULL << 11;
+
+	inline const uint64_t MANAGE_MESSAGES			= 1ULL << 13;
+
+	inline const uint64_t EMBED_LINKS				= 1ULL << 14;
+
+	inline const uint64_t ATTACH_FILES				= 1ULL << 15;
+
+	inline const uint64_t READ_MESSAGE_HISTORY		= 1ULL << 16;
+
+	inline const uint64_t MENTION_EVERYONE			= 1ULL << 17;
+
+	inline const uint64_t MANAGE_NICKNAMES			= 1ULL << 27;
+
+	inline const uint64_t MANAGE_ROLES				= 1ULL << 28;
+
+	inline const uint64_t ALL						= ~0ULL;
+
+}
+
+/*
+ * Class permission_cache keeps computed permissions: the base permissions of a member in
+ * its guild and its permissions in a channel, overwrites applied.
+ *
+ * Entries are invalidated by generations rather than found and erased. A guild, a channel
+ * and a member each have a generation, an entry remembers those it was computed under and
+ * is stale once any of them moved on: a role update bumps its guild and drops every entry
+ * of the guild, a channel update only the entries of that channel, a member update only
+ * the entries of that member. The generations are atomic counters in one table, an id
+ * hashed to its slot: nothing is stored per id, so they never need to be forgotten, and
+ * ids sharing a slot only cost each other a few extra misses.
+ *
+ * Entries sit in sets of WAYS slots, a key hashed to its set, and a lookup takes no lock.
+ * Each slot is a seqlock: its sequence is odd while a writer fills it, a reader keeps what
+ * it read only if the sequence was even and the same before and after. A store takes the
+ * slot of its key, else an empty or stale one of the set; when the whole set is current
+ * the table doubles, up to MAX_ENTRIES, past which a current entry is evicted. A table
+ * that was replaced is kept until the cache goes since a reader may still be in it, those
+ * add up to less than the current one.
+ */
+class permission_cache {
+
+public:
+
+	static const size_t MAX_ENTRIES = 1 << 20;
+
+	static const size_t GENERATION_SLOTS = 1 << 18;
+
+	/*
+	 * The generations an entry is computed under, taken before computing it.
+	 */
+	struct stamp {
+		uint32_t	reset = 0;
+		uint32_t	guild = 0;
+		uint32_t	channel = 0;
+		uint32_t	member = 0;
+
+		bool operator==(const stamp& o) const { return reset == o.reset && guild == o.guild && channel == o.channel && member == o.member; }
+
+		bool operator!=(const stamp& o) const { return !(*this == o); }
+	};
+
+	permission_cache();
+
+	permission_cache(const permission_cache&) = delete;
+
+	permission_cache& operator=(const permission_cache&) = delete;
+
+	/**
+	 * @param channel_id The channel, 0 for the base permissions in the guild.
+	 * @param perms		 Set to the cached permissions on a hit.
+	 * @param s			 Set to the current generations on a miss, to store the result with.
+	 * @return Whether the permissions were cached and current.
+	 */
+	bool find(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t& perms, stamp& s) const;
+
+	/**
+	 * Store permissions computed under s, dropped if s is already stale or a writer holds
+	 * the slot.
+	 */
+	void store(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t perms, const stamp& s);
+
+	void invalidate_guild(snowflake guild_id);
+
+	void invalidate_channel(snowflake channel_id);
+
+	void invalidate_member(snowflake guild_id, snowflake user_id);
+
+	/**
+	 * Make every entry stale, stamps taken before included.
+	 */
+	void clear();
+
+	/**
+	 * @return The number of current entries.
+	 */
+	size_t size() const;
+
+	/**
+	 * @return The number of slots of the table.
+	 */
+	size_t capacity() const;
+
+private:
+
+	static const size_t WAYS = 4;
+
+	//Slots of the first table
+	static const size_t INITIAL_SLOTS = 1024;
+
+	struct entry {
+		snowflake	guild_id;
+		//0 for the base permissions
+		snowflake	channel_id;
+		//0 for an empty slot
+		snowflake	user_id;
+		uint64_t	perms = 0;
+		stamp		at;
+	};
+
+	/*
+	 * An entry behind a seqlock, its fields are atomics so a reader racing a writer reads
+	 * torn values rather than undefined ones, and throws them away.
+	 */
+	struct alignas(64) slot {
+		std::atomic<uint32_t>	sequence{ 0 };
+		std::atomic<uint64_t>	guild_id{ 0 };
+		std::atomic<uint64_t>	channel_id{ 0 };
+		std::atomic<uint64_t>	user_id{ 0 };
+		std::atomic<uint64_t>	perms{ 0 };
+		//reset and guild, channel and member
+		std::atomic<uint64_t>	at_high{ 0 };
+		std::atomic<uint64_t>	at_low{ 0 };
+	};
+
+	struct table {
+		size_t						capacity;
+		std::unique_ptr<slot[]>		slots;
+
+		explicit table(size_t n) : capacity(n), slots(new slot[n]) {}
+
+		slot* set_of(snowflake guild_id, snowflake user_id, snowflake channel_id) const {
+			return &slots[(mix(channel_id ? channel_id : guild_id, user_id) & (capacity / WAYS - 1)) * WAYS];
+		}
+	};
+
+	/*
+	 * A multiplicative hash, cheaper than snowflake::hash() on the lookup path: the high
+	 * half of the product depends on every bit of the ids.
+	 */
+	static size_t mix(snowflake a, snowflake b = snowflake()) {
+		return static_cast<size_t>(((a.value() * 0x9E3779B97F4A7C15ULL) ^ b.value()) * 0xC2B2AE3D27D4EB4FULL >> 32);
+	}
+
+	std::atomic<uint32_t>& generation_of(snowflake id) const {
+		return m_generations[mix(id) & (GENERATION_SLOTS - 1)];
+	}
+
+	std::atomic<uint32_t>& generation_of(snowflake guild_id, snowflake user_id) const {
+		return m_generations[mix(guild_id, user_id) & (GENERATION_SLOTS - 1)];
+	}
+
+	stamp current(snowflake guild_id, snowflake user_id, snowflake channel_id) const {
+		stamp s;
+		s.reset = m_resets.load(std::memory_order_acquire);
+		s.guild = generation_of(guild_id).load(std::memory_order_acquire);
+		s.channel = channel_id ? generation_of(channel_id).load(std::memory_order_acquire) : 0;
+		s.member = generation_of(guild_id, user_id).load(std::memory_order_acquire);
+		return s;
+	}
+
+	bool is_current(const entry& e) const {
+		return e.at == current(e.guild_id, e.user_id, e.channel_id);
+	}
+
+	/**
+	 * Read a slot, false if a writer was in it meanwhile.
+	 */
+	static bool read(const slot& sl, entry& e);
+
+	/**
+	 * Fill a slot, false if another writer holds it.
+	 */
+	static bool write(slot& sl, const entry& e);
+
+	/**
+	 * Put e in the slot of its key or in an empty or stale one of its set.
+	 *
+	 * @param evict Whether a current entry may be evicted when there is no such slot.
+	 * @return False if the set was full of current entries.
+	 */
+	bool place(table& t, const entry& e, bool evict);
+
+	/**
+	 * Replace t with a table twice as large holding its current entries.
+	 */
+	void grow(table* t);
+
+	std::unique_ptr<std::atomic<uint32_t>[]>	m_generations;
+	std::atomic<uint32_t>						m_resets;
+	std::atomic<table*>							m_table;
+	//Every table so far, the last is the current one
+	std::vector<std::unique_ptr<table>>			m_tables;
+	std::mutex									m_grow_lock;
+
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PRESENCE_STATE
+#define PRESENCE_STATE
+
+#include <misc/json.hpp>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+/*
+ * Class presence_state holds the latest presence (opcode 3) of a bot for all its shards.
+ * The payload is serialized once per update, in both encodings, and every shard copies
+ * the bytes into its own queue. Each shard sends at most one presence per
+ * PRESENCE_WINDOW and always the latest one, updates in between replace each other.
+ */
+class presence_state {
+
+public:
+
+	typedef std::chrono::steady_clock clock;
+
+	presence_state();
+
+	/**
+	 * Replace the presence.
+	 *
+	 * @param gateway_json The whole gateway payload, op and d.
+	 */
+	void set(const nlohmann::json& gateway_json);
+
+	/**
+	 * Get the presence if it changed since version.
+	 *
+	 * @param version Version the caller last sent, updated to the returned one.
+	 * @param etf	  Whether to return the ETF or the JSON serialization.
+	 * @param out	  Set to the serialized payload.
+	 * @return Whether there was a newer presence.
+	 */
+	bool get_if_newer(uint64_t& version, bool etf, std::string& out);
+
+	static const std::chrono::milliseconds PRESENCE_WINDOW;
+
+private:
+
+	std::mutex	m_lock;
+	uint64_t	m_version;
+	std::string	m_json;
+	std::string	m_etf;
+
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <string>
+#include <chrono>
+#include <vector>
 
 class rate_limit {
 
@@ -23,4 +26,47 @@ private:
 	
 };
 
+/*
+ * Class sliding_window allows at most limit operations in any period, it keeps the
+ * time of the last limit operations. Unlike a token bucket refilled continuously,
+ * a full burst is never followed by more operations before the period is over.
+ * Part of the window can be reserved so that low priority operations never use
+ * the last operations and high priority ones always find one.
+ */
+class sliding_window {
+
+public:
+
+	typedef std::chrono::steady_clock clock;
+
+	sliding_window(unsigned int limit, std::chrono::milliseconds period);
+
+	/**
+	 * Count an operation if more than reserved are left in the window.
+	 *
+	 * @param reserved Number of operations that must stay available.
+	 * @return Whether the operation was counted.
+	 */
+	bool try_take(unsigned int reserved = 0);
+
+	/**
+	 * @param reserved Number of operations that must stay available.
+	 * @return Time until try_take(reserved) succeeds.
+	 */
+	std::chrono::milliseconds time_until_available(unsigned int reserved = 0);
+
+	unsigned int get_limit() const;
+
+private:
+
+	void expire(clock::time_point now);
+
+	//Ring of the times of the operations still in the window, oldest at m_first
+	std::vector<clock::time_point>	m_times;
+	size_t							m_first;
+	size_t							m_count;
+	clock::duration					m_period;
+
+};
+
 #endif
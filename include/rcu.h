@@ -0,0 +1,95 @@
+#ifndef RCU
+#define RCU
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Class rcu is epoch based reclamation for read-mostly structures.
+ *
+ * Readers enter a read section with a read_guard: it announces the current epoch in a slot of
+ * the thread and takes no lock. Writers unlink a node, retire it, and it is only deleted once
+ * every reader that was inside a read section when it was unlinked has left it, that is once
+ * no slot announces an epoch at or before the one it was retired in.
+ *
+ * Each reading thread takes one slot on its first read section and frees it when it exits.
+ */
+class rcu {
+
+public:
+
+	static const size_t MAX_READERS = 1024;
+
+	/*
+	 * A read section, pointers read under it stay valid until it ends. Sections nest.
+	 */
+	class read_guard {
+
+	public:
+
+		read_guard();
+
+		~read_guard();
+
+		read_guard(const read_guard&) = delete;
+
+		read_guard& operator=(const read_guard&) = delete;
+
+	};
+
+	/**
+	 * Delete p once no read section can see it anymore. p must already be unreachable
+	 * for new readers.
+	 */
+	template<class T> static void retire(const T* p) {
+		if (p != nullptr) retire(const_cast<T*>(p), [](void* q) { delete static_cast<T*>(q); });
+	}
+
+	static void retire(void* p, void (*deleter)(void*));
+
+	/**
+	 * Delete the retired nodes no reader can see, called by writers after a batch of updates.
+	 */
+	static void reclaim();
+
+	/**
+	 * @return Retired nodes waiting for readers.
+	 */
+	static size_t pending();
+
+private:
+
+	struct alignas(64) slot {
+		std::atomic<uint64_t>	epoch{ 0 };
+		std::atomic<bool>		used{ false };
+	};
+
+	struct retired {
+		void*		p;
+		void		(*deleter)(void*);
+		uint64_t	epoch;
+	};
+
+	struct thread_slot {
+		slot*		s = nullptr;
+		unsigned	depth = 0;
+
+		~thread_slot();
+	};
+
+	static thread_slot& local();
+
+	static void enter();
+
+	static void leave();
+
+	static slot						s_slots[MAX_READERS];
+	static std::atomic<uint64_t>	s_epoch;
+	static std::mutex				s_retired_lock;
+	static std::vector<retired>		s_retired;
+
+};
+
+#endif
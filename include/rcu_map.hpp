@@ -0,0 +1,189 @@
+#ifndef RCU_MAP
+#define RCU_MAP
+
+#include <rcu.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+/*
+ * Class rcu_map is a hash map read without locks: readers look up under an rcu::read_guard
+ * while one writer at a time changes it.
+ *
+ * Values are immutable once published. The writer replaces a value by linking a new node in
+ * place of the old one and retires the old one, a reader sees either version whole and never
+ * a half written one. Buckets are chains of atomic pointers. Growing publishes a new bucket
+ * array holding copies of the nodes, the old array and nodes are retired with it.
+ *
+ * Writers must be serialized by the caller. Pointers returned to a reader are valid until
+ * its read_guard ends, pointers returned to the writer until its next change.
+ */
+template<class K, class V, class Hash = std::hash<K>> class rcu_map {
+
+public:
+
+	rcu_map() : m_table(new table(8)), m_size(0) {}
+
+	~rcu_map() {
+		//No reader may be left when the map goes, everything is deleted now
+		destroy(m_table.load(std::memory_order_relaxed), true);
+	}
+
+	rcu_map(const rcu_map&) = delete;
+
+	rcu_map& operator=(const rcu_map&) = delete;
+
+	size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+	bool empty() const { return size() == 0; }
+
+	/**
+	 * @return Bytes held by the buckets and the nodes, not counting what the values allocate.
+	 */
+	size_t memory_usage() const {
+		return m_table.load(std::memory_order_acquire)->bucket_count * sizeof(std::atomic<node*>) + size() * sizeof(node);
+	}
+
+	/**
+	 * @return The value of key, nullptr if there is none. Readers call it under a read_guard.
+	 */
+	const V* find(const K& key) const {
+		const table* t = m_table.load(std::memory_order_acquire);
+		for (const node* n = t->buckets[index(t, key)].load(std::memory_order_acquire); n != nullptr; n = n->next.load(std::memory_order_acquire)) {
+			if (n->key == key) return &n->value;
+		}
+		return nullptr;
+	}
+
+	bool contains(const K& key) const {
+		return find(key) != nullptr;
+	}
+
+	/**
+	 * Publish value as the value of key, the previous one is retired.
+	 */
+	void assign(const K& key, V value) {
+		table* t = m_table.load(std::memory_order_relaxed);
+		std::atomic<node*>* link = &t->buckets[index(t, key)];
+		for (node* n = link->load(std::memory_order_relaxed); n != nullptr; n = n->next.load(std::memory_order_relaxed)) {
+			if (n->key == key) {
+				node* replacement = new node(key, std::move(value), n->next.load(std::memory_order_relaxed));
+				link->store(replacement, std::memory_order_release);
+				rcu::retire(n);
+				return;
+			}
+			link = &n->next;
+		}
+
+		std::atomic<node*>& head = t->buckets[index(t, key)];
+		head.store(new node(key, std::move(value), head.load(std::memory_order_relaxed)), std::memory_order_release);
+		if (m_size.fetch_add(1, std::memory_order_relaxed) + 1 > t->bucket_count) rehash(t->bucket_count * 2);
+	}
+
+	/**
+	 * @return Whether key was there.
+	 */
+	bool erase(const K& key) {
+		table* t = m_table.load(std::memory_order_relaxed);
+		std::atomic<node*>* link = &t->buckets[index(t, key)];
+		for (node* n = link->load(std::memory_order_relaxed); n != nullptr; n = n->next.load(std::memory_order_relaxed)) {
+			if (n->key == key) {
+				link->store(n->next.load(std::memory_order_relaxed), std::memory_order_release);
+				rcu::retire(n);
+				m_size.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+			link = &n->next;
+		}
+		return false;
+	}
+
+	void clear() {
+		table* old = m_table.exchange(new table(8), std::memory_order_acq_rel);
+		m_size.store(0, std::memory_order_relaxed);
+		destroy(old, false);
+	}
+
+	/**
+	 * Make room for n elements, growing copies every node.
+	 */
+	void reserve(size_t n) {
+		size_t count = 8;
+		while (count < n) count *= 2;
+		if (count > m_table.load(std::memory_order_relaxed)->bucket_count) rehash(count);
+	}
+
+	/**
+	 * Call f(key, value) for every element, under a read_guard for readers.
+	 */
+	template<class F> void for_each(F f) const {
+		const table* t = m_table.load(std::memory_order_acquire);
+		for (size_t i = 0; i < t->bucket_count; i++) {
+			for (const node* n = t->buckets[i].load(std::memory_order_acquire); n != nullptr; n = n->next.load(std::memory_order_acquire)) {
+				f(n->key, n->value);
+			}
+		}
+	}
+
+private:
+
+	struct node {
+		K					key;
+		V					value;
+		std::atomic<node*>	next;
+
+		node(const K& k, V&& v, node* n) : key(k), value(std::move(v)), next(n) {}
+
+		node(const K& k, const V& v, node* n) : key(k), value(v), next(n) {}
+	};
+
+	struct table {
+		size_t									bucket_count;
+		std::unique_ptr<std::atomic<node*>[]>	buckets;
+
+		explicit table(size_t count) : bucket_count(count), buckets(new std::atomic<node*>[count]) {
+			for (size_t i = 0; i < count; i++) buckets[i].store(nullptr, std::memory_order_relaxed);
+		}
+	};
+
+	static size_t index(const table* t, const K& key) {
+		return Hash()(key) & (t->bucket_count - 1);
+	}
+
+	void rehash(size_t count) {
+		table* old = m_table.load(std::memory_order_relaxed);
+		table* t = new table(count);
+		for (size_t i = 0; i < old->bucket_count; i++) {
+			for (node* n = old->buckets[i].load(std::memory_order_relaxed); n != nullptr; n = n->next.load(std::memory_order_relaxed)) {
+				std::atomic<node*>& head = t->buckets[index(t, n->key)];
+				head.store(new node(n->key, n->value, head.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+			}
+		}
+		m_table.store(t, std::memory_order_release);
+		destroy(old, false);
+	}
+
+	/*
+	 * Delete or retire a table and its nodes.
+	 */
+	static void destroy(table* t, bool now) {
+		for (size_t i = 0; i < t->bucket_count; i++) {
+			node* n = t->buckets[i].load(std::memory_order_relaxed);
+			while (n != nullptr) {
+				node* next = n->next.load(std::memory_order_relaxed);
+				if (now) delete n;
+				else rcu::retire(n);
+				n = next;
+			}
+		}
+		if (now) delete t;
+		else rcu::retire(t);
+	}
+
+	std::atomic<table*>		m_table;
+	std::atomic<size_t>		m_size;
+
+};
+
+#endif
@@ -11,6 +11,8 @@
 #include <sstream>
 #include <openssl/ssl.h>
 #include <iostream>
+#include <unordered_map>
+#include <mutex>
 
 //Winsocket and OpenSSL initialization
 static struct WSINIT {
@@ -77,6 +79,17 @@ inline void wait_read(hsocket hs, const timeval* timeout) {
 	wait(&fds, nullptr, nullptr, timeout);
 }
 
+/**
+ * @return Whether data waits to be read on hs, without waiting for it.
+ */
+inline bool is_readable(hsocket hs) {
+	struct fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(hs, &fds);
+	timeval now = { 0, 0 };
+	return select(0, &fds, nullptr, nullptr, &now) > 0;
+}
+
 inline void wait_write(hsocket hs, const timeval* timeout) {
 	struct fd_set fds;
 	FD_ZERO(&fds);
@@ -91,6 +104,65 @@ inline void wait_read_write(hsocket hs, const timeval* timeout) {
 	wait(&fds, &fds, nullptr, timeout);
 }
 
+/*
+ * Class tls_context is one SSL_CTX shared by many sockets, with a client session cache
+ * keyed by host and port. A socket connecting to a host that was already connected to
+ * offers the cached session and resumes it with an abbreviated handshake.
+ * Every hsocket_tls uses the process wide shared() context unless given another one.
+ */
+class tls_context {
+public:
+
+	tls_context(const SSL_METHOD* method = DEFAULT_METHOD) :
+		m_ctx(SSL_CTX_new(method))
+	{
+		SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_CLIENT);
+	}
+
+	~tls_context() {
+		for (auto& i : m_sessions) SSL_SESSION_free(i.second);
+		SSL_CTX_free(m_ctx);
+	}
+
+	tls_context(const tls_context&) = delete;
+
+	SSL* create_ssl() {
+		return SSL_new(m_ctx);
+	}
+
+	/**
+	 * Offer the cached session of key to ssl, before the handshake.
+	 */
+	void resume(SSL* ssl, const std::string& key) {
+		std::lock_guard<std::mutex> guard(m_lock);
+		auto it = m_sessions.find(key);
+		if (it != m_sessions.end()) SSL_set_session(ssl, it->second);
+	}
+
+	/**
+	 * Cache the session of ssl under key, after the handshake.
+	 */
+	void store(SSL* ssl, const std::string& key) {
+		SSL_SESSION* session = SSL_get1_session(ssl);
+		if (session == nullptr) return;
+		std::lock_guard<std::mutex> guard(m_lock);
+		SSL_SESSION*& cached = m_sessions[key];
+		if (cached != nullptr) SSL_SESSION_free(cached);
+		cached = session;
+	}
+
+	static tls_context& shared() {
+		static tls_context context;
+		return context;
+	}
+
+private:
+
+	SSL_CTX*	m_ctx;
+	std::mutex	m_lock;
+	std::unordered_map<std::string, SSL_SESSION*> m_sessions;
+};
+
 /*
  * Class hsocket_tls initiates SSL and socket with non-blocking I/O, TLS 1.2 by default.
  * It handles asynchronous writing and reading for the socket with default timeout time is 5 seconds.
@@ -100,12 +172,18 @@ inline void wait_read_write(hsocket hs, const timeval* timeout) {
 class hsocket_tls {
 public:
 
-	hsocket_tls() : 
+	hsocket_tls(tls_context& context = tls_context::shared()) : 
 		m_buffer(new char[0]), 
 		m_len(0),
 		m_connected(false),
 		m_reading(false),
-		m_timeout(new timeval()) {}
+		m_timeout(new timeval()),
+		m_timeout_ms(TIMEOUT),
+		m_ssl(nullptr),
+		m_context(context)
+	{
+		set_read_timeout(TIMEOUT);
+	}
 
 	~hsocket_tls() {
 		delete m_timeout;
@@ -114,7 +192,6 @@ public:
 		closesocket(m_socket);
 
 		SSL_free(m_ssl);
-		SSL_CTX_free(m_ssl_ctx);
 	}
 
 	/**
@@ -140,14 +217,14 @@ public:
 		sin.sin_addr.S_un.S_addr = ip_addr;
 
 		m_socket = create_tcp_socket();
-		m_timeout->tv_sec = TIMEOUT / 1000;
-		m_timeout->tv_usec = (TIMEOUT * 1000) % 1000000;
+		set_timeout(m_timeout_ms);
 		set_non_blocking(m_socket, &m_mode);
 
-		m_ssl_ctx = SSL_CTX_new(DEFAULT_METHOD);
-		m_ssl = SSL_new(m_ssl_ctx);
+		std::string session_key = m_host + ":" + std::to_string(m_port);
+		m_ssl = m_context.create_ssl();
 		SSL_set_fd(m_ssl, m_socket);
 		SSL_set_connect_state(m_ssl);
+		m_context.resume(m_ssl, session_key);
 
 		connect(m_socket, (const sockaddr*) &sin, sizeof(sin));
 		wait_read_write(m_socket, m_timeout);
@@ -168,6 +245,7 @@ public:
 			e = SSL_get_error(m_ssl, SSL_do_handshake(m_ssl));
 		}
 
+		m_context.store(m_ssl, session_key);
 		m_connected = true;
 	}
 
@@ -175,10 +253,39 @@ public:
 		if (!m_connected) return;
 		SSL_shutdown(m_ssl);
 		SSL_free(m_ssl);
-		SSL_CTX_free(m_ssl_ctx);
+		m_ssl = nullptr;
 		closesocket(m_socket);
 		m_connected = false;
 	}
+
+	/**
+	 * Set how long connecting and writing wait for the socket, 5 seconds by default.
+	 *
+	 * @param ms The timeout in milliseconds.
+	 */
+	void set_timeout(long ms) {
+		m_timeout_ms = ms;
+		m_timeout->tv_sec = ms / 1000;
+		m_timeout->tv_usec = (ms * 1000) % 1000000;
+	}
+
+	/**
+	 * Set how long reading waits for the socket, 5 seconds by default. It is kept when
+	 * the socket connects again.
+	 * A reader polling many sockets uses 0: it only reads a socket select() found
+	 * readable, takes what arrived and leaves the rest in flight to its next round.
+	 *
+	 * @param ms The timeout in milliseconds.
+	 */
+	void set_read_timeout(long ms) {
+		m_read_timeout_ms = ms;
+		m_read_timeout.tv_sec = ms / 1000;
+		m_read_timeout.tv_usec = (ms * 1000) % 1000000;
+	}
+
+	hsocket get_socket() const {
+		return m_socket;
+	}
 	
 	/**
 	 * This method writes buf of len bytes to the socket with SSL_write. 
@@ -227,12 +334,14 @@ public:
 		int n, t = 0, cursor = m_cursor;
 		char buffer[DEFAULT_BUFFER_SIZE];
 
-		wait_read(m_socket, m_timeout);
+		wait_read(m_socket, &m_read_timeout);
 
 		while ((n = SSL_read(m_ssl, buffer, sizeof(buffer))) > 0) {
 			copy_to_buffer(buffer, n);
 			t += n;
-			wait_read(m_socket, m_timeout);
+			//Without a timeout, stop once OpenSSL holds nothing decrypted and nothing more arrived
+			if (m_read_timeout_ms == 0 && SSL_pending(m_ssl) == 0 && !is_readable(m_socket)) break;
+			wait_read(m_socket, &m_read_timeout);
 		}
 
 		if (t > len) {
@@ -329,8 +438,11 @@ private:
 	hsocket			m_socket;
 	mode			m_mode = 1;
 	SSL*			m_ssl;
-	SSL_CTX*		m_ssl_ctx;
+	tls_context&	m_context;
 	timeval*		m_timeout;
+	long			m_timeout_ms;
+	timeval			m_read_timeout;
+	long			m_read_timeout_ms;
 };
 
 #endif
\ No newline at end of file
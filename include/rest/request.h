@@ -5,6 +5,8 @@
 #include <string>
 #include <misc/json.hpp>
 #include <sstream>
+#include <vector>
+#include <utility>
 #include <iostream>
 
 #define HTTP std::string("HTTP/1.1\r\n")
@@ -52,6 +54,22 @@ public:
 
 	value get_method() const { return m_method; }
 
+	/**
+	 * Write the request line and headers of a request to out, leaving the method untouched.
+	 */
+	void write(std::string& out, const std::string& host, const std::string& route, const std::string& headers) const {
+		out += get_method_name(m_method);
+		out += ' ';
+		out += route;
+		out += ' ';
+		out += HTTP;
+		out += "Host: ";
+		out += host;
+		out += "\r\n";
+		out += headers;
+		out += "\r\n\r\n";
+	}
+
 	virtual void content_type(std::string) { return; }
 
 	virtual std::string dump() {
@@ -61,14 +79,14 @@ public:
 
 };
 
-inline struct get : public virtual method {
+inline const struct get : public virtual method {
 
 	get(value m) : method(m)  {}
 
 } REST_GET(GET);
 
 
-inline struct post : public virtual method {
+inline const struct post : public virtual method {
 
 public:
 
@@ -76,31 +94,120 @@ public:
 
 } REST_POST(POST);
 
-inline struct put : public virtual method {
+inline const struct put : public virtual method {
 
 	put(value m) : method(m) {}
 
 } REST_PUT(PUT);
 
-inline std::string handle_request(
-	method&			   method, 
+/**
+ * Build a request in a buffer of the calling thread, the methods are shared and never modified.
+ *
+ * @return The request, valid until the thread builds the next one.
+ */
+inline const std::string& handle_request(
+	const method&	   method, 
 	const std::string& host, 
 	const std::string& route, 
 	const std::string& headers, 
 	const std::string& data) {
 	
-	std::string request;
+	static thread_local std::string request;
 
-	method.reset_header();
-	method.route(route);
-	method.host(host);
-	method.header(headers);
-
-	request = method.dump() + data;
+	request.clear();
+	method.write(request, host, route, headers);
+	request += data;
 	
 	return request;
 }
 
+/*
+ * Class request_builder assembles the headers and the body of one REST request in buffers of
+ * the calling thread, reused from a request to the next. The default headers are only read,
+ * so threads build and send requests at once without sharing anything mutable.
+ *
+ * One builder per thread at a time, its strings are valid until the thread starts another.
+ */
+class request_builder {
+
+public:
+
+	/**
+	 * @param defaults Headers of every request of this kind, those set by header() win.
+	 */
+	explicit request_builder(const nlohmann::json& defaults) :
+		m_buffers(local()),
+		m_defaults(defaults)
+	{
+		m_buffers.headers.clear();
+		m_buffers.overrides.clear();
+		m_buffers.body.clear();
+	}
+
+	request_builder(const request_builder&) = delete;
+
+	request_builder& header(const std::string& name, const std::string& value) {
+		m_buffers.overrides.emplace_back(name, value);
+		return *this;
+	}
+
+	/**
+	 * Set the body, and its Content-Length.
+	 */
+	request_builder& body(const nlohmann::json& data) {
+		m_buffers.body = data.dump();
+		return header("Content-Length", std::to_string(m_buffers.body.size()));
+	}
+
+	/**
+	 * @return The headers, one per line, without the line break of the last one.
+	 */
+	const std::string& get_headers() {
+		std::string& out = m_buffers.headers;
+		out.clear();
+		for (auto& i : m_defaults.items()) {
+			if (find(i.key()) != nullptr) continue;
+			append(i.key(), i.value().is_string() ? i.value().get_ref<const std::string&>() : i.value().dump());
+		}
+		for (const std::pair<std::string, std::string>& h : m_buffers.overrides) append(h.first, h.second);
+		if (out.size() >= 2) out.erase(out.size() - 2);
+		return out;
+	}
+
+	const std::string& get_body() const { return m_buffers.body; }
+
+private:
+
+	struct buffers {
+		std::string										headers;
+		std::string										body;
+		std::vector<std::pair<std::string, std::string>> overrides;
+	};
+
+	static buffers& local() {
+		static thread_local buffers b;
+		return b;
+	}
+
+	const std::string* find(const std::string& name) const {
+		for (const std::pair<std::string, std::string>& h : m_buffers.overrides) {
+			if (h.first == name) return &h.second;
+		}
+		return nullptr;
+	}
+
+	void append(const std::string& name, const std::string& value) {
+		m_buffers.headers += name;
+		m_buffers.headers += ": ";
+		m_buffers.headers += value;
+		m_buffers.headers += "\r\n";
+	}
+
+	buffers&				m_buffers;
+	const nlohmann::json&	m_defaults;
+
+};
+
 inline nlohmann::json handle_response( 
 	const std::string& res) {
 	std::cout << "Raw response:\n" << res;
@@ -122,7 +229,7 @@ inline nlohmann::json handle_response(
 			try {
 				response["data"] = nlohmann::json::parse(l);
 			}
-			catch (nlohmann::json::parse_error) {
+			catch (const nlohmann::json::parse_error&) {
 				response["data"] = l;
 			}
 		}
@@ -4,6 +4,7 @@
 #include <rest/request.h>
 #include <rest/hsocket.h>
 #include <iostream>
+#include <mutex>
 
 class rest {
 
@@ -46,17 +47,18 @@ public:
 	 * @param method A HTTP method.
 	 * @param route A route relative to the host.
 	 * @param data Data to send to the host.
-	 * @return JSON object representing the response from the host.
+	 * @return JSON object representing the response from the host, empty if not connected.
 	 */
-	nlohmann::json send(method& method, const std::string& route, const nlohmann::json& headers = {}, const nlohmann::json& data = {});
+	nlohmann::json send(const method& method, const std::string& route, const nlohmann::json& headers = {}, const nlohmann::json& data = {});
 
-	nlohmann::json send(method& method, const std::string& route, const std::string& headers = "", const std::string& data = "");
+	nlohmann::json send(const method& method, const std::string& route, const std::string& headers = "", const std::string& data = "");
 
 private:
 
 	std::string	 m_host;
 	short		 m_port;
 	hsocket_tls* m_hsocket;
+	std::mutex	 m_lock;
 	
 };
 
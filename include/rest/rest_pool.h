@@ -0,0 +1,57 @@
+#ifndef REST_POOL
+#define REST_POOL
+
+#include <rest/rest.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/*
+ * Class rest_pool keeps a few keep-alive connections to one host and lends an idle one
+ * to each request, so requests of different bots or threads run in parallel without
+ * one TLS handshake per caller. The pool holds no rate limit state, each bot keeps its own.
+ */
+class rest_pool {
+
+public:
+
+	/**
+	 * @param host Host to connect to.
+	 * @param size Number of connections, at least one.
+	 * @param port Port of the host.
+	 */
+	rest_pool(const std::string& host = "discord.com", size_t size = 1, const short& port = 443);
+
+	~rest_pool();
+
+	rest_pool(const rest_pool&) = delete;
+
+	/**
+	 * Connect every connection of the pool that is not connected yet.
+	 */
+	void open();
+
+	void close();
+
+	/**
+	 * Send a request on an idle connection, waiting for one if they are all busy.
+	 * See rest::send.
+	 */
+	nlohmann::json send(const method& method, const std::string& route, const nlohmann::json& headers = {}, const nlohmann::json& data = {});
+
+	nlohmann::json send(const method& method, const std::string& route, const std::string& headers = "", const std::string& data = "");
+
+private:
+
+	rest* lease();
+
+	void release(rest* r);
+
+	std::vector<rest*>		m_connections;
+	std::vector<rest*>		m_idle;
+	std::mutex				m_lock;
+	std::condition_variable	m_available;
+
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef DISCORD_SNOWFLAKE
+#define DISCORD_SNOWFLAKE
+
+#include <misc/json.hpp>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+/*
+ * From Discord:
+ * "Discord utilizes Twitter's snowflake format for uniquely identifiable descriptors (IDs).
+ * These IDs are guaranteed to be unique across all of Discord...
+ * Because Snowflake IDs are up to 64 bits in size (e.g. a uint64), they are always
+ * returned as strings in the HTTP API to prevent integer overflows in some languages."
+ *
+ *	bits 63 to 22	milliseconds since the Discord epoch (1420070400000)
+ *	bits 21 to 17	internal worker id
+ *	bits 16 to 12	internal process id
+ *	bits 11 to 0	increment
+ *
+ * Class snowflake keeps an id as its 64 bit value. It is parsed from the digits of the
+ * JSON string without allocating and written back as digits straight into a buffer.
+ */
+class snowflake {
+
+public:
+
+	static const uint64_t DISCORD_EPOCH = 1420070400000ULL;
+
+	/*
+	 * Longest decimal form of a 64 bit value.
+	 */
+	static const size_t MAX_DIGITS = 20;
+
+	constexpr snowflake() : m_value(0) {}
+
+	constexpr explicit snowflake(uint64_t value) : m_value(value) {}
+
+	/**
+	 * Parse an id, 0 if s is not a valid one.
+	 */
+	explicit snowflake(std::string_view s) : m_value(0) {
+		parse(s, *this);
+	}
+
+	/**
+	 * Parse the decimal digits of an id, with or without the quotes of a JSON string.
+	 *
+	 * @param s	 The digits.
+	 * @param id Set to the id, left unchanged on failure.
+	 * @return False if s is empty, has a non digit or does not fit in 64 bits.
+	 */
+	static bool parse(std::string_view s, snowflake& id) {
+		if (s.size() >= 2 && s.front() == '"' && s.back() == '"') s = s.substr(1, s.size() - 2);
+		if (s.empty() || s.size() > MAX_DIGITS) return false;
+		uint64_t v = 0;
+		for (char c : s) {
+			if (c < '0' || c > '9') return false;
+			uint64_t digit = static_cast<uint64_t>(c - '0');
+			if (v > (UINT64_MAX - digit) / 10) return false;
+			v = v * 10 + digit;
+		}
+		id.m_value = v;
+		return true;
+	}
+
+	constexpr uint64_t value() const { return m_value; }
+
+	constexpr bool empty() const { return m_value == 0; }
+
+	constexpr explicit operator bool() const { return m_value != 0; }
+
+	/**
+	 * @return Milliseconds since the Unix epoch at which the id was created.
+	 */
+	constexpr uint64_t timestamp() const { return (m_value >> 22) + DISCORD_EPOCH; }
+
+	constexpr unsigned int worker_id() const { return static_cast<unsigned int>((m_value >> 17) & 0x1F); }
+
+	constexpr unsigned int process_id() const { return static_cast<unsigned int>((m_value >> 12) & 0x1F); }
+
+	constexpr unsigned int increment() const { return static_cast<unsigned int>(m_value & 0xFFF); }
+
+	/**
+	 * Write the decimal digits of the id at out, which must have MAX_DIGITS bytes.
+	 *
+	 * @return The end of the written digits.
+	 */
+	char* format(char* out) const {
+		char digits[MAX_DIGITS];
+		size_t n = 0;
+		uint64_t v = m_value;
+		do {
+			digits[n++] = static_cast<char>('0' + v % 10);
+			v /= 10;
+		} while (v != 0);
+		while (n > 0) *out++ = digits[--n];
+		return out;
+	}
+
+	/**
+	 * Append the decimal digits of the id to s, e.g. into a REST route.
+	 */
+	void append_to(std::string& s) const {
+		char buf[MAX_DIGITS];
+		s.append(buf, format(buf) - buf);
+	}
+
+	std::string to_string() const {
+		std::string s;
+		append_to(s);
+		return s;
+	}
+
+	/**
+	 * @return The id with its bits mixed, the low bits of an id are mostly the
+	 * increment and a zero process id, they make a poor hash on their own.
+	 */
+	constexpr size_t hash() const {
+		uint64_t h = m_value;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return static_cast<size_t>(h);
+	}
+
+	constexpr bool operator==(const snowflake& o) const { return m_value == o.m_value; }
+
+	constexpr bool operator!=(const snowflake& o) const { return m_value != o.m_value; }
+
+	constexpr bool operator<(const snowflake& o) const { return m_value < o.m_value; }
+
+	constexpr bool operator>(const snowflake& o) const { return m_value > o.m_value; }
+
+	constexpr bool operator<=(const snowflake& o) const { return m_value <= o.m_value; }
+
+	constexpr bool operator>=(const snowflake& o) const { return m_value >= o.m_value; }
+
+private:
+
+	uint64_t m_value;
+
+};
+
+namespace std {
+
+	template<> struct hash<snowflake> {
+		size_t operator()(const snowflake& id) const { return id.hash(); }
+	};
+
+}
+
+/*
+ * nlohmann::json conversions: ids are strings in JSON, ETF may give them as numbers.
+ */
+inline void to_json(nlohmann::json& j, const snowflake& id) {
+	j = id.to_string();
+}
+
+inline void from_json(const nlohmann::json& j, snowflake& id) {
+	if (j.is_string()) snowflake::parse(j.get_ref<const std::string&>(), id);
+	else if (j.is_number_unsigned() || j.is_number_integer()) id = snowflake(j.get<uint64_t>());
+	else id = snowflake();
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef WEBSOCKETPP_COMMON_CPU_HPP
+#define WEBSOCKETPP_COMMON_CPU_HPP
+
+// SIMD code paths are built for x86 targets, where SSE2 is always present. AVX2
+// code is compiled per function and only run once cpu::has_avx2() says so.
+#if !defined(_WEBSOCKETPP_NO_SIMD_) && (defined(_M_X64) || defined(__x86_64__) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+    #define _WEBSOCKETPP_SIMD_
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define _WEBSOCKETPP_TARGET_AVX2_
+    #else
+        #define _WEBSOCKETPP_TARGET_AVX2_ __attribute__((target("avx2")))
+    #endif
+#endif
+
+/// Detection of the instruction sets the SIMD code paths use
+namespace cpu {
+
+#ifdef _WEBSOCKETPP_SIMD_
+
+/// Query the CPU and the OS for AVX2
+inline bool detect_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    // the OS must save the ymm registers
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // _WEBSOCKETPP_SIMD_
+
+/// Whether AVX2 code can run, queried once
+inline bool has_avx2() {
+#ifdef _WEBSOCKETPP_SIMD_
+    static bool const avx2 = detect_avx2();
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+} // namespace cpu
+
+#endif // WEBSOCKETPP_COMMON_CPU_HPP
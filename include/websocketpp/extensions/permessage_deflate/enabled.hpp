@@ -716,7 +716,7 @@ private:
                 m_server_max_window_bits = bits;
                 break;
             case mode::largest:
-                m_server_max_window_bits = min(bits,m_server_max_window_bits);
+                m_server_max_window_bits = std::min(bits,m_server_max_window_bits);
                 break;
             case mode::smallest:
                 m_server_max_window_bits = min_server_max_window_bits;
@@ -776,7 +776,7 @@ private:
                 m_client_max_window_bits = bits;
                 break;
             case mode::largest:
-                m_client_max_window_bits = min(bits,m_client_max_window_bits);
+                m_client_max_window_bits = std::min(bits,m_client_max_window_bits);
                 break;
             case mode::smallest:
                 m_client_max_window_bits = min_client_max_window_bits;
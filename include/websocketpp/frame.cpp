@@ -29,6 +29,7 @@
 #define WEBSOCKETPP_FRAME_HPP
 
 #include <algorithm>
+#include <cstring>
 #include <string>
 
 #include <system_error>
@@ -36,6 +37,12 @@
 
 #include <websocketpp/utilities.cpp>
 
+#include <websocketpp/common/cpu.hpp>
+
+#if defined(_WEBSOCKETPP_SIMD_) && !defined(_WEBSOCKETPP_NO_SIMD_MASKING_)
+    #define _WEBSOCKETPP_SIMD_MASKING_
+#endif
+
 /// Data structures and utility functions for manipulating WebSocket frames
 /**
  * namespace frame provides a number of data structures and utility functions
@@ -304,7 +311,7 @@ void byte_mask(input_iter b, input_iter e, output_iter o, masking_key_type
 template <typename iter_type>
 void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
     size_t key_offset = 0);
-void word_mask_exact(uint8_t * input, uint8_t * output, size_t length,
+void word_mask_exact(uint8_t const * input, uint8_t * output, size_t length,
     masking_key_type const & key);
 void word_mask_exact(uint8_t * data, size_t length, masking_key_type const &
     key);
@@ -677,15 +684,142 @@ void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
     byte_mask(b,e,b,key,key_offset);
 }
 
-/// Exact word aligned mask/unmask
+/// Masking kernels
 /**
- * Balanced combination of byte by byte and circular word by word masking.
- * Best used to mask complete messages at once. Has much higher setup costs than
- * word_mask_circ but works with exact sized buffers.
+ * A masking kernel computes output[i] = input[i] ^ key[i % 4] for a buffer,
+ * key holding the four bytes of the masking key in the order they apply.
+ * input and output may be the same buffer, nothing past length is touched.
  *
- * Buffer based word by word masking and unmasking for WebSocket payloads.
- * Masking is done in word by word chunks with the remainder not divisible by
- * the word size done byte by byte.
+ * get_mask_kernel() picks the widest kernel the CPU supports on first use.
+ */
+typedef void (*mask_kernel)(uint8_t const * input, uint8_t * output,
+    size_t length, uint32_t key);
+
+namespace simd {
+
+/// Mask the bytes of a tail, starting at key offset 0
+inline void mask_tail(uint8_t const * input, uint8_t * output, size_t length,
+    uint32_t key)
+{
+    uint8_t key_bytes[4];
+    std::memcpy(key_bytes, &key, 4);
+    for (size_t i = 0; i < length; ++i) {
+        output[i] = input[i] ^ key_bytes[i % 4];
+    }
+}
+
+/// Portable kernel, one machine word at a time
+inline void mask_scalar(uint8_t const * input, uint8_t * output, size_t length,
+    uint32_t key)
+{
+    uint8_t key_bytes[8];
+    std::memcpy(key_bytes, &key, 4);
+    std::memcpy(key_bytes + 4, &key, 4);
+    size_t word_key;
+    std::memcpy(&word_key, key_bytes, sizeof(size_t));
+
+    size_t i = 0;
+    for (; i + sizeof(size_t) <= length; i += sizeof(size_t)) {
+        size_t word;
+        std::memcpy(&word, input + i, sizeof(size_t));
+        word ^= word_key;
+        std::memcpy(output + i, &word, sizeof(size_t));
+    }
+    mask_tail(input + i, output + i, length - i, key);
+}
+
+#ifdef _WEBSOCKETPP_SIMD_MASKING_
+
+/// SSE2 kernel, 16 bytes at a time
+inline void mask_sse2(uint8_t const * input, uint8_t * output, size_t length,
+    uint32_t key)
+{
+    // x86 is little endian, the lanes hold the key bytes in memory order
+    __m128i const k = _mm_set1_epi32(static_cast<int>(key));
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input + i + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i + 48), _mm_xor_si128(d, k));
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_xor_si128(a, k));
+    }
+    mask_scalar(input + i, output + i, length - i, key);
+}
+
+/// AVX2 kernel, 32 bytes at a time
+_WEBSOCKETPP_TARGET_AVX2_
+inline void mask_avx2(uint8_t const * input, uint8_t * output, size_t length,
+    uint32_t key)
+{
+    __m256i const k = _mm256_set1_epi32(static_cast<int>(key));
+
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input + i + 96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i + 32), _mm256_xor_si256(b, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i + 64), _mm256_xor_si256(c, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i + 96), _mm256_xor_si256(d, k));
+    }
+    for (; i + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_xor_si256(a, k));
+    }
+    if (i + 16 <= length) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i),
+            _mm_xor_si128(a, _mm256_castsi256_si128(k)));
+        i += 16;
+    }
+    mask_scalar(input + i, output + i, length - i, key);
+}
+
+#endif // _WEBSOCKETPP_SIMD_MASKING_
+
+/// Pick the widest kernel the CPU supports
+inline mask_kernel select_mask_kernel() {
+#ifdef _WEBSOCKETPP_SIMD_MASKING_
+    if (cpu::has_avx2()) {
+        return &mask_avx2;
+    }
+    return &mask_sse2;
+#else
+    return &mask_scalar;
+#endif
+}
+
+} // namespace simd
+
+/// The masking kernel of this CPU, selected once
+inline mask_kernel get_mask_kernel() {
+    static mask_kernel const kernel = simd::select_mask_kernel();
+    return kernel;
+}
+
+/// The four key bytes a prepared key starts with, as a kernel takes them
+inline uint32_t get_prepared_key_bytes(size_t prepared_key) {
+    uint32_t key;
+    std::memcpy(&key, &prepared_key, 4);
+    return key;
+}
+
+/// Exact word aligned mask/unmask
+/**
+ * Best used to mask complete messages at once. Runs on the masking kernel of
+ * the CPU (AVX2, SSE2 or machine words), the remainder not divisible by its
+ * width done byte by byte.
  *
  * input and output must both be at least length bytes. Exactly length bytes
  * will be written.
@@ -698,21 +832,10 @@ void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
  *
  * @param key Masking key to use
  */
-inline void word_mask_exact(uint8_t* input, uint8_t* output, size_t length,
-    const masking_key_type& key)
+inline void word_mask_exact(uint8_t const * input, uint8_t* output,
+    size_t length, const masking_key_type& key)
 {
-    size_t prepared_key = prepare_masking_key(key);
-    size_t n = length/sizeof(size_t);
-    size_t* input_word = reinterpret_cast<size_t*>(input);
-    size_t* output_word = reinterpret_cast<size_t*>(output);
-
-    for (size_t i = 0; i < n; i++) {
-        output_word[i] = input_word[i] ^ prepared_key;
-    }
-
-    for (size_t i = n*sizeof(size_t); i < length; i++) {
-        output[i] = input[i] ^ key.c[i%4];
-    }
+    get_mask_kernel()(input, output, length, key.i);
 }
 
 /// Exact word aligned mask/unmask (in place)
@@ -737,24 +860,14 @@ inline void word_mask_exact(uint8_t* data, size_t length, const
 /**
  * Performs a circular mask/unmask in word sized chunks using pre-prepared keys
  * that store state between calls. Best for providing streaming masking or
- * unmasking of small chunks at a time of a larger message. Requires that the
- * underlying allocated size of the data buffer be a multiple of the word size.
- * Data in the buffer after `length` will be overwritten only with the same
- * values that were originally present.
- *
- * Buffer based word by word masking and unmasking for WebSocket payloads.
- * Performs masking in place using the supplied key. Casts the data buffer to
- * an array of size_t's and performs masking word by word. The underlying
- * buffer size must be a muliple of the word size.
+ * unmasking of small chunks at a time of a larger message. Runs on the masking
+ * kernel of the CPU, nothing after `length` is read or written.
  *
  * word_mask returns a copy of prepared_key circularly shifted based on the
  * length value. The returned value may be fed back into word_mask when more
  * data is available.
  *
- * input and output must both have length at least:
- *    ceil(length/sizeof(size_t))*sizeof(size_t)
- * Exactly that many bytes will be written, although only exactly length bytes
- * will be changed (trailing bytes will be replaced without masking)
+ * input and output must both be at least length bytes.
  *
  * @param data Character buffer to mask
  *
@@ -767,24 +880,10 @@ inline void word_mask_exact(uint8_t* data, size_t length, const
 inline size_t word_mask_circ(uint8_t * input, uint8_t * output, size_t length,
     size_t prepared_key)
 {
-    size_t n = length / sizeof(size_t); // whole words
-    size_t l = length - (n * sizeof(size_t)); // remaining bytes
-    size_t * input_word = reinterpret_cast<size_t *>(input);
-    size_t * output_word = reinterpret_cast<size_t *>(output);
-
-    // mask word by word
-    for (size_t i = 0; i < n; i++) {
-        output_word[i] = input_word[i] ^ prepared_key;
-    }
-
-    // mask partial word at the end
-    size_t start = length - l;
-    uint8_t * byte_key = reinterpret_cast<uint8_t *>(&prepared_key);
-    for (size_t i = 0; i < l; ++i) {
-        output[start+i] = input[start+i] ^ byte_key[i];
-    }
+    get_mask_kernel()(input, output, length,
+        get_prepared_key_bytes(prepared_key));
 
-    return circshift_prepared_key(prepared_key,l);
+    return circshift_prepared_key(prepared_key,length % sizeof(size_t));
 }
 
 /// Circular word aligned mask/unmask (in place)
@@ -829,12 +928,8 @@ inline size_t word_mask_circ(uint8_t* data, size_t length, size_t prepared_key){
 inline size_t byte_mask_circ(uint8_t * input, uint8_t * output, size_t length,
     size_t prepared_key)
 {
-    uint32_converter key;
-    key.i = prepared_key;
-
-    for (size_t i = 0; i < length; ++i) {
-        output[i] = input[i] ^ key.c[i % 4];
-    }
+    get_mask_kernel()(input, output, length,
+        get_prepared_key_bytes(prepared_key));
 
     return circshift_prepared_key(prepared_key,length % 4);
 }
@@ -25,203 +25,234 @@
  *
  */
 
-#ifndef WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
-#define WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+#ifndef WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
+#define WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
 
-#include <memory>
+#include <websocketpp/frame.cpp>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace message_buffer {
+namespace pool {
 
-/* # message:
- * object that stores a message while it is being sent or received. Contains
- * the message payload itself, the message header, the extension data, and the
- * opcode.
- *
- * # connection_message_manager:
- * An object that manages all of the message_buffers associated with a given
- * connection. Implements the get_message_buffer(size) method that returns
- * a message buffer at least size bytes long.
- *
- * Message buffers are reference counted with shared ownership semantics. Once
- * requested from the manager the requester and it's associated downstream code
- * may keep a pointer to the message indefinitely at a cost of extra resource
- * usage. Once the reference count drops to the point where the manager is the
- * only reference the messages is recycled using whatever method is implemented
- * in the manager.
- *
- * # endpoint_message_manager:
- * An object that manages connection_message_managers. Implements the
- * get_message_manager() method. This is used once by each connection to
- * request the message manager that they are supposed to use to manage message
- * buffers for their own use.
- *
- * TYPES OF CONNECTION_MESSAGE_MANAGERS
- * - allocate a message with the exact size every time one is requested
- * - maintain a pool of pre-allocated messages and return one when needed.
- *   Recycle previously used messages back into the pool
- *
- * TYPES OF ENDPOINT_MESSAGE_MANAGERS
- *  - allocate a new connection manager for each connection. Message pools
- *    become connection specific. This increases memory usage but improves
- *    concurrency.
- *  - allocate a single connection manager and share a pointer to it with all
- *    connections created by this endpoint. The message pool will be shared
- *    among all connections, improving memory usage and performance at the cost
- *    of reduced concurrency
- */
+/// Default limits of the message pools
+namespace limits {
+    /// Payload capacity of the smallest size class, as a power of two
+    static size_t const min_class_shift = 7;
 
-/// Custom deleter for use in shared_ptrs to message.
-/**
- * This is used to catch messages about to be deleted and offer the manager the
- * ability to recycle them instead. Message::recycle will return true if it was
- * successfully recycled and false otherwise. In the case of exceptions or error
- * this deleter frees the memory.
- */
-template <typename T>
-void message_deleter(T* msg) {
-    try {
-        if (!msg->recycle()) {
-            delete msg;
-        }
-    } catch (...) {
-        // TODO: is there a better way to ensure this function doesn't throw?
-        delete msg;
-    }
-}
+    /// Number of size classes, from 128 bytes to 64 KiB
+    static size_t const class_count = 10;
 
-/// Represents a buffer for a single WebSocket message.
+    /// Default cap on the payload bytes a connection keeps pooled
+    static size_t const max_pooled_bytes = 1024 * 1024;
+} // namespace limits
+
+/// A connection message manager that maintains a pool of messages that is
+/// used to fulfill get_message requests.
 /**
+ * The pool keeps ownership of every message it hands out. A message is free
+ * again once the pool holds the only reference to it, at which point it is
+ * reset and reused with the payload capacity it already has. Messages are
+ * sorted into size classes by the capacity they were created with, a request
+ * is served from the smallest class that fits it.
  *
+ * The payload bytes kept by the pool are capped. Requests larger than the
+ * largest class, requests made while the pool is at its cap and messages
+ * that grew past the largest class are served by plain allocations that are
+ * freed once released. Payload growth is accounted when a message is reused.
  *
+ * Messages are requested both by the connection's read path and by the
+ * threads that send, so the pool is locked. Releasing a message only drops
+ * its reference count and never touches the pool.
  */
-template <typename con_msg_manager>
-class message {
+template <typename message>
+class con_msg_manager
+  : public std::enable_shared_from_this<con_msg_manager<message> >
+{
 public:
-    typedef std::shared_ptr<message> ptr;
+    typedef con_msg_manager<message> type;
+    typedef std::shared_ptr<con_msg_manager> ptr;
+    typedef std::weak_ptr<con_msg_manager> weak_ptr;
 
-    typedef typename con_msg_manager::weak_ptr con_msg_man_ptr;
+    typedef typename message::ptr message_ptr;
 
-    message(con_msg_man_ptr manager, size_t size = 128)
-      : m_manager(manager)
-      , m_payload(size) {}
+    /// Construct a pool
+    /**
+     * @param max_bytes The most payload bytes the pool keeps.
+     */
+    explicit con_msg_manager(size_t max_bytes = limits::max_pooled_bytes)
+      : m_max_bytes(max_bytes)
+      , m_bytes(0) {}
 
-    frame::opcode::value get_opcode() const {
-        return m_opcode;
-    }
-    const std::string& get_header() const {
-        return m_header;
-    }
-    const std::string& get_extension_data() const {
-        return m_extension_data;
-    }
-    const std::string& get_payload() const {
-        return m_payload;
+    /// Get an empty message buffer
+    /**
+     * @return A shared pointer to an empty message from the smallest class
+     */
+    message_ptr get_message() {
+        return get_message(frame::opcode::text, 0);
     }
 
-    /// Recycle the message
+    /// Get a message buffer with specified size and opcode
     /**
-     * A request to recycle this message was received. Forward that request to
-     * the connection message manager for processing. Errors and exceptions
-     * from the manager's recycle member function should be passed back up the
-     * call chain. The caller to message::recycle will deal with them.
-     *
-     * Recycle must *only* be called by the message shared_ptr's destructor.
-     * Once recycled successfully, ownership of the memory has been passed to
-     * another system and must not be accessed again.
+     * @param op The opcode to use
+     * @param size Minimum size in bytes to request for the message payload.
      *
-     * @return true if the message was successfully recycled, false otherwise.
+     * @return A shared pointer to a message with at least the specified
+     * capacity.
      */
-    bool recycle() {
-        typename con_msg_manager::ptr shared = m_manager.lock();
-
-        if (shared) {
-            return shared->(recycle(this));
-        } else {
-            return false;
+    message_ptr get_message(frame::opcode::value op, size_t size) {
+        size_t c = class_of(size);
+        if (c == limits::class_count) {
+            return make_message(op, size);
         }
-    }
-private:
-    con_msg_man_ptr             m_manager;
 
-    frame::opcode::value        m_opcode;
-    std::string                 m_header;
-    std::string                 m_extension_data;
-    std::string                 m_payload;
-};
+        std::lock_guard<std::mutex> lock(m_lock);
 
-namespace alloc {
+        size_class & sc = m_classes[c];
+        size_t const n = sc.entries.size();
+        for (size_t k = 0; k < n; ++k) {
+            size_t i = (sc.next + k) % n;
+            entry & e = sc.entries[i];
+            if (e.msg.use_count() != 1) {
+                continue;
+            }
+            // the last user dropped its reference on another thread, see its
+            // writes to the message before reusing it
+            std::atomic_thread_fence(std::memory_order_acquire);
 
-/// A connection message manager that allocates a new message for each
-/// request.
-template <typename message>
-class con_msg_manager {
-public:
-    typedef std::shared_ptr<con_msg_manager> ptr;
-    typedef std::weak_ptr<con_msg_manager> weak_ptr;
+            message_ptr msg = e.msg;
+            reset(*msg, op);
 
-    typedef typename message::ptr message_ptr;
+            size_t capacity = msg->get_raw_payload().capacity();
+            m_bytes += capacity;
+            m_bytes -= e.bytes;
+            e.bytes = capacity;
 
-    /// Get a message buffer with specified size
-    /**
-     * @param size Minimum size in bytes to request for the message payload.
-     *
-     * @return A shared pointer to a new message with specified size.
-     */
-    message_ptr get_message(size_t size) const {
-        return std::make_shared<message>(size);
+            if (capacity > class_size(limits::class_count - 1)
+                || m_bytes > m_max_bytes)
+            {
+                // grown too large to keep, hand it out unpooled
+                m_bytes -= e.bytes;
+                e = sc.entries.back();
+                sc.entries.pop_back();
+                sc.next = 0;
+            } else {
+                sc.next = (i + 1) % n;
+            }
+            return msg;
+        }
+
+        size_t bytes = class_size(c);
+        if (m_bytes + bytes > m_max_bytes) {
+            return make_message(op, size);
+        }
+
+        message_ptr msg = make_message(op, bytes);
+        sc.entries.push_back(entry(msg, msg->get_raw_payload().capacity()));
+        m_bytes += sc.entries.back().bytes;
+        return msg;
     }
 
     /// Recycle a message
     /**
-     * This method shouldn't be called. If it is, return false to indicate an
-     * error. The rest of the method recycle chain should notice this and free
-     * the memory.
+     * The pool keeps a reference to the messages it owns, so they are reused
+     * by get_message rather than recycled through their deleter. This method
+     * shouldn't be called. If it is, return false to indicate an error. The
+     * rest of the method recycle chain should notice this and free the
+     * memory.
      *
      * @param msg The message to be recycled.
      *
      * @return true if the message was successfully recycled, false otherwse.
      */
-    bool recycle(message * msg) {
+    bool recycle(message *) {
         return false;
     }
+
+    /// Get the payload bytes currently kept by the pool
+    size_t get_pooled_bytes() const {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_bytes;
+    }
+private:
+    struct entry {
+        entry(message_ptr m, size_t b) : msg(m), bytes(b) {}
+
+        message_ptr msg;
+        size_t      bytes;
+    };
+
+    struct size_class {
+        size_class() : next(0) {}
+
+        std::vector<entry>  entries;
+        size_t              next;
+    };
+
+    /// Payload capacity of size class c
+    static size_t class_size(size_t c) {
+        return size_t(1) << (limits::min_class_shift + c);
+    }
+
+    /// Smallest size class that fits size, class_count if none does
+    static size_t class_of(size_t size) {
+        size_t c = 0;
+        while (c < limits::class_count && class_size(c) < size) {
+            ++c;
+        }
+        return c;
+    }
+
+    message_ptr make_message(frame::opcode::value op, size_t size) {
+        return std::make_shared<message>(type::shared_from_this(), op, size);
+    }
+
+    /// Put a message back in the state of a new one, keeping its buffers
+    static void reset(message & msg, frame::opcode::value op) {
+        msg.set_opcode(op);
+        msg.set_prepared(false);
+        msg.set_fin(true);
+        msg.set_terminal(false);
+        msg.set_compressed(false);
+        msg.set_header(std::string());
+        msg.get_raw_payload().clear();
+    }
+
+    mutable std::mutex  m_lock;
+    size_class          m_classes[limits::class_count];
+    size_t const        m_max_bytes;
+    size_t              m_bytes;
 };
 
-/// An endpoint message manager that allocates a new manager for each
-/// connection.
+/// An endpoint message manager that allocates a new pool for each connection.
 template <typename con_msg_manager>
 class endpoint_msg_manager {
 public:
     typedef typename con_msg_manager::ptr con_msg_man_ptr;
 
+    /// Construct an endpoint manager
+    /**
+     * @param max_bytes The most payload bytes each connection's pool keeps.
+     */
+    explicit endpoint_msg_manager(size_t max_bytes = limits::max_pooled_bytes)
+      : m_max_bytes(max_bytes) {}
+
     /// Get a pointer to a connection message manager
     /**
      * @return A pointer to the requested connection message manager.
      */
     con_msg_man_ptr get_manager() const {
-        return std::make_shared<con_msg_manager>();
+        return con_msg_man_ptr(std::make_shared<con_msg_manager>(m_max_bytes));
     }
-};
-
-} // namespace alloc
-
-namespace pool {
-
-/// A connection messages manager that maintains a pool of messages that is
-/// used to fulfill get_message requests.
-class con_msg_manager {
-
-};
-
-/// An endpoint manager that maintains a shared pool of connection managers
-/// and returns an appropriate one for the requesting connection.
-class endpoint_msg_manager {
-
+private:
+    size_t m_max_bytes;
 };
 
 } // namespace pool
-
 } // namespace message_buffer
 
-#endif // WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+#endif // WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
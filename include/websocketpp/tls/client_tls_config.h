@@ -18,7 +18,7 @@
 
 // Messages
 #include <websocketpp/message_buffer/message.hpp>
-#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/message_buffer/pool.hpp>
 
 // Loggers
 #include <websocketpp/logger.cpp>
@@ -69,9 +69,9 @@ struct client_tls_config{
     typedef http::parser::response response_type;
 
     // Message Policies
-    typedef message_buffer::message<message_buffer::alloc::con_msg_manager> message_type;
-    typedef message_buffer::alloc::con_msg_manager<message_type> con_msg_manager_type;
-    typedef message_buffer::alloc::endpoint_msg_manager<con_msg_manager_type> endpoint_msg_manager_type;
+    typedef message_buffer::message<message_buffer::pool::con_msg_manager> message_type;
+    typedef message_buffer::pool::con_msg_manager<message_type> con_msg_manager_type;
+    typedef message_buffer::pool::endpoint_msg_manager<con_msg_manager_type> endpoint_msg_manager_type;
 
     /// Logging policies
     typedef logger::basic<concurrency_type, logger::alevel> alog_type; 
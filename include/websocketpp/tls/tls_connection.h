@@ -119,6 +119,26 @@ public:
 		return 0;
 	}
 
+	/**
+	 * ----Modified----
+	 * The native socket of the connection, for a reader waiting on many connections at once.
+	 * ----------------
+	 */
+	hsocket get_socket() const {
+		return m_hsocket->get_socket();
+	}
+
+	/**
+	 * ----Modified----
+	 * Set how long a read waits for more data, see hsocket_tls::set_read_timeout.
+	 * ----------------
+	 *
+	 * @param ms The timeout in milliseconds.
+	 */
+	void set_read_timeout(long ms) {
+		m_hsocket->set_read_timeout(ms);
+	}
+
 	/**
 	 * ----Modified----
 	 * Not required.
@@ -0,0 +1,97 @@
+#include <bot_runtime.h>
+#include <algorithm>
+
+bot_runtime::bot_runtime(size_t reactors, size_t workers, size_t rest_connections, const std::string& host) :
+	m_host(host),
+	m_client(discord_bot::create_client()),
+	m_rest(host, rest_connections),
+	m_executor(workers),
+	m_stop(false)
+{
+	m_rest.open();
+	reactors = std::max<size_t>(reactors, 1);
+	for (size_t i = 0; i < reactors; i++) {
+		reactor* r = new reactor();
+		r->thread = std::thread(&bot_runtime::run, this, r);
+		m_reactors.push_back(r);
+	}
+}
+
+bot_runtime::~bot_runtime() {
+	stop();
+	for (reactor* r : m_reactors) {
+		if (r->thread.joinable()) r->thread.join();
+		delete r;
+	}
+	delete m_client;
+}
+
+void bot_runtime::add(discord_bot& bot) {
+	//The handshake and HELLO are read with the default timeout, the reactor then reads without waiting.
+	//IDENTIFY is only scheduled here, the reactor sends it once its slot is reached
+	bot.start();
+	bot.set_read_timeout(READ_TIMEOUT_MS);
+
+	reactor* target = nullptr;
+	for (reactor* r : m_reactors) {
+		std::lock_guard<std::mutex> guard(r->lock);
+		if (r->bots.size() >= FD_SETSIZE) continue;
+		if (target == nullptr || r->bots.size() < target->bots.size()) target = r;
+	}
+	if (target == nullptr) {
+		bot.log(NAME + " Every reactor of the runtime is full");
+		return;
+	}
+	std::lock_guard<std::mutex> guard(target->lock);
+	target->bots.push_back(&bot);
+}
+
+void bot_runtime::remove(discord_bot& bot) {
+	for (reactor* r : m_reactors) {
+		{
+			std::lock_guard<std::mutex> guard(r->lock);
+			std::vector<discord_bot*>::iterator it = std::remove(r->bots.begin(), r->bots.end(), &bot);
+			if (it == r->bots.end()) continue;
+			r->bots.erase(it, r->bots.end());
+		}
+		//The current round may still poll bot from its copy
+		std::lock_guard<std::mutex> polling(r->poll_lock);
+	}
+}
+
+void bot_runtime::join() {
+	for (reactor* r : m_reactors) {
+		if (r->thread.joinable()) r->thread.join();
+	}
+}
+
+void bot_runtime::stop() {
+	m_stop = true;
+}
+
+void bot_runtime::run(reactor* r) {
+	timeval timeout;
+	fd_set readable;
+
+	while (!m_stop) {
+		std::unique_lock<std::mutex> polling(r->poll_lock);
+		{
+			//add() and remove() only wait for the copy, not for select() and the polls
+			std::lock_guard<std::mutex> guard(r->lock);
+			r->polled.assign(r->bots.begin(), r->bots.end());
+		}
+		if (r->polled.empty()) {
+			polling.unlock();
+			std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+			continue;
+		}
+
+		FD_ZERO(&readable);
+		for (discord_bot* bot : r->polled) FD_SET(bot->get_socket(), &readable);
+		timeout.tv_sec = 0;
+		timeout.tv_usec = POLL_INTERVAL_MS * 1000;
+		wait(&readable, nullptr, nullptr, &timeout);
+
+		for (discord_bot* bot : r->polled) bot->poll(FD_ISSET(bot->get_socket(), &readable) != 0);
+	}
+}
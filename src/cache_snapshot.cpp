@@ -0,0 +1,366 @@
+#include <cache_snapshot.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	const char MAGIC[8] = { 'S', 'S', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+	static_assert(sizeof(cache_snapshot::header) % 8 == 0, "snapshot records must keep 8 byte alignment");
+	static_assert(sizeof(cache_snapshot::guild_record) % 8 == 0, "snapshot records must keep 8 byte alignment");
+	static_assert(sizeof(cache_snapshot::channel_record) % 8 == 0, "snapshot records must keep 8 byte alignment");
+	static_assert(sizeof(cache_snapshot::overwrite_record) % 8 == 0, "snapshot records must keep 8 byte alignment");
+	static_assert(sizeof(cache_snapshot::role_record) % 8 == 0, "snapshot records must keep 8 byte alignment");
+	static_assert(sizeof(cache_snapshot::member_record) % 8 == 0, "snapshot records must keep 8 byte alignment");
+
+	/*
+	 * Builds the sections in memory before they are written out in one go.
+	 */
+	struct snapshot_builder {
+		std::vector<cache_snapshot::guild_record>		guilds;
+		std::vector<cache_snapshot::channel_record>		channels;
+		std::vector<cache_snapshot::overwrite_record>	overwrites;
+		std::vector<cache_snapshot::role_record>		roles;
+		std::vector<cache_snapshot::member_record>		members;
+		std::vector<uint64_t>							member_roles;
+		std::string										strings;
+		std::unordered_map<std::string, cache_snapshot::string_ref> pooled;
+
+		//Names and avatars repeat across guilds, each distinct string is written once
+		cache_snapshot::string_ref add(std::string_view s) {
+			if (s.empty()) return cache_snapshot::string_ref{ 0, 0 };
+			auto it = pooled.find(std::string(s));
+			if (it != pooled.end()) return it->second;
+			cache_snapshot::string_ref r = { static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size()) };
+			strings.append(s.data(), s.size());
+			pooled.emplace(std::string(s), r);
+			return r;
+		}
+	};
+
+	template<class T> cache_snapshot::section place(uint64_t& offset, const std::vector<T>& v) {
+		cache_snapshot::section s = { offset, v.size() };
+		offset += v.size() * sizeof(T);
+		return s;
+	}
+
+	template<class T> bool write_all(FILE* f, const std::vector<T>& v) {
+		return v.empty() || std::fwrite(v.data(), sizeof(T), v.size(), f) == v.size();
+	}
+
+}
+
+cache_snapshot::cache_snapshot() :
+	m_data(nullptr),
+	m_size(0),
+	m_mapping(nullptr)
+{}
+
+cache_snapshot::~cache_snapshot() {
+	close();
+}
+
+bool cache_snapshot::save(const std::string& path, const entity_cache* cache, const std::string& session_id, int sequence, int shard_id, int shard_count) {
+	snapshot_builder b;
+	header h = {};
+	std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = VERSION;
+	h.header_size = sizeof(header);
+	h.shard_id = shard_id;
+	h.shard_count = shard_count;
+	h.sequence = sequence;
+	h.created = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	h.session_id = b.add(session_id);
+
+	if (cache != nullptr) {
+		std::shared_lock<std::shared_mutex> lock(cache->m_lock);
+		rcu::read_guard guard;
+		b.guilds.reserve(cache->m_guilds.size());
+		cache->m_guilds.for_each([&b](snowflake id, const cached_guild& g) {
+			b.guilds.push_back(guild_record{ id.value(), g.owner_id.value(), g.member_count, b.add(g.name), 0 });
+		});
+		b.channels.reserve(cache->m_channels.size());
+		cache->m_channels.for_each([&b](snowflake id, const cached_channel& c) {
+			channel_record r = { id.value(), c.guild_id.value(), c.parent_id.value(), c.position, c.type, static_cast<uint32_t>(b.overwrites.size()), static_cast<uint32_t>(c.overwrites.size()), b.add(c.name) };
+			for (const permission_overwrite& o : c.overwrites) b.overwrites.push_back(overwrite_record{ o.id.value(), o.allow, o.deny, static_cast<uint32_t>(o.type), 0 });
+			b.channels.push_back(r);
+		});
+		b.roles.reserve(cache->m_roles.size());
+		cache->m_roles.for_each([&b](snowflake id, const cached_role& r) {
+			b.roles.push_back(role_record{ id.value(), r.guild_id.value(), r.permissions, r.color, r.position, b.add(r.name) });
+		});
+		b.members.reserve(cache->m_members.size());
+		cache->m_members.for_each([&b](snowflake guild_id, const member_view& m) {
+			member_record r = {};
+			r.guild_id = guild_id.value();
+			r.user_id = m.user_id.value();
+			r.username = b.add(m.username);
+			r.nick = b.add(m.nick);
+			r.avatar = b.add(m.avatar);
+			r.first_role = static_cast<uint32_t>(b.member_roles.size());
+			r.role_count = static_cast<uint32_t>(m.role_count);
+			r.discriminator = m.discriminator;
+			r.bot = m.bot;
+			for (size_t i = 0; i < m.role_count; i++) b.member_roles.push_back(m.roles[i].value());
+			b.members.push_back(r);
+		});
+	}
+
+	uint64_t offset = sizeof(header);
+	h.guilds = place(offset, b.guilds);
+	h.channels = place(offset, b.channels);
+	h.overwrites = place(offset, b.overwrites);
+	h.roles = place(offset, b.roles);
+	h.members = place(offset, b.members);
+	h.member_roles = place(offset, b.member_roles);
+	h.strings = section{ offset, b.strings.size() };
+
+	std::string tmp = path + ".tmp";
+	FILE* f = std::fopen(tmp.c_str(), "wb");
+	if (f == nullptr) return false;
+	bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1
+		&& write_all(f, b.guilds) && write_all(f, b.channels) && write_all(f, b.overwrites)
+		&& write_all(f, b.roles) && write_all(f, b.members) && write_all(f, b.member_roles)
+		&& (b.strings.empty() || std::fwrite(b.strings.data(), 1, b.strings.size(), f) == b.strings.size());
+	ok = std::fclose(f) == 0 && ok;
+	if (!ok) {
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	return MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(tmp.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool cache_snapshot::open(const std::string& path, int shard_id, int shard_count) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(header))) {
+		CloseHandle(file);
+		return false;
+	}
+	//The view keeps the mapping and the file open, both handles can go
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return false;
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == NULL) return false;
+	m_mapping = view;
+	m_size = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(header))) {
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED) return false;
+	m_mapping = view;
+	m_size = static_cast<size_t>(st.st_size);
+#endif
+
+	m_data = static_cast<const char*>(m_mapping);
+	if (!validate(shard_id, shard_count)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void cache_snapshot::close() {
+	if (m_mapping == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_mapping);
+#else
+	munmap(m_mapping, m_size);
+#endif
+	m_mapping = nullptr;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void cache_snapshot::load(entity_cache& cache) const {
+	if (!is_open()) return;
+	const header& h = get_header();
+	std::unique_lock<std::shared_mutex> lock(cache.m_lock);
+
+	cache.m_guilds.clear();
+	cache.m_channels.clear();
+	cache.m_roles.clear();
+	cache.m_members.clear();
+	cache.m_guilds.reserve(h.guilds.count);
+	cache.m_channels.reserve(h.channels.count);
+	cache.m_roles.reserve(h.roles.count);
+
+	//Guilds are completed with their channel and role lists before they are published
+	flat_map<snowflake, cached_guild> staged;
+	staged.reserve(h.guilds.count);
+	const guild_record* guilds = records<guild_record>(h.guilds);
+	for (uint64_t i = 0; i < h.guilds.count; i++) {
+		if (guilds[i].id == 0) continue;
+		cached_guild& g = staged[snowflake(guilds[i].id)];
+		g.id = snowflake(guilds[i].id);
+		g.owner_id = snowflake(guilds[i].owner_id);
+		g.member_count = guilds[i].member_count;
+		g.name = get_string(guilds[i].name);
+	}
+
+	const channel_record* channels = records<channel_record>(h.channels);
+	const overwrite_record* overwrites = records<overwrite_record>(h.overwrites);
+	for (uint64_t i = 0; i < h.channels.count; i++) {
+		const channel_record& r = channels[i];
+		cached_channel c;
+		c.id = snowflake(r.id);
+		c.guild_id = snowflake(r.guild_id);
+		c.parent_id = snowflake(r.parent_id);
+		c.position = r.position;
+		c.type = static_cast<uint8_t>(r.type);
+		c.name = get_string(r.name);
+		c.overwrites.resize(r.overwrite_count);
+		for (uint32_t j = 0; j < r.overwrite_count; j++) {
+			const overwrite_record& o = overwrites[r.first_overwrite + j];
+			c.overwrites[j] = permission_overwrite{ snowflake(o.id), o.allow, o.deny, o.type == permission_overwrite::MEMBER ? permission_overwrite::MEMBER : permission_overwrite::ROLE };
+		}
+		if (cached_guild* g = staged.find(c.guild_id)) g->channels.push_back(c.id);
+		cache.m_channels.assign(snowflake(r.id), std::move(c));
+	}
+
+	const role_record* roles = records<role_record>(h.roles);
+	for (uint64_t i = 0; i < h.roles.count; i++) {
+		const role_record& r = roles[i];
+		cached_role role;
+		role.id = snowflake(r.id);
+		role.guild_id = snowflake(r.guild_id);
+		role.permissions = r.permissions;
+		role.color = r.color;
+		role.position = r.position;
+		role.name = get_string(r.name);
+		if (cached_guild* g = staged.find(role.guild_id)) g->roles.push_back(role.id);
+		cache.m_roles.assign(snowflake(r.id), std::move(role));
+	}
+	staged.for_each([&cache](snowflake id, cached_guild& g) {
+		cache.m_guilds.assign(id, std::move(g));
+	});
+
+	//Ids in the file are plain 64 bit values, the same layout as snowflake
+	static_assert(sizeof(snowflake) == sizeof(uint64_t), "snowflake must be a plain 64 bit value");
+	const member_record* members = records<member_record>(h.members);
+	const snowflake* member_roles = records<snowflake>(h.member_roles);
+	for (uint64_t i = 0; i < h.members.count; i++) {
+		const member_record& r = members[i];
+		member_view m;
+		m.user_id = snowflake(r.user_id);
+		m.username = get_string(r.username);
+		m.nick = get_string(r.nick);
+		m.avatar = get_string(r.avatar);
+		m.roles = member_roles + r.first_role;
+		m.role_count = r.role_count;
+		m.discriminator = r.discriminator;
+		m.bot = r.bot != 0;
+		cache.m_members.restore(snowflake(r.guild_id), m);
+	}
+	cache.m_permissions.clear();
+	rcu::reclaim();
+}
+
+std::string_view cache_snapshot::get_string(string_ref r) const {
+	const section& pool = get_header().strings;
+	if (static_cast<uint64_t>(r.offset) + r.length > pool.count) return std::string_view();
+	return std::string_view(m_data + pool.offset + r.offset, r.length);
+}
+
+bool cache_snapshot::validate(int shard_id, int shard_count) const {
+	const header& h = get_header();
+	if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION || h.header_size != sizeof(header)) return false;
+	if (h.shard_id != shard_id || h.shard_count != shard_count) return false;
+
+	auto fits = [this](const section& s, size_t record_size) {
+		return s.offset % 8 == 0 && s.offset <= m_size && s.count <= (m_size - s.offset) / record_size;
+	};
+	if (!fits(h.guilds, sizeof(guild_record)) || !fits(h.channels, sizeof(channel_record)) || !fits(h.overwrites, sizeof(overwrite_record))
+		|| !fits(h.roles, sizeof(role_record)) || !fits(h.members, sizeof(member_record)) || !fits(h.member_roles, sizeof(uint64_t))) return false;
+	if (h.strings.offset > m_size || h.strings.count > m_size - h.strings.offset) return false;
+
+	//Cross references are checked once here so that load can follow them blindly
+	const channel_record* channels = records<channel_record>(h.channels);
+	for (uint64_t i = 0; i < h.channels.count; i++) {
+		if (static_cast<uint64_t>(channels[i].first_overwrite) + channels[i].overwrite_count > h.overwrites.count) return false;
+	}
+	const member_record* members = records<member_record>(h.members);
+	for (uint64_t i = 0; i < h.members.count; i++) {
+		if (static_cast<uint64_t>(members[i].first_role) + members[i].role_count > h.member_roles.count) return false;
+	}
+	return true;
+}
+
+applied_sequence::applied_sequence() :
+	m_applied(0)
+{}
+
+void applied_sequence::start(int sequence) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_pending.push_back(pending{ sequence, false });
+}
+
+void applied_sequence::skip(int sequence) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_pending.empty()) {
+		m_applied = sequence;
+		return;
+	}
+	m_pending.push_back(pending{ sequence, true });
+}
+
+void applied_sequence::finish(int sequence) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	//Events usually finish close to the order they started in
+	for (pending& p : m_pending) {
+		if (p.sequence != sequence) continue;
+		p.finished = true;
+		advance();
+		return;
+	}
+}
+
+void applied_sequence::reset(int sequence) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_pending.clear();
+	m_applied = sequence;
+}
+
+int applied_sequence::get() const {
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_applied;
+}
+
+void applied_sequence::advance() {
+	while (!m_pending.empty() && m_pending.front().finished) {
+		m_applied = m_pending.front().sequence;
+		m_pending.pop_front();
+	}
+}
+
@@ -1,45 +1,90 @@
 #define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
 
 #include <discord_bot.h>
+#include <bot_runtime.h>
+#include <algorithm>
 
 
-discord_bot::discord_bot(std::string h, std::string t) :
+discord_bot::discord_bot(std::string h, std::string t, int shard_id, int shard_count) :
 	m_host(h),
 	m_token(t),
+	m_shard_id(shard_id),
+	m_shard_count(shard_count),
 	m_ws_route("/?v=6&encoding=json&compress=zlib-stream"),
-	m_rest(new rest()),
+	m_encoding(gateway_encoding::JSON),
+	m_identify_pending(false),
+	m_runtime(nullptr),
+	m_rest(new rest_pool()),
+	m_executor(nullptr),
+	m_worker_count(std::max(1u, std::thread::hardware_concurrency())),
+	m_client(create_client()),
 	m_on_open(nullptr),
 	m_on_message(nullptr),
 	m_on_close(nullptr),
-	m_initialized(false),
-	m_heartbeat(opcode::gateway::heartbeat),
+	m_state(CONNECTING),
+	m_has_filter(false),
+	m_cache(nullptr),
+	m_messages(nullptr),
+	m_nonce(0),
+	m_member_intent(false),
 	m_heartbeat_interval(0),
 	m_sequence(0),
+	m_presence_version(0),
 	m_rest_route("/api")
 {
 	m_rest->open();
-	m_gateway = m_rest->send(REST_GET, m_rest_route + "/gateway/bot", "Connection: keep-alive\nAuthorization: Bot " + m_token)["data"];
-	if (!m_gateway.count("url")) {
-		m_client->get_alog().write(logger::alevel::app, NAME + " Failed to request gateway...");
-		exit(EXIT_FAILURE);
-	}
-	
-	std::error_code ec;
-	m_client = new dclient_type();
-	m_client->set_open_handler(&on_open_forwarder);
-	m_client->set_message_handler(std::bind(&on_message_forwarder, m_client, std::placeholders::_1, std::placeholders::_2));
-	m_client->set_close_handler(&on_close_forwarder);
-	m_client->set_secure(true);
-	m_client->set_user_agent("Abby/1");
-
-	m_on_message = std::bind(&discord_bot::on_hello, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+	init_templates();
+	init_connection();
+}
 
-	m_connection = m_client->get_connection(m_gateway["url"].get<std::string>() + m_ws_route, ec);
-	m_hdl = m_connection->get_handle();
-	hdl_map[m_hdl.lock().get()] = this;
+discord_bot::discord_bot(bot_runtime& runtime, std::string t, int shard_id, int shard_count) :
+	m_host(runtime.get_host()),
+	m_token(t),
+	m_shard_id(shard_id),
+	m_shard_count(shard_count),
+	m_ws_route("/?v=6&encoding=json&compress=zlib-stream"),
+	m_encoding(gateway_encoding::JSON),
+	m_identify_pending(false),
+	m_runtime(&runtime),
+	m_rest(&runtime.get_rest()),
+	m_executor(&runtime.get_executor()),
+	m_worker_count(0),
+	m_client(runtime.get_client()),
+	m_on_open(nullptr),
+	m_on_message(nullptr),
+	m_on_close(nullptr),
+	m_state(CONNECTING),
+	m_has_filter(false),
+	m_cache(nullptr),
+	m_messages(nullptr),
+	m_nonce(0),
+	m_member_intent(false),
+	m_heartbeat_interval(0),
+	m_sequence(0),
+	m_presence_version(0),
+	m_rest_route("/api")
+{
+	init_templates();
+	init_connection();
 }
 
 discord_bot::~discord_bot() {
+	if (m_runtime != nullptr) m_runtime->remove(*this);
+	{
+		std::lock_guard<std::mutex> guard(hdl_map_lock);
+		hdl_map.erase(m_hdl.lock().get());
+	}
+	//Queued dispatches update the caches and use this bot, the workers may be shared with
+	//other bots: drop those of this bot and wait for the running ones before anything goes
+	if (m_executor != nullptr) m_executor->drain(m_tasks);
+	if (m_runtime == nullptr) {
+		delete m_executor;
+		m_executor = nullptr;
+	}
+	delete m_cache;
+	delete m_messages;
+	//A bot of a runtime only borrows the client, the workers and the REST connections
+	if (m_runtime != nullptr) return;
 	delete m_rest;
 	delete m_client;
 }
@@ -47,66 +92,152 @@ discord_bot::~discord_bot() {
 //Public methods
 
 discord_bot& discord_bot::listen() {
+	start();
+	while (true) poll(true);
+	return *this;
+}
 
-	m_client->connect(m_connection);
-	m_client->resume_reading(m_hdl);
+discord_bot& discord_bot::on_open(on_open_handler func) {
+	m_on_open = func;
+	return *this;
+}
 
-	m_client->get_alog().write(logger::alevel::app, NAME + " Sending IDENTIFY payload");
+discord_bot& discord_bot::on_message(on_message_handler func) {
+	m_on_message = func;
+	return *this;
+}
 
-	payload p = event_payload::identify;
-	p.set_data_key<std::string>("token", m_token);
-	p.set_data_key<int>("intents", intent::GUILD_MESSAGES);
-	p.set_data_key<int>(std::vector<std::string>({ "presence", "game", "created_at" }), std::chrono::seconds(std::time(0)).count());
+bool discord_bot::is_subscribed(event::type e) const {
+	if (m_on_message != nullptr) return true;
+	return e != event::UNKNOWN && (m_handlers[e] != nullptr || m_raw_handlers[e] != nullptr);
+}
 
-	std::string identify = p.get_gateway_payload();
-	m_client->send(m_hdl, identify, frame::opcode::text);
-	m_client->resume_reading(m_hdl);
+discord_bot& discord_bot::on_close(on_close_handler func) {
+	m_on_close = func;
+	return *this;
+}
+
+discord_bot& discord_bot::set_worker_count(size_t threads) {
+	m_worker_count = threads;
+	return *this;
+}
+
+event_executor::stats discord_bot::get_worker_stats() const {
+	if (m_executor == nullptr) return event_executor::stats();
+	return m_executor->get_stats();
+}
 
-	while (true) {
-		auto interval = std::chrono::duration_cast<milliseconds>(h_clock::now() - m_timepoint);
-		if (interval >= m_heartbeat_interval) send_heartbeat();
-		m_client->resume_reading(m_hdl);
+discord_bot& discord_bot::set_event_filter(const event_filter& filter) {
+	m_filter = filter;
+	m_has_filter = true;
+	for (int e = 0; e < event::UNKNOWN; e++) {
+		if (is_internal(static_cast<event::type>(e))) m_filter.keep(static_cast<event::type>(e));
 	}
 	return *this;
 }
 
-discord_bot& discord_bot::on_open(on_open_handler func) {
-	m_on_open = func;
+discord_bot& discord_bot::set_encoding(gateway_encoding::type e) {
+	m_encoding = e;
+	m_ws_route = e == gateway_encoding::ETF ? "/?v=6&encoding=etf&compress=zlib-stream" : "/?v=6&encoding=json&compress=zlib-stream";
+	m_connection->set_uri(std::make_shared<uri>(m_gateway["url"].get<std::string>() + m_ws_route));
 	return *this;
 }
 
-discord_bot& discord_bot::on_message(on_message_handler func) {
-	if (!m_initialized) m_on_message_orig = func;
-	else m_on_message = func;
+discord_bot& discord_bot::enable_cache(size_t member_memory_limit) {
+	if (m_cache == nullptr) m_cache = new entity_cache();
+	m_cache->set_member_memory_limit(member_memory_limit);
 	return *this;
 }
 
-discord_bot& discord_bot::on_close(on_close_handler func) {
-	m_on_close = func;
+const entity_cache* discord_bot::get_cache() const {
+	return m_cache;
+}
+
+discord_bot& discord_bot::enable_message_cache(size_t memory_budget, uint32_t messages_per_channel) {
+	if (m_messages == nullptr) m_messages = new message_cache(memory_budget, messages_per_channel);
+	return *this;
+}
+
+const message_cache* discord_bot::get_message_cache() const {
+	return m_messages;
+}
+
+discord_bot& discord_bot::set_snapshot_path(std::string path) {
+	m_snapshot_path = path;
 	return *this;
 }
 
-discord_bot& discord_bot::set_bot_status(int, std::string) {
+bool discord_bot::save_snapshot() {
+	if (m_snapshot_path.empty()) return false;
+	std::string session_id;
+	{
+		std::lock_guard<std::mutex> guard(m_session_lock);
+		session_id = m_session_id;
+	}
+	//Events received but still queued for the workers are not in the cache, RESUME replays them
+	return cache_snapshot::save(m_snapshot_path, m_cache, session_id, m_applied.get(), m_shard_id, m_shard_count);
+}
+
+discord_bot& discord_bot::set_bot_status(int type, std::string name, std::string status) {
+	payload p = event_payload::presence;
+	p.set_data_key<nlohmann::json>("game", nlohmann::json({ {"name", name}, {"type", type} }));
+	p.set_data_key<std::string>("status", status);
+	m_shard_group->presence.set(p.get_gateway_json());
 	return *this;
 }
 
 
 	//p.set_data_key<std::u16string>("content", std::u16string(msg.begin(), msg.end()));
 
-discord_bot& discord_bot::create_message(std::string msg, std::string channel_id) {
-	payload p = event_payload::message;
-	p.set_data_key<std::string>("content", msg);
+discord_bot& discord_bot::create_message(std::string msg, snowflake channel_id) {
+	nlohmann::json body = event_payload::message.get_data();
+	body["content"] = msg;
 
-	payload h = event_payload::message_headers;
-	h.set_data_key<std::string>("Authorization", "Bot " + m_token);
-	h.set_data_key<int>("Content-Length", p.get_data().dump().size());
+	request_builder request(event_payload::message_headers.get_data());
+	request.header("Authorization", "Bot " + m_token).body(body);
 
-	std::string route = m_rest_route + "/channels/" + channel_id + "/messages";
+	std::string route;
+	route.reserve(m_rest_route.size() + snowflake::MAX_DIGITS + 20);
+	route += m_rest_route;
+	route += "/channels/";
+	channel_id.append_to(route);
+	route += "/messages";
 
-	nlohmann::json response = m_rest->send(REST_POST, route, h.get_data(), p.get_data());
+	nlohmann::json response = m_rest->send(REST_POST, route, request.get_headers(), request.get_body());
 	return *this;
 }
 
+discord_bot& discord_bot::enable_member_requests() {
+	m_member_intent = true;
+	return *this;
+}
+
+std::future<member_list> discord_bot::request_guild_members(snowflake guild_id, const std::string& query, int limit, member_request::chunk_handler on_chunk) {
+	std::shared_ptr<member_request> request = std::make_shared<member_request>(on_chunk);
+	std::future<member_list> members = request->get_future();
+
+	//The gateway would never answer, the request would wait forever
+	if (query.empty() && (get_intents() & intent::GUILD_MEMBERS) == 0) {
+		request->fail("Requesting every member of a guild needs the GUILD_MEMBERS intent, see enable_member_requests()");
+		return members;
+	}
+
+	std::string nonce;
+	{
+		std::lock_guard<std::mutex> guard(m_member_requests_lock);
+		nonce = std::to_string(++m_nonce);
+		m_member_requests[nonce] = request;
+	}
+
+	typed_payload<payload_schema::request_guild_members> p;
+	p.set<payload_field::guild_id>(guild_id)
+		.set<payload_field::query>(query)
+		.set<payload_field::limit>(limit)
+		.set<payload_field::nonce>(nonce);
+	send_payload(p);
+	return members;
+}
+
 discord_bot& discord_bot::log(std::string msg) {
 	m_client->get_alog().write(logger::alevel::app, msg);
 	return *this;
@@ -120,25 +251,186 @@ const std::string& discord_bot::get_token() const {
 
 void discord_bot::on_hello(int e, std::string e_name, const nlohmann::json& data) {
 	m_heartbeat_interval = milliseconds(data["heartbeat_interval"].get<unsigned int>());
-	m_on_message = std::bind(&discord_bot::on_identify, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
 	m_timepoint = h_clock::now();
+	//A session loaded from a snapshot is resumed, the gateway then replays the missed events
+	if (m_state == RESUMING) {
+		send_resume();
+		return;
+	}
+	m_state = IDENTIFYING;
+	schedule_identify();
 }
 
 void discord_bot::on_identify(int e, std::string e_name, const nlohmann::json& data) {
-	m_initialized = true;
-	m_session_id = data["session_id"];
-	m_on_message = m_on_message_orig;
+	if (e != opcode::gateway::dispatch || e_name != "READY") return;
+	{
+		std::lock_guard<std::mutex> guard(m_session_lock);
+		m_session_id = data["session_id"];
+	}
+	m_state = READY;
 }
 
 //Private methods
 
+void discord_bot::init_connection() {
+	{
+		//Only the first shard of a token requests the gateway, the others wait for its response
+		std::lock_guard<std::mutex> guard(shard_map_lock);
+		if (!shard_map.count(m_token)) {
+			nlohmann::json gateway = m_rest->send(REST_GET, m_rest_route + "/gateway/bot", "Connection: keep-alive\nAuthorization: Bot " + m_token)["data"];
+			if (!gateway.count("url")) {
+				std::cerr << NAME << " Failed to request gateway...\n";
+				exit(EXIT_FAILURE);
+			}
+			shard_map[m_token] = new shard_group{ gateway, new identify_scheduler(gateway["session_start_limit"]) };
+		}
+		m_shard_group = shard_map.at(m_token);
+		m_gateway = m_shard_group->gateway;
+	}
+
+	std::error_code ec;
+	m_connection = m_client->get_connection(m_gateway["url"].get<std::string>() + m_ws_route, ec);
+	m_hdl = m_connection->get_handle();
+	std::lock_guard<std::mutex> guard(hdl_map_lock);
+	hdl_map[m_hdl.lock().get()] = this;
+}
+
+void discord_bot::init_templates() {
+	m_heartbeat = gateway_templates::heartbeat();
+	m_identify = gateway_templates::identify(m_shard_count > 0);
+}
+
+dclient discord_bot::create_client() {
+	dclient c = new dclient_type();
+	c->set_open_handler(&on_open_forwarder);
+	c->set_message_handler(std::bind(&on_message_forwarder, c, std::placeholders::_1, std::placeholders::_2));
+	c->set_close_handler(&on_close_forwarder);
+	c->set_secure(true);
+	c->set_user_agent("Abby/1");
+	return c;
+}
+
+void discord_bot::start() {
+
+	if (m_executor == nullptr) m_executor = new event_executor(m_worker_count);
+	for (int e = 0; e < event::UNKNOWN; e++) {
+		event::type t = static_cast<event::type>(e);
+		if (is_internal(t)) m_filter.keep(t);
+		else if (!m_has_filter && !is_subscribed(t)) m_filter.drop(t);
+	}
+
+	if (!m_snapshot_path.empty()) {
+		cache_snapshot snapshot;
+		if (snapshot.open(m_snapshot_path, m_shard_id, m_shard_count)) {
+			if (m_cache != nullptr) snapshot.load(*m_cache);
+			std::lock_guard<std::mutex> guard(m_session_lock);
+			m_session_id = std::string(snapshot.get_session_id());
+			m_sequence = snapshot.get_sequence();
+			m_applied.reset(snapshot.get_sequence());
+		}
+	}
+	//Decided before HELLO can be read
+	m_state = !m_session_id.empty() && m_sequence.load() != 0 ? RESUMING : CONNECTING;
+
+	m_client->connect(m_connection);
+	m_client->resume_reading(m_hdl);
+	flush_outbound();
+}
+
+void discord_bot::schedule_identify() {
+	//The connection keeps being polled and heartbeating until the slot is reached
+	m_identify_at = m_shard_group->scheduler->reserve_slot(m_shard_id);
+	m_identify_pending = true;
+}
+
+void discord_bot::send_identify() {
+	m_identify_pending = false;
+	m_client->get_alog().write(logger::alevel::app, NAME + " Sending IDENTIFY payload");
+
+	m_identify.set(gateway_templates::IDENTIFY_TOKEN, m_token);
+	m_identify.set(gateway_templates::IDENTIFY_INTENTS, get_intents());
+	m_identify.set(gateway_templates::IDENTIFY_CREATED_AT, static_cast<int64_t>(std::time(0)));
+	if (m_shard_count > 0) m_identify.set_raw(gateway_templates::IDENTIFY_SHARD, "[" + std::to_string(m_shard_id) + "," + std::to_string(m_shard_count) + "]");
+
+	send_payload(m_identify, gateway_queue::HIGH);
+}
+
+void discord_bot::send_resume() {
+	m_client->get_alog().write(logger::alevel::app, NAME + " Sending RESUME payload");
+
+	typed_payload<payload_schema::resume> p;
+	p.set<payload_field::token>(m_token)
+		.set<payload_field::session_id>(m_session_id)
+		.set<payload_field::seq>(m_sequence.load());
+	send_payload(p);
+}
+
+void discord_bot::poll(bool readable) {
+	//No heartbeat before HELLO gave the interval
+	auto interval = std::chrono::duration_cast<milliseconds>(h_clock::now() - m_timepoint);
+	if (m_heartbeat_interval.count() > 0 && interval >= m_heartbeat_interval) send_heartbeat();
+	if (m_identify_pending && identify_scheduler::clock::now() >= m_identify_at) send_identify();
+	expire_member_requests();
+	if (m_state == READY) flush_presence();
+	flush_outbound();
+	if (readable) m_client->resume_reading(m_hdl);
+}
+
+hsocket discord_bot::get_socket() const {
+	return m_connection->get_socket();
+}
+
+void discord_bot::set_read_timeout(long ms) {
+	m_connection->set_read_timeout(ms);
+}
+
 void discord_bot::send_heartbeat() {
-	m_heartbeat.set_sequence(nullptr);
-	if (m_sequence) { m_heartbeat.set_sequence(m_sequence); }
-	m_client->send(m_hdl, m_heartbeat.get_gateway_payload(), frame::opcode::text);
+	int sequence = m_sequence.load();
+	if (sequence) m_heartbeat.set(gateway_templates::HEARTBEAT_SEQUENCE, sequence);
+	else m_heartbeat.set_null(gateway_templates::HEARTBEAT_SEQUENCE);
+
+	//Sent from the reading thread, so a heartbeat nothing waits before skips the queue and its copy
+	if (m_encoding == gateway_encoding::JSON && m_outbound.take_direct()) {
+		const std::string& data = m_heartbeat.render();
+		m_client->send(m_hdl, data.data(), data.size(), frame::opcode::text);
+	}
+	else {
+		send_payload(m_heartbeat, gateway_queue::HIGH);
+	}
 	m_timepoint = h_clock::now();
 }
 
+void discord_bot::send_payload(const payload& p) {
+	nlohmann::json j = p.get_gateway_json();
+	int op = j["op"].get<int>();
+	gateway_queue::priority priority = op == opcode::gateway::heartbeat || op == opcode::gateway::identify || op == opcode::gateway::resume ? gateway_queue::HIGH : gateway_queue::NORMAL;
+
+	if (m_encoding == gateway_encoding::ETF) m_outbound.push(etf::encode(j), true, priority);
+	else m_outbound.push(j.dump(), false, priority);
+}
+
+void discord_bot::send_payload(payload_template& t, gateway_queue::priority priority) {
+	const std::string& data = t.render();
+	if (m_encoding == gateway_encoding::ETF) m_outbound.push(etf::encode(nlohmann::json::parse(data)), true, priority);
+	else m_outbound.push(data, false, priority);
+}
+
+void discord_bot::flush_outbound() {
+	gateway_queue::command c;
+	while (m_outbound.pop(c)) {
+		m_client->send(m_hdl, c.data, c.binary ? frame::opcode::binary : frame::opcode::text);
+	}
+}
+
+void discord_bot::flush_presence() {
+	if (h_clock::now() - m_presence_sent < presence_state::PRESENCE_WINDOW) return;
+
+	std::string data;
+	if (!m_shard_group->presence.get_if_newer(m_presence_version, m_encoding == gateway_encoding::ETF, data)) return;
+	m_outbound.push(std::move(data), m_encoding == gateway_encoding::ETF, gateway_queue::NORMAL);
+	m_presence_sent = h_clock::now();
+}
+
 void discord_bot::on_open_internal(dconnection_hdl hdl) {
 	if (m_on_open != nullptr) m_on_open();
 }
@@ -146,22 +438,180 @@ void discord_bot::on_open_internal(dconnection_hdl hdl) {
 void discord_bot::on_message_internal(dclient c, dconnection_hdl hdl, msg_ptr msg) {
 	const std::string& raw = msg->get_payload();
 
-	nlohmann::json j = nlohmann::json::parse(raw);
-	m_sequence = j["s"].is_null() ? m_sequence : j["s"].get<int>();
+	//The frame opcode says nothing of the encoding, zlib-stream payloads come as binary frames either way
+	bool json = m_encoding == gateway_encoding::JSON;
+	session_state state = m_state;
+	bool dispatching = state == RESUMING || state == READY;
+
+	//Dropped events never reach the JSON parser, only their sequence is kept
+	int sequence;
+	if (dispatching && json && m_filter.try_drop(raw, sequence)) {
+		m_sequence = sequence;
+		if (!m_snapshot_path.empty()) m_applied.skip(sequence);
+		return;
+	}
 
-	int op = j["op"].get<int>();
-	std::string op_name = j["t"].is_null() ? "" : j["t"].get<std::string>();
-	nlohmann::json data = j["d"];
+	gateway_envelope env;
+	bool valid = json ? gateway_envelope::peek(raw, env) : gateway_envelope::peek_etf(raw, env);
+	if (!valid) {
+		m_client->get_alog().write(logger::alevel::app, NAME + " Received an invalid gateway payload");
+		return;
+	}
+	if (env.has_sequence) m_sequence = env.sequence;
+
+	int op = env.op;
+	event::type e = op == opcode::gateway::dispatch ? event::from_name(env.t) : event::UNKNOWN;
+
+	//An ETF frame has no byte scan, its filter applies once the envelope was read past "d"
+	if (dispatching && !json && m_filter.is_dropped(e)) {
+		if (env.has_sequence && !m_snapshot_path.empty()) m_applied.skip(env.sequence);
+		return;
+	}
 
 	switch(op) {
+	case opcode::gateway::hello:
+		on_hello(op, std::string(env.t), env.data());
+		return;
 	case opcode::gateway::heartbeat: 
 		send_heartbeat();
 		break;
+	case opcode::gateway::invalid_session:
+		//The snapshot's session expired, a new one is identified once the scheduler allows it
+		if (state == RESUMING) {
+			m_client->get_alog().write(logger::alevel::app, NAME + " Session could not be resumed");
+			{
+				std::lock_guard<std::mutex> guard(m_session_lock);
+				m_session_id.clear();
+			}
+			m_sequence = 0;
+			m_applied.reset(0);
+			//The snapshot's entities will not be brought up to date, the new session's GUILD_CREATEs rebuild them
+			if (m_cache != nullptr) m_cache->clear();
+			m_state = IDENTIFYING;
+			schedule_identify();
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+
+	//With a snapshot path, the sequence saved is the one the cache applied, not the one received
+	bool track = env.has_sequence && !m_snapshot_path.empty();
+
+	//Before READY the bot handles the payloads itself, a resumed session is dispatched right away
+	if (!dispatching) {
+		on_identify(op, std::string(env.t), env.data());
+		if (track) m_applied.skip(env.sequence);
+		return;
+	}
+	if (e == event::RESUMED) m_state = READY;
+
+	//Nobody wants this event, "d" is dropped without being parsed
+	if (!is_subscribed(e) && !is_internal(e)) {
+		if (track) m_applied.skip(env.sequence);
+		return;
+	}
+
+	//Handlers run on the workers so the reading thread is free to keep up with heartbeats,
+	//msg is kept alive by the task since the envelope points into its payload
+	//The guild events carry their guild as "id", they go on the same strand as the rest of the guild
+	const char* key_name = e == event::GUILD_CREATE || e == event::GUILD_UPDATE || e == event::GUILD_DELETE ? "id" : "guild_id";
+	snowflake key = event_decoder::find_id(env, key_name);
+	if (track) m_applied.start(env.sequence);
+	m_executor->post(key, [this, msg, env, e]() {
+		on_dispatch(env, e);
+	}, m_tasks);
+}
+
+void discord_bot::on_dispatch(const gateway_envelope& env, event::type e) {
+	applied_sequence::finisher applied(env.has_sequence && !m_snapshot_path.empty() ? &m_applied : nullptr, env.sequence);
+
+	switch (e) {
+	case event::GUILD_MEMBERS_CHUNK:
+		on_members_chunk(env);
+		break;
 	default:
 		break;
 	}
 
-	if (m_on_message != nullptr) m_on_message(op, op_name, data);
+	//The cache is updated before the handlers run so they see the new state
+	nlohmann::json data;
+	bool parsed = false;
+	bool entities = m_cache != nullptr && entity_cache::is_cached(e);
+	bool messages = m_messages != nullptr && message_cache::is_cached(e);
+	if (entities || messages) {
+		data = env.data();
+		parsed = true;
+	}
+	if (entities) m_cache->update(e, data);
+	applied.finish();
+
+	if (e != event::UNKNOWN && m_raw_handlers[e] != nullptr) m_raw_handlers[e](env);
+
+	//The DOM is only built if a JSON handler wants it
+	bool wants_json = e != event::UNKNOWN && m_handlers[e] != nullptr;
+	if (wants_json || m_on_message != nullptr) {
+		if (!parsed) data = env.data();
+		if (wants_json) m_handlers[e](data);
+		if (m_on_message != nullptr) m_on_message(env.op, std::string(env.t), data);
+	}
+
+	//The message cache is updated last, the handlers still find the message as it was
+	if (messages) m_messages->update(e, data);
+}
+
+void discord_bot::on_members_chunk(const gateway_envelope& env) {
+	std::string nonce;
+	if (!member_request::find_nonce(env, nonce)) return;
+
+	std::shared_ptr<member_request> request;
+	{
+		std::lock_guard<std::mutex> guard(m_member_requests_lock);
+		auto it = m_member_requests.find(nonce);
+		if (it == m_member_requests.end()) return;
+		request = it->second;
+	}
+
+	//Chunks of a guild run on its strand, one at a time and in order
+	if (request->on_chunk(env)) {
+		std::lock_guard<std::mutex> guard(m_member_requests_lock);
+		m_member_requests.erase(nonce);
+	}
+}
+
+void discord_bot::expire_member_requests() {
+	std::vector<std::shared_ptr<member_request>> expired;
+	{
+		std::lock_guard<std::mutex> guard(m_member_requests_lock);
+		if (m_member_requests.empty()) return;
+		member_request::clock::time_point now = member_request::clock::now();
+		for (auto it = m_member_requests.begin(); it != m_member_requests.end();) {
+			if (!it->second->expired(now)) {
+				++it;
+				continue;
+			}
+			expired.push_back(it->second);
+			it = m_member_requests.erase(it);
+		}
+	}
+	for (const std::shared_ptr<member_request>& request : expired) request->fail("The gateway stopped sending the requested members");
+}
+
+int discord_bot::get_intents() const {
+	int intents = intent::GUILD_MESSAGES;
+	if (m_cache != nullptr) intents |= intent::GUILDS | intent::GUILD_MEMBERS;
+	if (m_member_intent) intents |= intent::GUILD_MEMBERS;
+	return intents;
+}
+
+bool discord_bot::is_internal(event::type e) const {
+	switch (e) {
+	case event::GUILD_MEMBERS_CHUNK:
+		return true;
+	default:
+		return (m_cache != nullptr && entity_cache::is_cached(e)) || (m_messages != nullptr && message_cache::is_cached(e));
+	}
 }
 
 void discord_bot::on_close_internal(dconnection_hdl hdl) {
@@ -0,0 +1,390 @@
+#include <entity_cache.h>
+#include <algorithm>
+#include <mutex>
+
+namespace {
+
+	const nlohmann::json& field(const nlohmann::json& d, const char* key) {
+		static const nlohmann::json null;
+		if (!d.is_object() || !d.count(key)) return null;
+		return d[key];
+	}
+
+	snowflake id_of(const nlohmann::json& d, const char* key) {
+		if (!d.is_object() || !d.count(key)) return snowflake();
+		return d[key].get<snowflake>();
+	}
+
+	bool read_string(const nlohmann::json& d, const char* key, std::string& out) {
+		if (!d.is_object() || !d.count(key)) return false;
+		const nlohmann::json& v = d[key];
+		if (v.is_string()) out = v.get_ref<const std::string&>();
+		else out.clear();
+		return true;
+	}
+
+	//Heap bytes of a string, short strings are stored inline
+	size_t string_bytes(const std::string& s) {
+		return s.capacity() > 15 ? s.capacity() + 1 : 0;
+	}
+
+}
+
+void entity_cache::set_member_memory_limit(size_t bytes) {
+	std::unique_lock<std::shared_mutex> lock(m_lock);
+	m_members.set_memory_limit(bytes);
+}
+
+void entity_cache::clear() {
+	std::unique_lock<std::shared_mutex> lock(m_lock);
+	m_guilds.clear();
+	m_channels.clear();
+	m_roles.clear();
+	m_members.clear();
+	m_permissions.clear();
+	rcu::reclaim();
+}
+
+bool entity_cache::is_cached(event::type e) {
+	switch (e) {
+	case event::GUILD_CREATE:
+	case event::GUILD_UPDATE:
+	case event::GUILD_DELETE:
+	case event::CHANNEL_CREATE:
+	case event::CHANNEL_UPDATE:
+	case event::CHANNEL_DELETE:
+	case event::GUILD_ROLE_CREATE:
+	case event::GUILD_ROLE_UPDATE:
+	case event::GUILD_ROLE_DELETE:
+	case event::GUILD_MEMBER_ADD:
+	case event::GUILD_MEMBER_UPDATE:
+	case event::GUILD_MEMBER_REMOVE:
+	case event::GUILD_MEMBERS_CHUNK:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void entity_cache::update(event::type e, const nlohmann::json& d) {
+	if (!d.is_object()) return;
+	std::unique_lock<std::shared_mutex> lock(m_lock);
+
+	switch (e) {
+	case event::GUILD_CREATE:
+		on_guild(d, true);
+		break;
+	case event::GUILD_UPDATE:
+		on_guild(d, false);
+		break;
+	case event::GUILD_DELETE:
+		//An unavailable guild is an outage, its state comes back with the next GUILD_CREATE
+		if (!d.count("unavailable") || !d["unavailable"].is_boolean() || !d["unavailable"].get<bool>()) on_guild_delete(id_of(d, "id"));
+		break;
+	case event::CHANNEL_CREATE:
+	case event::CHANNEL_UPDATE:
+		on_channel(d, id_of(d, "guild_id"), true);
+		break;
+	case event::CHANNEL_DELETE:
+		on_channel_delete(id_of(d, "id"));
+		break;
+	case event::GUILD_ROLE_CREATE:
+	case event::GUILD_ROLE_UPDATE:
+		if (d.count("role")) on_role(d["role"], id_of(d, "guild_id"), true);
+		break;
+	case event::GUILD_ROLE_DELETE:
+		on_role_delete(id_of(d, "guild_id"), id_of(d, "role_id"));
+		break;
+	case event::GUILD_MEMBER_ADD: {
+		snowflake guild_id = id_of(d, "guild_id");
+		on_member(d, guild_id);
+		update_guild(guild_id, [](cached_guild& g) { g.member_count++; });
+		break;
+	}
+	case event::GUILD_MEMBER_UPDATE:
+		on_member(d, id_of(d, "guild_id"));
+		break;
+	case event::GUILD_MEMBER_REMOVE: {
+		snowflake guild_id = id_of(d, "guild_id");
+		if (d.count("user")) on_member_remove(guild_id, id_of(d["user"], "id"));
+		update_guild(guild_id, [](cached_guild& g) {
+			if (g.member_count > 0) g.member_count--;
+		});
+		break;
+	}
+	case event::GUILD_MEMBERS_CHUNK:
+		if (d.count("members") && d["members"].is_array()) {
+			snowflake guild_id = id_of(d, "guild_id");
+			for (const nlohmann::json& member : d["members"]) on_member(member, guild_id);
+		}
+		break;
+	default:
+		break;
+	}
+	invalidate_permissions(e, d);
+	rcu::reclaim();
+}
+
+uint64_t entity_cache::get_permissions(snowflake guild_id, snowflake user_id, snowflake channel_id) const {
+	uint64_t perms;
+	permission_cache::stamp s;
+	if (m_permissions.find(guild_id, user_id, channel_id, perms, s)) return perms;
+
+	//Computed outside the permission cache's lock, an event applied meanwhile leaves the stamp stale
+	if (!compute_permissions(guild_id, user_id, channel_id, perms)) return 0;
+	m_permissions.store(guild_id, user_id, channel_id, perms, s);
+	return perms;
+}
+
+entity_cache::memory_stats entity_cache::get_memory_stats() const {
+	std::shared_lock<std::shared_mutex> lock(m_lock);
+	rcu::read_guard guard;
+	memory_stats s = {};
+
+	s.guilds = m_guilds.size();
+	s.guild_bytes = m_guilds.memory_usage();
+	m_guilds.for_each([&s](snowflake, const cached_guild& g) {
+		s.guild_bytes += string_bytes(g.name) + (g.channels.capacity() + g.roles.capacity()) * sizeof(snowflake);
+	});
+
+	s.channels = m_channels.size();
+	s.channel_bytes = m_channels.memory_usage();
+	m_channels.for_each([&s](snowflake, const cached_channel& c) {
+		s.channel_bytes += string_bytes(c.name) + c.overwrites.capacity() * sizeof(permission_overwrite);
+	});
+
+	s.roles = m_roles.size();
+	s.role_bytes = m_roles.memory_usage();
+	m_roles.for_each([&s](snowflake, const cached_role& r) {
+		s.role_bytes += string_bytes(r.name);
+	});
+
+	s.members = m_members.size();
+	s.member_bytes = m_members.memory_usage();
+	s.evicted_members = m_members.get_evicted();
+	return s;
+}
+
+void entity_cache::on_guild(const nlohmann::json& d, bool create) {
+	snowflake id = id_of(d, "id");
+	if (!id) return;
+
+	//Published values are immutable, the guild is changed on a copy that replaces it
+	const cached_guild* old = m_guilds.find(id);
+	cached_guild g = old != nullptr ? *old : cached_guild();
+	g.id = id;
+	read_string(d, "name", g.name);
+	if (d.count("owner_id")) g.owner_id = id_of(d, "owner_id");
+	if (d.count("member_count") && d["member_count"].is_number()) g.member_count = d["member_count"].get<uint32_t>();
+
+	//GUILD_CREATE and GUILD_UPDATE both carry the whole role list
+	if (d.count("roles") && d["roles"].is_array()) {
+		for (snowflake role : g.roles) m_roles.erase(role);
+		g.roles.clear();
+		for (const nlohmann::json& role : d["roles"]) {
+			if (on_role(role, id, false)) g.roles.push_back(id_of(role, "id"));
+		}
+	}
+	if (create && d.count("channels") && d["channels"].is_array()) {
+		for (snowflake channel : g.channels) m_channels.erase(channel);
+		g.channels.clear();
+		for (const nlohmann::json& channel : d["channels"]) {
+			if (on_channel(channel, id, false)) g.channels.push_back(id_of(channel, "id"));
+		}
+	}
+	m_guilds.assign(id, std::move(g));
+
+	if (create && d.count("members") && d["members"].is_array()) {
+		for (const nlohmann::json& member : d["members"]) on_member(member, id);
+	}
+}
+
+void entity_cache::on_guild_delete(snowflake id) {
+	const cached_guild* g = m_guilds.find(id);
+	if (g == nullptr) return;
+	for (snowflake channel : g->channels) m_channels.erase(channel);
+	for (snowflake role : g->roles) m_roles.erase(role);
+	m_members.remove_guild(id);
+	m_permissions.invalidate_guild(id);
+	m_guilds.erase(id);
+}
+
+bool entity_cache::on_channel(const nlohmann::json& d, snowflake guild_id, bool link) {
+	snowflake id = id_of(d, "id");
+	if (!id) return false;
+
+	const cached_channel* old = m_channels.find(id);
+	bool added = old == nullptr;
+	cached_channel c = old != nullptr ? *old : cached_channel();
+	c.id = id;
+	if (guild_id) c.guild_id = guild_id;
+	if (d.count("parent_id")) c.parent_id = id_of(d, "parent_id");
+	if (d.count("position") && d["position"].is_number()) c.position = d["position"].get<int32_t>();
+	if (d.count("type") && d["type"].is_number()) c.type = d["type"].get<uint8_t>();
+	read_string(d, "name", c.name);
+
+	if (d.count("permission_overwrites") && d["permission_overwrites"].is_array()) {
+		c.overwrites.clear();
+		for (const nlohmann::json& o : d["permission_overwrites"]) {
+			permission_overwrite p;
+			p.id = id_of(o, "id");
+			const nlohmann::json& type = field(o, "type");
+			p.type = (type.is_string() && type.get_ref<const std::string&>() == "member") || (type.is_number() && type.get<int>() == 1) ? permission_overwrite::MEMBER : permission_overwrite::ROLE;
+			p.allow = to_permissions(field(o, o.count("allow_new") ? "allow_new" : "allow"));
+			p.deny = to_permissions(field(o, o.count("deny_new") ? "deny_new" : "deny"));
+			c.overwrites.push_back(p);
+		}
+	}
+	guild_id = c.guild_id;
+	m_channels.assign(id, std::move(c));
+
+	if (added && link && guild_id) {
+		update_guild(guild_id, [id](cached_guild& g) { g.channels.push_back(id); });
+	}
+	return added;
+}
+
+void entity_cache::on_channel_delete(snowflake id) {
+	const cached_channel* c = m_channels.find(id);
+	if (c == nullptr) return;
+	update_guild(c->guild_id, [id](cached_guild& g) {
+		g.channels.erase(std::remove(g.channels.begin(), g.channels.end(), id), g.channels.end());
+	});
+	m_channels.erase(id);
+}
+
+bool entity_cache::on_role(const nlohmann::json& d, snowflake guild_id, bool link) {
+	snowflake id = id_of(d, "id");
+	if (!id) return false;
+
+	const cached_role* old = m_roles.find(id);
+	bool added = old == nullptr;
+	cached_role r = old != nullptr ? *old : cached_role();
+	r.id = id;
+	r.guild_id = guild_id;
+	read_string(d, "name", r.name);
+	if (d.count("permissions_new") || d.count("permissions")) r.permissions = to_permissions(d.count("permissions_new") ? d["permissions_new"] : d["permissions"]);
+	if (d.count("color") && d["color"].is_number()) r.color = d["color"].get<uint32_t>();
+	if (d.count("position") && d["position"].is_number()) r.position = d["position"].get<int32_t>();
+	m_roles.assign(id, std::move(r));
+
+	if (added && link) {
+		update_guild(guild_id, [id](cached_guild& g) { g.roles.push_back(id); });
+	}
+	return added;
+}
+
+void entity_cache::on_role_delete(snowflake guild_id, snowflake id) {
+	m_roles.erase(id);
+	update_guild(guild_id, [id](cached_guild& g) {
+		g.roles.erase(std::remove(g.roles.begin(), g.roles.end(), id), g.roles.end());
+	});
+	//Discord does not send a GUILD_MEMBER_UPDATE for the members who had the role
+	m_members.remove_role(id);
+}
+
+void entity_cache::on_member(const nlohmann::json& d, snowflake guild_id) {
+	if (!m_guilds.contains(guild_id)) return;
+	m_members.update(guild_id, d);
+}
+
+void entity_cache::on_member_remove(snowflake guild_id, snowflake user_id) {
+	m_members.remove(guild_id, user_id);
+}
+
+bool entity_cache::compute_permissions(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t& perms) const {
+	std::shared_lock<std::shared_mutex> lock(m_lock);
+	rcu::read_guard guard;
+
+	const cached_guild* g = m_guilds.find(guild_id);
+	if (g == nullptr) return false;
+	const cached_channel* c = nullptr;
+	if (channel_id) {
+		c = m_channels.find(channel_id);
+		if (c == nullptr || c->guild_id != guild_id) return false;
+	}
+	if (g->owner_id == user_id) {
+		perms = permission::ALL;
+		return true;
+	}
+	member_view m;
+	if (!m_members.find(guild_id, user_id, m)) return false;
+
+	//The @everyone role has the id of its guild
+	const cached_role* everyone = m_roles.find(guild_id);
+	uint64_t base = everyone != nullptr ? everyone->permissions : 0;
+	for (size_t i = 0; i < m.role_count; i++) {
+		if (const cached_role* r = m_roles.find(m.roles[i])) base |= r->permissions;
+	}
+	if (base & permission::ADMINISTRATOR) {
+		perms = permission::ALL;
+		return true;
+	}
+	if (c == nullptr) {
+		perms = base;
+		return true;
+	}
+
+	//Overwrites apply @everyone first, then the member's roles together, then the member
+	uint64_t allow = 0;
+	uint64_t deny = 0;
+	const permission_overwrite* own = nullptr;
+	for (const permission_overwrite& o : c->overwrites) {
+		if (o.type == permission_overwrite::MEMBER) {
+			if (o.id == user_id) own = &o;
+		}
+		else if (o.id == guild_id) {
+			base = (base & ~o.deny) | o.allow;
+		}
+		else if (std::binary_search(m.roles, m.roles + m.role_count, o.id)) {
+			allow |= o.allow;
+			deny |= o.deny;
+		}
+	}
+	base = (base & ~deny) | allow;
+	if (own != nullptr) base = (base & ~own->deny) | own->allow;
+	perms = base;
+	return true;
+}
+
+void entity_cache::invalidate_permissions(event::type e, const nlohmann::json& d) {
+	switch (e) {
+	case event::GUILD_CREATE:
+	case event::GUILD_UPDATE:
+		m_permissions.invalidate_guild(id_of(d, "id"));
+		break;
+	case event::GUILD_ROLE_CREATE:
+	case event::GUILD_ROLE_UPDATE:
+	case event::GUILD_ROLE_DELETE:
+		m_permissions.invalidate_guild(id_of(d, "guild_id"));
+		break;
+	case event::CHANNEL_CREATE:
+	case event::CHANNEL_UPDATE:
+	case event::CHANNEL_DELETE:
+		m_permissions.invalidate_channel(id_of(d, "id"));
+		break;
+	case event::GUILD_MEMBER_ADD:
+	case event::GUILD_MEMBER_UPDATE:
+	case event::GUILD_MEMBER_REMOVE:
+		m_permissions.invalidate_member(id_of(d, "guild_id"), id_of(field(d, "user"), "id"));
+		break;
+	//GUILD_DELETE is in on_guild_delete, an unavailable guild keeps its permissions
+	case event::GUILD_MEMBERS_CHUNK:
+		if (d.count("members") && d["members"].is_array()) {
+			snowflake guild_id = id_of(d, "guild_id");
+			for (const nlohmann::json& member : d["members"]) m_permissions.invalidate_member(guild_id, id_of(field(member, "user"), "id"));
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+uint64_t entity_cache::to_permissions(const nlohmann::json& j) {
+	if (j.is_number()) return j.get<uint64_t>();
+	if (!j.is_string()) return 0;
+	//permissions_new, allow_new and deny_new are decimal strings
+	snowflake bits;
+	snowflake::parse(j.get_ref<const std::string&>(), bits);
+	return bits.value();
+}
@@ -0,0 +1,134 @@
+#include <event_executor.h>
+#include <algorithm>
+#include <iostream>
+#include <exception>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+event_executor::event_executor(size_t threads) :
+	m_stop(false),
+	m_depth(0),
+	m_max_depth(0),
+	m_executed(0),
+	m_wait_total_us(0),
+	m_run_total_us(0),
+	m_max_run_us(0)
+{
+	threads = std::max<size_t>(threads, 1);
+	for (size_t i = 0; i < threads; i++) m_workers.emplace_back(&event_executor::run, this);
+}
+
+event_executor::~event_executor() {
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	for (std::thread& t : m_workers) t.join();
+}
+
+void event_executor::post(snowflake key, task t) {
+	push(key, job{ std::move(t), clock::now(), nullptr });
+}
+
+void event_executor::post(snowflake key, task t, group& g) {
+	push(key, job{ std::move(t), clock::now(), &g });
+}
+
+void event_executor::push(snowflake key, job j) {
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (j.owner != nullptr) {
+			if (j.owner->drained) return;
+			j.owner->pending++;
+		}
+		strand& s = m_strands[key];
+		s.jobs.push_back(std::move(j));
+		m_depth++;
+		m_max_depth = std::max(m_max_depth, m_depth);
+		//An active strand is either queued or running, its worker picks up the new job
+		if (s.active) return;
+		s.active = true;
+		m_ready.push_back(key);
+	}
+	m_cv.notify_one();
+}
+
+void event_executor::drain(group& g) {
+	std::unique_lock<std::mutex> lock(m_lock);
+	g.drained = true;
+	//A strand left empty is erased by the worker that takes it
+	for (std::pair<const snowflake, strand>& s : m_strands) {
+		std::deque<job>& jobs = s.second.jobs;
+		size_t before = jobs.size();
+		jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&g](const job& j) { return j.owner == &g; }), jobs.end());
+		m_depth -= before - jobs.size();
+		g.pending -= before - jobs.size();
+	}
+	m_drained.wait(lock, [&g]() { return g.pending == 0; });
+}
+
+event_executor::stats event_executor::get_stats() const {
+	std::lock_guard<std::mutex> guard(m_lock);
+	stats s;
+	s.queue_depth = m_depth;
+	s.max_queue_depth = m_max_depth;
+	s.strands = m_strands.size();
+	s.executed = m_executed;
+	s.average_wait_us = m_executed ? m_wait_total_us / m_executed : 0;
+	s.average_run_us = m_executed ? m_run_total_us / m_executed : 0;
+	s.max_run_us = m_max_run_us;
+	return s;
+}
+
+void event_executor::run() {
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true) {
+		m_cv.wait(lock, [this]() { return m_stop || !m_ready.empty(); });
+		if (m_ready.empty()) return;
+
+		snowflake key = m_ready.front();
+		m_ready.pop_front();
+
+		//References to unordered_map elements stay valid while other strands are added
+		strand& s = m_strands.at(key);
+		if (s.jobs.empty()) {
+			//Its jobs were drained while it waited
+			m_strands.erase(key);
+			continue;
+		}
+		job j = std::move(s.jobs.front());
+		s.jobs.pop_front();
+		m_depth--;
+
+		lock.unlock();
+		clock::time_point start = clock::now();
+		try {
+			j.t();
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Event handler threw an exception: " << e.what() << "\n";
+		}
+		clock::time_point end = clock::now();
+		j.t = nullptr;
+		lock.lock();
+
+		//The task and its captures are gone, the owner may go once its last one is done
+		if (j.owner != nullptr && --j.owner->pending == 0) m_drained.notify_all();
+
+		uint64_t run_us = duration_cast<microseconds>(end - start).count();
+		m_executed++;
+		m_wait_total_us += duration_cast<microseconds>(start - j.queued).count();
+		m_run_total_us += run_us;
+		m_max_run_us = std::max(m_max_run_us, run_us);
+
+		if (s.jobs.empty()) {
+			m_strands.erase(key);
+		}
+		else {
+			m_ready.push_back(key);
+			m_cv.notify_one();
+		}
+	}
+}
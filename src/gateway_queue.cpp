@@ -0,0 +1,41 @@
+#include <gateway_queue.h>
+
+gateway_queue::gateway_queue(unsigned int limit, std::chrono::milliseconds period, unsigned int reserved) :
+	m_window(limit, period),
+	m_reserved(reserved < limit ? reserved : limit - 1)
+{}
+
+void gateway_queue::push(std::string data, bool binary, priority p) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	(p == HIGH ? m_high : m_normal).push_back(command{ std::move(data), binary });
+}
+
+bool gateway_queue::pop(command& c) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (!m_high.empty()) {
+		if (!m_window.try_take()) return false;
+		c = std::move(m_high.front());
+		m_high.pop_front();
+		return true;
+	}
+	if (m_normal.empty() || !m_window.try_take(m_reserved)) return false;
+	c = std::move(m_normal.front());
+	m_normal.pop_front();
+	return true;
+}
+
+bool gateway_queue::take_direct() {
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_high.empty() && m_window.try_take();
+}
+
+size_t gateway_queue::size() {
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_high.size() + m_normal.size();
+}
+
+void gateway_queue::clear() {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_high.clear();
+	m_normal.clear();
+}
@@ -0,0 +1,53 @@
+#include <identify_scheduler.h>
+#include <algorithm>
+
+const std::chrono::milliseconds identify_scheduler::IDENTIFY_WINDOW(5000);
+
+const std::chrono::milliseconds identify_scheduler::SESSION_RESET_WINDOW(24 * 60 * 60 * 1000);
+
+identify_scheduler::identify_scheduler(const nlohmann::json& session_start_limit) :
+	m_max_concurrency(1),
+	m_remaining(1),
+	m_total(1)
+{
+	if (session_start_limit.count("max_concurrency")) {
+		m_max_concurrency = std::max(1, session_start_limit["max_concurrency"].get<int>());
+	}
+	if (session_start_limit.count("remaining")) {
+		m_remaining = session_start_limit["remaining"].get<int>();
+	}
+	if (session_start_limit.count("total")) {
+		m_total = session_start_limit["total"].get<int>();
+	}
+	unsigned int reset_after = 0;
+	if (session_start_limit.count("reset_after")) {
+		reset_after = session_start_limit["reset_after"].get<unsigned int>();
+	}
+	m_reset_at = clock::now() + std::chrono::milliseconds(reset_after);
+	m_next_slot.assign(m_max_concurrency, clock::now());
+}
+
+identify_scheduler::clock::time_point identify_scheduler::reserve_slot(int shard_id) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	clock::time_point& next = m_next_slot[shard_id % m_max_concurrency];
+
+	clock::time_point slot = std::max(clock::now(), next);
+	//The daily session budget is used up, nothing can identify before it resets
+	if (m_remaining <= 0) {
+		slot = std::max(slot, m_reset_at);
+		m_reset_at += SESSION_RESET_WINDOW;
+		m_remaining = m_total;
+	}
+	m_remaining--;
+	next = slot + IDENTIFY_WINDOW;
+	return slot;
+}
+
+int identify_scheduler::get_max_concurrency() const {
+	return m_max_concurrency;
+}
+
+int identify_scheduler::get_remaining() const {
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_remaining;
+}
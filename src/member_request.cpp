@@ -0,0 +1,151 @@
+#include <member_request.h>
+#include <gateway_events.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+void member_list::add(snowflake id, std::string_view username, std::string_view nick, const std::vector<snowflake>& roles, bool bot) {
+	record r;
+	r.id = id;
+	r.bot = bot;
+	r.username_offset = static_cast<uint32_t>(m_strings.size());
+	r.username_length = static_cast<uint16_t>(username.size());
+	m_strings.append(username);
+	r.nick_offset = static_cast<uint32_t>(m_strings.size());
+	r.nick_length = static_cast<uint16_t>(nick.size());
+	m_strings.append(nick);
+	r.roles_offset = static_cast<uint32_t>(m_roles.size());
+	r.role_count = static_cast<uint16_t>(roles.size());
+	m_roles.insert(m_roles.end(), roles.begin(), roles.end());
+	m_records.push_back(r);
+}
+
+member_request::member_request(chunk_handler on_chunk) :
+	m_on_chunk(on_chunk),
+	m_chunk_count(1),
+	m_chunks_received(0),
+	m_deadline((clock::now() + CHUNK_TIMEOUT).time_since_epoch().count()),
+	m_done(false)
+{}
+
+std::future<member_list> member_request::get_future() {
+	return m_promise.get_future();
+}
+
+bool member_request::find_nonce(const gateway_envelope& env, std::string& nonce) {
+	if (env.etf) return read_nonce<etf::scanner>(etf::scanner::find_key(env.d, "nonce"), nonce);
+	return read_nonce<json_scanner>(json_scanner::find_key(env.d, "nonce"), nonce);
+}
+
+bool member_request::on_chunk(const gateway_envelope& env) {
+	m_deadline = (clock::now() + CHUNK_TIMEOUT).time_since_epoch().count();
+	size_t first = m_members.size();
+	bool ok;
+	if (env.etf) {
+		etf::scanner s(env.d);
+		ok = parse_chunk(s);
+	}
+	else {
+		json_scanner s(env.d);
+		ok = parse_chunk(s);
+	}
+	if (!ok) {
+		fail("The gateway sent a member chunk that could not be read");
+		return true;
+	}
+	m_chunks_received++;
+
+	if (m_on_chunk != nullptr) m_on_chunk(m_members, first);
+	if (m_chunks_received < m_chunk_count) return false;
+
+	if (!m_done.exchange(true)) m_promise.set_value(std::move(m_members));
+	return true;
+}
+
+bool member_request::expired(clock::time_point now) const {
+	return now.time_since_epoch().count() >= m_deadline.load();
+}
+
+void member_request::fail(const std::string& reason) {
+	if (m_done.exchange(true)) return;
+	m_promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+}
+
+template<class S> bool member_request::parse_chunk(S& s) {
+	std::string_view key, member_key, user_key, value;
+	std::string username, nick;
+	std::vector<snowflake> roles;
+	bool escaped;
+	int64_t n;
+
+	if (!s.enter_object()) return false;
+	while (s.next_key(key)) {
+		if (key == "chunk_count") {
+			if (!s.read_int(n) || n < 1) return false;
+			m_chunk_count = static_cast<int>(n);
+		}
+		else if (key == "members") {
+			if (!s.enter_array()) return false;
+			while (s.next_element()) {
+				snowflake id;
+				bool bot = false;
+				username.clear();
+				nick.clear();
+				roles.clear();
+
+				if (!s.enter_object()) return false;
+				while (s.next_key(member_key)) {
+					if (member_key == "user") {
+						if (!s.enter_object()) return false;
+						while (s.next_key(user_key)) {
+							if (user_key == "id") {
+								event_decoder::read_id(s, id);
+							}
+							else if (user_key == "username") {
+								if (s.read_string(value, escaped)) username = escaped ? json_scanner::unescape(value) : std::string(value);
+							}
+							else if (user_key == "bot") {
+								s.read_bool(bot);
+							}
+							else {
+								s.skip_value();
+							}
+						}
+					}
+					else if (member_key == "nick") {
+						if (!s.read_null() && s.read_string(value, escaped)) nick = escaped ? json_scanner::unescape(value) : std::string(value);
+					}
+					else if (member_key == "roles") {
+						if (!s.enter_array()) return false;
+						snowflake role;
+						while (s.next_element() && event_decoder::read_id(s, role)) roles.push_back(role);
+					}
+					else {
+						s.skip_value();
+					}
+				}
+				if (!s.ok()) return false;
+				m_members.add(id, username, nick, roles, bot);
+			}
+		}
+		else if (!s.skip_value()) {
+			return false;
+		}
+	}
+	return s.ok();
+}
+
+template<class S> bool member_request::read_nonce(std::string_view value, std::string& nonce) {
+	std::string_view raw;
+	bool escaped;
+	int64_t n;
+	S text(value);
+	if (text.read_string(raw, escaped)) {
+		nonce = escaped ? json_scanner::unescape(raw) : std::string(raw);
+		return true;
+	}
+	//A failed read leaves a scanner failed, the number is read with a new one
+	S number(value);
+	if (!number.read_int(n)) return false;
+	nonce = std::to_string(n);
+	return true;
+}
@@ -0,0 +1,162 @@
+#include <member_store.h>
+#include <algorithm>
+#include <cstdlib>
+
+member_store::member_store() :
+	m_limit(0),
+	m_hand(0),
+	m_evicted(0)
+{}
+
+void member_store::set_memory_limit(size_t bytes) {
+	m_limit = bytes;
+	if (m_limit != 0) evict();
+}
+
+bool member_store::update(snowflake guild_id, const nlohmann::json& d) {
+	if (!d.is_object() || !d.count("user") || !d["user"].is_object()) return false;
+	const nlohmann::json& user = d["user"];
+	member_key key = { guild_id, user.count("id") ? user["id"].get<snowflake>() : snowflake() };
+	if (!key.guild_id || !key.user_id) return false;
+
+	bool added = !m_members.contains(key);
+	record& r = m_members[key];
+
+	if (user.count("username") && user["username"].is_string()) r.username = m_strings.replace(r.username, user["username"].get_ref<const std::string&>());
+	if (user.count("avatar")) {
+		const nlohmann::json& avatar = user["avatar"];
+		r.avatar = avatar.is_string() ? m_strings.replace(r.avatar, avatar.get_ref<const std::string&>()) : (m_strings.release(r.avatar), 0);
+	}
+	if (user.count("discriminator") && user["discriminator"].is_string()) r.discriminator = static_cast<uint16_t>(std::atoi(user["discriminator"].get_ref<const std::string&>().c_str()));
+	if (user.count("bot") && user["bot"].is_boolean()) r.bot = user["bot"].get<bool>();
+
+	if (d.count("nick")) {
+		const nlohmann::json& nick = d["nick"];
+		r.nick = nick.is_string() ? m_strings.replace(r.nick, nick.get_ref<const std::string&>()) : (m_strings.release(r.nick), 0);
+	}
+	if (d.count("roles") && d["roles"].is_array()) {
+		m_roles_buffer.clear();
+		for (const nlohmann::json& role : d["roles"]) m_roles_buffer.push_back(role.get<snowflake>());
+		std::sort(m_roles_buffer.begin(), m_roles_buffer.end());
+		r.roles = m_role_sets.replace(r.roles, m_roles_buffer);
+	}
+	r.referenced.store(true, std::memory_order_relaxed);
+
+	if (added && m_limit != 0 && live_bytes() > m_limit) evict();
+	return added;
+}
+
+void member_store::restore(snowflake guild_id, const member_view& m) {
+	member_key key = { guild_id, m.user_id };
+	if (!key.guild_id || !key.user_id) return;
+
+	bool added = !m_members.contains(key);
+	record& r = m_members[key];
+	r.username = m_strings.replace(r.username, std::string(m.username));
+	r.nick = m_strings.replace(r.nick, std::string(m.nick));
+	r.avatar = m_strings.replace(r.avatar, std::string(m.avatar));
+	m_roles_buffer.assign(m.roles, m.roles + m.role_count);
+	std::sort(m_roles_buffer.begin(), m_roles_buffer.end());
+	r.roles = m_role_sets.replace(r.roles, m_roles_buffer);
+	r.discriminator = m.discriminator;
+	r.bot = m.bot;
+
+	if (added && m_limit != 0 && live_bytes() > m_limit) evict();
+}
+
+bool member_store::remove(snowflake guild_id, snowflake user_id) {
+	member_key key = { guild_id, user_id };
+	record* r = m_members.find(key);
+	if (r == nullptr) return false;
+	release(*r);
+	m_members.erase(key);
+	return true;
+}
+
+void member_store::remove_guild(snowflake guild_id) {
+	//Erasing shifts the next members back into the slot, so the slot is checked again
+	for (size_t i = 0; i < m_members.slot_count();) {
+		auto* s = m_members.slot_at(i);
+		if (s == nullptr || s->first.guild_id != guild_id) {
+			i++;
+			continue;
+		}
+		member_key key = s->first;
+		release(s->second);
+		m_members.erase(key);
+	}
+}
+
+void member_store::clear() {
+	m_members.clear();
+	m_strings = intern_table<std::string>();
+	m_role_sets = intern_table<std::vector<snowflake>, role_set_hash>();
+	m_hand = 0;
+}
+
+void member_store::remove_role(snowflake role_id) {
+	m_role_sets.update_all([role_id](std::vector<snowflake>& roles) {
+		auto it = std::find(roles.begin(), roles.end(), role_id);
+		if (it == roles.end()) return false;
+		roles.erase(it);
+		return true;
+	});
+}
+
+bool member_store::find(snowflake guild_id, snowflake user_id, member_view& view) const {
+	const record* r = m_members.find(member_key{ guild_id, user_id });
+	if (r == nullptr) return false;
+	r->referenced.store(true, std::memory_order_relaxed);
+	fill(user_id, *r, view);
+	return true;
+}
+
+size_t member_store::memory_usage() const {
+	return m_members.memory_usage() + m_strings.memory_usage() + m_role_sets.memory_usage() + m_roles_buffer.capacity() * sizeof(snowflake);
+}
+
+void member_store::release(record& r) {
+	m_strings.release(r.username);
+	m_strings.release(r.nick);
+	m_strings.release(r.avatar);
+	m_role_sets.release(r.roles);
+}
+
+void member_store::fill(snowflake user_id, const record& r, member_view& view) const {
+	const std::vector<snowflake>& roles = m_role_sets.get(r.roles);
+	view.user_id = user_id;
+	view.username = m_strings.get(r.username);
+	view.nick = m_strings.get(r.nick);
+	view.avatar = m_strings.get(r.avatar);
+	view.roles = roles.data();
+	view.role_count = roles.size();
+	view.discriminator = r.discriminator;
+	view.bot = r.bot;
+}
+
+void member_store::evict() {
+	while (m_members.size() > 0 && live_bytes() > m_limit) {
+		if (m_hand >= m_members.slot_count()) m_hand = 0;
+		auto* s = m_members.slot_at(m_hand);
+		if (s == nullptr) {
+			m_hand++;
+			continue;
+		}
+		//Second chance for a member used since the hand last passed
+		if (s->second.referenced.load(std::memory_order_relaxed)) {
+			s->second.referenced.store(false, std::memory_order_relaxed);
+			m_hand++;
+			continue;
+		}
+		member_key key = s->first;
+		release(s->second);
+		m_members.erase(key);
+		m_evicted++;
+	}
+}
+
+size_t member_store::live_bytes() const {
+	//The table is kept at most 3/4 full
+	size_t table = m_members.size() * sizeof(std::pair<member_key, record>) * 4 / 3;
+	return table + m_strings.memory_usage() + m_role_sets.memory_usage();
+}
@@ -0,0 +1,289 @@
+#include <message_cache.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	snowflake id_of(const nlohmann::json& d, const char* key) {
+		if (!d.is_object() || !d.count(key)) return snowflake();
+		return d[key].get<snowflake>();
+	}
+
+}
+
+message_cache::message_cache(size_t memory_budget, uint32_t messages_per_channel) :
+	m_free(NONE),
+	m_free_count(0),
+	m_used(0),
+	m_budget(std::max(memory_budget, BLOCKS_PER_CHUNK * BLOCK_SIZE)),
+	m_ring_size(std::max(messages_per_channel, 1u)),
+	m_channel_bytes(2 * sizeof(flat_map<snowflake, channel>::slot) + m_ring_size * sizeof(entry)),
+	m_hand(0),
+	m_evicted(0)
+{}
+
+bool message_cache::is_cached(event::type e) {
+	switch (e) {
+	case event::MESSAGE_CREATE:
+	case event::MESSAGE_UPDATE:
+	case event::MESSAGE_DELETE:
+	case event::MESSAGE_DELETE_BULK:
+	case event::CHANNEL_DELETE:
+	case event::GUILD_DELETE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void message_cache::update(event::type e, const nlohmann::json& d) {
+	if (!d.is_object()) return;
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	switch (e) {
+	case event::MESSAGE_CREATE:
+		on_create(d);
+		break;
+	case event::MESSAGE_UPDATE:
+		on_update(d);
+		break;
+	case event::MESSAGE_DELETE:
+		on_delete(id_of(d, "id"));
+		break;
+	case event::MESSAGE_DELETE_BULK:
+		if (d.count("ids") && d["ids"].is_array()) {
+			for (const nlohmann::json& id : d["ids"]) on_delete(id.get<snowflake>());
+		}
+		break;
+	case event::CHANNEL_DELETE:
+		drop_channel(id_of(d, "id"));
+		break;
+	case event::GUILD_DELETE: {
+		if (d.count("unavailable") && d["unavailable"].is_boolean() && d["unavailable"].get<bool>()) break;
+		snowflake guild_id = id_of(d, "id");
+		std::vector<snowflake> channels;
+		m_channels.for_each([&channels, guild_id](snowflake id, const channel& c) {
+			if (c.guild_id == guild_id) channels.push_back(id);
+		});
+		for (snowflake id : channels) drop_channel(id);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+bool message_cache::find(snowflake id, cached_message& out) const {
+	std::lock_guard<std::mutex> guard(m_lock);
+	const location* l = m_index.find(id);
+	if (l == nullptr) return false;
+	const channel* c = m_channels.find(l->channel_id);
+	const entry& e = c->ring[l->slot];
+
+	out.id = e.id;
+	out.channel_id = c->id;
+	out.guild_id = c->guild_id;
+	out.author_id = e.author_id;
+	out.content.clear();
+	size_t remaining = e.length;
+	for (uint32_t b = e.block; b != NONE && remaining > 0; b = m_next[b]) {
+		size_t n = std::min(remaining, BLOCK_SIZE);
+		out.content.append(block_data(b), n);
+		remaining -= n;
+	}
+	return true;
+}
+
+message_cache::stats message_cache::get_stats() const {
+	std::lock_guard<std::mutex> guard(m_lock);
+	stats s;
+	s.channels = m_channels.size();
+	s.messages = m_index.size();
+	s.arena_bytes = m_chunks.size() * BLOCKS_PER_CHUNK * BLOCK_SIZE;
+	s.used_bytes = m_used * BLOCK_SIZE;
+	s.overhead_bytes = footprint() - s.used_bytes;
+	s.evicted = m_evicted;
+	return s;
+}
+
+void message_cache::on_create(const nlohmann::json& d) {
+	snowflake id = id_of(d, "id");
+	snowflake channel_id = id_of(d, "channel_id");
+	if (!id || !channel_id || m_index.contains(id)) return;
+
+	channel* existing = m_channels.find(channel_id);
+	if (existing != nullptr && existing->count == m_ring_size) pop_oldest(*existing);
+	size_t ring = existing != nullptr ? 0 : m_channel_bytes;
+
+	static const std::string no_content;
+	const std::string& text = d.count("content") && d["content"].is_string() ? d["content"].get_ref<const std::string&>() : no_content;
+	//Content that can not fit is dropped, the message is still cached without it
+	uint32_t block = NONE;
+	if (make_room(blocks_for(text.size()) * BLOCK_SIZE + INDEX_BYTES + ring, channel_id)) block = store(text);
+	else if (!make_room(INDEX_BYTES + ring, channel_id)) return;
+
+	//Evicting may have moved the channel or taken from it too, it is looked up after
+	channel& c = m_channels[channel_id];
+	if (!c.id) {
+		c.id = channel_id;
+		c.ring.resize(m_ring_size);
+	}
+	if (d.count("guild_id")) c.guild_id = id_of(d, "guild_id");
+	if (c.count == m_ring_size) pop_oldest(c);
+	uint32_t slot = (c.head + c.count) % m_ring_size;
+	entry& e = c.ring[slot];
+	e.id = id;
+	e.author_id = d.count("author") ? id_of(d["author"], "id") : snowflake();
+	e.block = block;
+	e.length = block != NONE ? static_cast<uint32_t>(text.size()) : 0;
+	c.blocks += blocks_for(e.length);
+	c.count++;
+	c.messages++;
+	m_index[id] = location{ channel_id, slot };
+}
+
+void message_cache::on_update(const nlohmann::json& d) {
+	//An update without content is an embed being resolved, the text is unchanged
+	if (!d.count("content") || !d["content"].is_string()) return;
+	snowflake id = id_of(d, "id");
+	location* l = m_index.find(id);
+	if (l == nullptr) return;
+
+	location at = *l;
+	channel* c = m_channels.find(at.channel_id);
+	free_blocks(*c, c->ring[at.slot]);
+
+	const std::string& text = d["content"].get_ref<const std::string&>();
+	uint32_t block = make_room(blocks_for(text.size()) * BLOCK_SIZE, at.channel_id) ? store(text) : NONE;
+	c = m_channels.find(at.channel_id);
+	if (!m_index.contains(id)) {
+		//Evicted while making room for its own new content
+		if (block != NONE) {
+			entry lost = { id, snowflake(), block, static_cast<uint32_t>(text.size()) };
+			c->blocks += blocks_for(lost.length);
+			free_blocks(*c, lost);
+		}
+		return;
+	}
+	entry& e = c->ring[at.slot];
+	e.block = block;
+	e.length = block != NONE ? static_cast<uint32_t>(text.size()) : 0;
+	c->blocks += blocks_for(e.length);
+}
+
+void message_cache::on_delete(snowflake id) {
+	location* l = m_index.find(id);
+	if (l == nullptr) return;
+	channel& c = *m_channels.find(l->channel_id);
+	entry& e = c.ring[l->slot];
+	free_blocks(c, e);
+	//The slot stays taken until the ring comes around to it
+	e.id = snowflake();
+	e.author_id = snowflake();
+	c.messages--;
+	m_index.erase(id);
+}
+
+void message_cache::drop_channel(snowflake id) {
+	channel* c = m_channels.find(id);
+	if (c == nullptr) return;
+	while (c->count > 0) pop_oldest(*c);
+	m_channels.erase(id);
+	m_hand = 0;
+}
+
+uint32_t message_cache::store(const std::string& content) {
+	size_t n = blocks_for(content.size());
+	if (n == 0) return NONE;
+
+	while (m_free_count < n) {
+		uint32_t first = static_cast<uint32_t>(m_chunks.size() * BLOCKS_PER_CHUNK);
+		m_chunks.emplace_back(new char[BLOCKS_PER_CHUNK * BLOCK_SIZE]);
+		m_next.resize(m_next.size() + BLOCKS_PER_CHUNK);
+		for (uint32_t b = first + BLOCKS_PER_CHUNK; b-- > first;) {
+			m_next[b] = m_free;
+			m_free = b;
+		}
+		m_free_count += BLOCKS_PER_CHUNK;
+	}
+
+	uint32_t first = m_free;
+	uint32_t last = NONE;
+	const char* src = content.data();
+	size_t remaining = content.size();
+	for (size_t i = 0; i < n; i++) {
+		last = m_free;
+		m_free = m_next[last];
+		size_t len = std::min(remaining, BLOCK_SIZE);
+		std::memcpy(block_data(last), src, len);
+		src += len;
+		remaining -= len;
+	}
+	m_next[last] = NONE;
+	m_free_count -= n;
+	m_used += n;
+	return first;
+}
+
+bool message_cache::make_room(size_t bytes, snowflake keep) {
+	if (bytes > m_budget) return false;
+	while (footprint() + bytes > m_budget) {
+		if (!evict(keep)) return false;
+	}
+	return true;
+}
+
+void message_cache::free_blocks(channel& c, entry& e) {
+	size_t n = 0;
+	uint32_t b = e.block;
+	while (b != NONE) {
+		uint32_t next = m_next[b];
+		m_next[b] = m_free;
+		m_free = b;
+		b = next;
+		n++;
+	}
+	m_free_count += n;
+	m_used -= n;
+	c.blocks -= n;
+	e.block = NONE;
+	e.length = 0;
+}
+
+void message_cache::pop_oldest(channel& c) {
+	entry& e = c.ring[c.head];
+	if (e.id) {
+		free_blocks(c, e);
+		m_index.erase(e.id);
+		c.messages--;
+	}
+	e = entry();
+	c.head = (c.head + 1) % m_ring_size;
+	c.count--;
+}
+
+bool message_cache::evict(snowflake keep) {
+	size_t total = footprint();
+	//The largest channel always holds at least the average, one turn of the hand finds a
+	//victim unless keep is the only channel
+	for (size_t visited = 0; visited <= m_channels.slot_count(); visited++, m_hand++) {
+		if (m_hand >= m_channels.slot_count()) m_hand = 0;
+		auto* s = m_channels.slot_at(m_hand);
+		if (s == nullptr) continue;
+		channel& c = s->second;
+		if (c.messages == 0) {
+			if (c.id == keep) continue;
+			drop_channel(c.id);
+			return true;
+		}
+		if ((m_channel_bytes + c.messages * INDEX_BYTES + c.blocks * BLOCK_SIZE) * m_channels.size() < total) continue;
+
+		size_t before = c.messages;
+		while (c.messages == before) pop_oldest(c);
+		m_evicted++;
+		if (c.messages == 0 && c.id != keep) drop_channel(c.id);
+		else m_hand++;
+		return true;
+	}
+	return false;
+}
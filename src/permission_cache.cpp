@@ -0,0 +1,147 @@
+#include <permission_cache.h>
+
+permission_cache::permission_cache() :
+	m_generations(new std::atomic<uint32_t>[GENERATION_SLOTS]()),
+	m_resets(0),
+	m_table(nullptr)
+{
+	m_tables.emplace_back(new table(INITIAL_SLOTS));
+	m_table.store(m_tables.back().get(), std::memory_order_release);
+}
+
+bool permission_cache::find(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t& perms, stamp& s) const {
+	s = current(guild_id, user_id, channel_id);
+	uint64_t high = static_cast<uint64_t>(s.reset) << 32 | s.guild;
+	uint64_t low = static_cast<uint64_t>(s.channel) << 32 | s.member;
+	const slot* set = m_table.load(std::memory_order_acquire)->set_of(guild_id, user_id, channel_id);
+	for (size_t w = 0; w < WAYS; w++) {
+		//The key and stamp are compared on the slot itself, nothing is copied out of it
+		const slot& sl = set[w];
+		uint32_t before = sl.sequence.load(std::memory_order_acquire);
+		if (sl.user_id.load(std::memory_order_relaxed) != user_id.value()
+			|| sl.channel_id.load(std::memory_order_relaxed) != channel_id.value()
+			|| sl.guild_id.load(std::memory_order_relaxed) != guild_id.value()
+			|| sl.at_high.load(std::memory_order_relaxed) != high
+			|| sl.at_low.load(std::memory_order_relaxed) != low) continue;
+		uint64_t p = sl.perms.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if ((before & 1) || sl.sequence.load(std::memory_order_relaxed) != before) continue;
+		perms = p;
+		return true;
+	}
+	return false;
+}
+
+void permission_cache::store(snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t perms, const stamp& s) {
+	//Stored anyway, an invalidation between this check and the write leaves it stale
+	if (!user_id || s != current(guild_id, user_id, channel_id)) return;
+	entry e;
+	e.guild_id = guild_id;
+	e.channel_id = channel_id;
+	e.user_id = user_id;
+	e.perms = perms;
+	e.at = s;
+	table* t = m_table.load(std::memory_order_acquire);
+	if (place(*t, e, t->capacity >= MAX_ENTRIES)) return;
+	grow(t);
+	place(*m_table.load(std::memory_order_acquire), e, true);
+}
+
+void permission_cache::invalidate_guild(snowflake guild_id) {
+	generation_of(guild_id).fetch_add(1, std::memory_order_acq_rel);
+}
+
+void permission_cache::invalidate_channel(snowflake channel_id) {
+	generation_of(channel_id).fetch_add(1, std::memory_order_acq_rel);
+}
+
+void permission_cache::invalidate_member(snowflake guild_id, snowflake user_id) {
+	generation_of(guild_id, user_id).fetch_add(1, std::memory_order_acq_rel);
+}
+
+void permission_cache::clear() {
+	m_resets.fetch_add(1, std::memory_order_acq_rel);
+}
+
+size_t permission_cache::size() const {
+	const table* t = m_table.load(std::memory_order_acquire);
+	size_t n = 0;
+	entry e;
+	for (size_t i = 0; i < t->capacity; i++) {
+		if (read(t->slots[i], e) && e.user_id && is_current(e)) n++;
+	}
+	return n;
+}
+
+size_t permission_cache::capacity() const {
+	return m_table.load(std::memory_order_acquire)->capacity;
+}
+
+bool permission_cache::read(const slot& sl, entry& e) {
+	uint32_t before = sl.sequence.load(std::memory_order_acquire);
+	if (before & 1) return false;
+	e.guild_id = snowflake(sl.guild_id.load(std::memory_order_relaxed));
+	e.channel_id = snowflake(sl.channel_id.load(std::memory_order_relaxed));
+	e.user_id = snowflake(sl.user_id.load(std::memory_order_relaxed));
+	e.perms = sl.perms.load(std::memory_order_relaxed);
+	uint64_t high = sl.at_high.load(std::memory_order_relaxed);
+	uint64_t low = sl.at_low.load(std::memory_order_relaxed);
+	//The fields are read before the sequence is checked again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (sl.sequence.load(std::memory_order_relaxed) != before) return false;
+	e.at.reset = static_cast<uint32_t>(high >> 32);
+	e.at.guild = static_cast<uint32_t>(high);
+	e.at.channel = static_cast<uint32_t>(low >> 32);
+	e.at.member = static_cast<uint32_t>(low);
+	return true;
+}
+
+bool permission_cache::write(slot& sl, const entry& e) {
+	uint32_t before = sl.sequence.load(std::memory_order_relaxed);
+	if ((before & 1) || !sl.sequence.compare_exchange_strong(before, before + 1, std::memory_order_acquire)) return false;
+	//The odd sequence is visible before any field changes
+	std::atomic_thread_fence(std::memory_order_release);
+	sl.guild_id.store(e.guild_id.value(), std::memory_order_relaxed);
+	sl.channel_id.store(e.channel_id.value(), std::memory_order_relaxed);
+	sl.user_id.store(e.user_id.value(), std::memory_order_relaxed);
+	sl.perms.store(e.perms, std::memory_order_relaxed);
+	sl.at_high.store(static_cast<uint64_t>(e.at.reset) << 32 | e.at.guild, std::memory_order_relaxed);
+	sl.at_low.store(static_cast<uint64_t>(e.at.channel) << 32 | e.at.member, std::memory_order_relaxed);
+	sl.sequence.store(before + 2, std::memory_order_release);
+	return true;
+}
+
+bool permission_cache::place(table& t, const entry& e, bool evict) {
+	slot* set = t.set_of(e.guild_id, e.user_id, e.channel_id);
+	slot* free = nullptr;
+	entry old;
+	for (size_t w = 0; w < WAYS; w++) {
+		//A slot being written is skipped, at worst the key ends up twice in the set
+		if (!read(set[w], old)) continue;
+		if (old.user_id == e.user_id && old.guild_id == e.guild_id && old.channel_id == e.channel_id) {
+			write(set[w], e);
+			return true;
+		}
+		if (free == nullptr && (!old.user_id || !is_current(old))) free = &set[w];
+	}
+	if (free == nullptr) {
+		if (!evict) return false;
+		free = &set[e.user_id.hash() % WAYS];
+	}
+	write(*free, e);
+	return true;
+}
+
+void permission_cache::grow(table* t) {
+	std::lock_guard<std::mutex> guard(m_grow_lock);
+	//Another store grew it first
+	if (m_table.load(std::memory_order_relaxed) != t) return;
+	std::unique_ptr<table> bigger(new table(t->capacity * 2));
+	entry e;
+	for (size_t i = 0; i < t->capacity; i++) {
+		if (read(t->slots[i], e) && e.user_id && is_current(e)) place(*bigger, e, false);
+	}
+	//Stores into t from here on are lost, they are only missed once more
+	m_table.store(bigger.get(), std::memory_order_release);
+	m_tables.push_back(std::move(bigger));
+}
@@ -0,0 +1,27 @@
+#include <presence_state.h>
+#include <etf.hpp>
+
+//Discord allows 5 presence updates per minute
+const std::chrono::milliseconds presence_state::PRESENCE_WINDOW = std::chrono::milliseconds(12000);
+
+presence_state::presence_state() :
+	m_version(0)
+{}
+
+void presence_state::set(const nlohmann::json& gateway_json) {
+	std::string json = gateway_json.dump();
+	std::string etf = etf::encode(gateway_json);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_json = std::move(json);
+	m_etf = std::move(etf);
+	m_version++;
+}
+
+bool presence_state::get_if_newer(uint64_t& version, bool etf, std::string& out) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (version == m_version) return false;
+	out = etf ? m_etf : m_json;
+	version = m_version;
+	return true;
+}
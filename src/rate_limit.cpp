@@ -1 +1,40 @@
-#include <rate_limit.h>
\ No newline at end of file
+#include <rate_limit.h>
+#include <algorithm>
+
+sliding_window::sliding_window(unsigned int limit, std::chrono::milliseconds period) :
+	m_times(std::max(limit, 1u)),
+	m_first(0),
+	m_count(0),
+	m_period(period)
+{}
+
+bool sliding_window::try_take(unsigned int reserved) {
+	clock::time_point now = clock::now();
+	expire(now);
+	if (m_count + reserved >= m_times.size()) return false;
+	m_times[(m_first + m_count) % m_times.size()] = now;
+	m_count++;
+	return true;
+}
+
+std::chrono::milliseconds sliding_window::time_until_available(unsigned int reserved) {
+	clock::time_point now = clock::now();
+	expire(now);
+	if (reserved >= m_times.size()) return std::chrono::milliseconds::max();
+	if (m_count + reserved < m_times.size()) return std::chrono::milliseconds(0);
+	//Operations have to leave the window until reserved + 1 are free
+	size_t leaving = m_count + reserved + 1 - m_times.size();
+	clock::time_point at = m_times[(m_first + leaving - 1) % m_times.size()] + m_period;
+	return std::chrono::ceil<std::chrono::milliseconds>(at - now);
+}
+
+unsigned int sliding_window::get_limit() const {
+	return static_cast<unsigned int>(m_times.size());
+}
+
+void sliding_window::expire(clock::time_point now) {
+	while (m_count > 0 && now - m_times[m_first] >= m_period) {
+		m_first = (m_first + 1) % m_times.size();
+		m_count--;
+	}
+}
@@ -0,0 +1,85 @@
+#include <rcu.h>
+#include <stdexcept>
+
+rcu::slot rcu::s_slots[rcu::MAX_READERS];
+std::atomic<uint64_t> rcu::s_epoch(1);
+std::mutex rcu::s_retired_lock;
+std::vector<rcu::retired> rcu::s_retired;
+
+rcu::read_guard::read_guard() {
+	enter();
+}
+
+rcu::read_guard::~read_guard() {
+	leave();
+}
+
+rcu::thread_slot::~thread_slot() {
+	if (s == nullptr) return;
+	s->epoch.store(0, std::memory_order_release);
+	s->used.store(false, std::memory_order_release);
+}
+
+rcu::thread_slot& rcu::local() {
+	static thread_local thread_slot t;
+	return t;
+}
+
+void rcu::enter() {
+	thread_slot& t = local();
+	if (t.depth++ > 0) return;
+	if (t.s == nullptr) {
+		for (slot& s : s_slots) {
+			bool used = false;
+			if (s.used.compare_exchange_strong(used, true)) {
+				t.s = &s;
+				break;
+			}
+		}
+		if (t.s == nullptr) {
+			t.depth--;
+			throw std::runtime_error("rcu: more than MAX_READERS reading threads");
+		}
+	}
+	t.s->epoch.store(s_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+	//The announcement must be visible before any pointer is read, pairs with the fence in reclaim
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void rcu::leave() {
+	thread_slot& t = local();
+	if (--t.depth > 0) return;
+	t.s->epoch.store(0, std::memory_order_release);
+}
+
+void rcu::retire(void* p, void (*deleter)(void*)) {
+	std::lock_guard<std::mutex> guard(s_retired_lock);
+	//Readers announcing a later epoch started after p was unlinked
+	s_retired.push_back(retired{ p, deleter, s_epoch.fetch_add(1, std::memory_order_seq_cst) });
+}
+
+void rcu::reclaim() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint64_t oldest = UINT64_MAX;
+	for (const slot& s : s_slots) {
+		uint64_t e = s.epoch.load(std::memory_order_acquire);
+		if (e != 0 && e < oldest) oldest = e;
+	}
+
+	std::vector<retired> ready;
+	{
+		std::lock_guard<std::mutex> guard(s_retired_lock);
+		auto keep = s_retired.begin();
+		for (auto it = s_retired.begin(); it != s_retired.end(); ++it) {
+			if (it->epoch < oldest) ready.push_back(*it);
+			else *keep++ = *it;
+		}
+		s_retired.erase(keep, s_retired.end());
+	}
+	for (const retired& r : ready) r.deleter(r.p);
+}
+
+size_t rcu::pending() {
+	std::lock_guard<std::mutex> guard(s_retired_lock);
+	return s_retired.size();
+}
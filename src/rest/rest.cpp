@@ -13,8 +13,7 @@ rest::~rest() {
 
 void rest::open() { m_hsocket->connect_to(m_host, m_port); }
 
-nlohmann::json rest::send(method& method, const std::string& route, const nlohmann::json& h, const nlohmann::json& data) {
-	if (!m_hsocket->is_connected()) return {};
+nlohmann::json rest::send(const method& method, const std::string& route, const nlohmann::json& h, const nlohmann::json& data) {
 	std::string headers;
 	for (auto& i : h.items()) {
 		std::string v = i.value().dump();
@@ -25,8 +24,11 @@ nlohmann::json rest::send(method& method, const std::string& route, const nlohma
 	return send(method, route, headers, data.dump());
 }
 
-nlohmann::json rest::send(method& method, const std::string& route, const std::string& headers, const std::string& data) {
-	std::string request = handle_request(method, m_host, route, headers, data);
+nlohmann::json rest::send(const method& method, const std::string& route, const std::string& headers, const std::string& data) {
+	//One socket is shared by every caller, a request and its response must not interleave with another
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (!m_hsocket->is_connected()) return {};
+	const std::string& request = handle_request(method, m_host, route, headers, data);
 	m_hsocket->write(request.c_str(), request.size());
 	std::cout << "RestAPI [Request]: \n\n" << request << "\n";
 	nlohmann::json response = handle_response(m_hsocket->read_to_string());
@@ -0,0 +1,64 @@
+#include <rest/rest_pool.h>
+#include <algorithm>
+
+rest_pool::rest_pool(const std::string& host, size_t size, const short& port) {
+	size = std::max<size_t>(size, 1);
+	for (size_t i = 0; i < size; i++) m_connections.push_back(new rest(host, port));
+	m_idle = m_connections;
+}
+
+rest_pool::~rest_pool() {
+	for (rest* r : m_connections) delete r;
+}
+
+void rest_pool::open() {
+	for (rest* r : m_connections) r->open();
+}
+
+void rest_pool::close() {
+	for (rest* r : m_connections) r->close();
+}
+
+nlohmann::json rest_pool::send(const method& method, const std::string& route, const nlohmann::json& headers, const nlohmann::json& data) {
+	rest* r = lease();
+	nlohmann::json response;
+	try {
+		response = r->send(method, route, headers, data);
+	}
+	catch (...) {
+		release(r);
+		throw;
+	}
+	release(r);
+	return response;
+}
+
+nlohmann::json rest_pool::send(const method& method, const std::string& route, const std::string& headers, const std::string& data) {
+	rest* r = lease();
+	nlohmann::json response;
+	try {
+		response = r->send(method, route, headers, data);
+	}
+	catch (...) {
+		release(r);
+		throw;
+	}
+	release(r);
+	return response;
+}
+
+rest* rest_pool::lease() {
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_available.wait(lock, [this]() { return !m_idle.empty(); });
+	rest* r = m_idle.back();
+	m_idle.pop_back();
+	return r;
+}
+
+void rest_pool::release(rest* r) {
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_idle.push_back(r);
+	}
+	m_available.notify_one();
+}
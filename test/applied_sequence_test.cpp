@@ -0,0 +1,81 @@
+#include "check.hpp"
+#include <cache_snapshot.h>
+#include <stdexcept>
+
+/*
+ * The applied sequence must never pass an event a worker has not finished, whatever
+ * the order the workers finish in.
+ */
+namespace {
+
+	void test_out_of_order() {
+		applied_sequence applied;
+		applied.reset(10);
+		applied.start(11);
+		applied.start(12);
+		applied.skip(13);
+		applied.start(14);
+		CHECK(applied.get() == 10);
+
+		applied.finish(12);
+		CHECK(applied.get() == 10);
+		applied.finish(14);
+		CHECK(applied.get() == 10);
+
+		//13 was dropped and 14 finished, both are behind 11
+		applied.finish(11);
+		CHECK(applied.get() == 14);
+	}
+
+	void test_skip_when_idle() {
+		applied_sequence applied;
+		applied.skip(1);
+		applied.skip(2);
+		CHECK(applied.get() == 2);
+		applied.start(3);
+		applied.skip(4);
+		CHECK(applied.get() == 2);
+		applied.finish(3);
+		CHECK(applied.get() == 4);
+	}
+
+	void test_reset() {
+		applied_sequence applied;
+		applied.start(5);
+		applied.reset(0);
+		//An event of the old session finishing late changes nothing
+		applied.finish(5);
+		CHECK(applied.get() == 0);
+	}
+
+	void test_finisher() {
+		applied_sequence applied;
+		applied.reset(0);
+		applied.start(1);
+		applied.start(2);
+		try {
+			applied_sequence::finisher f(&applied, 1);
+			//A malformed event, the cache update throws
+			throw std::runtime_error("bad id");
+		}
+		catch (const std::runtime_error&) {
+		}
+		{
+			applied_sequence::finisher f(&applied, 2);
+			f.finish();
+			CHECK(applied.get() == 2);
+		}
+		//Finished once only
+		applied.start(3);
+		CHECK(applied.get() == 2);
+	}
+
+}
+
+int main() {
+	test_out_of_order();
+	test_skip_when_idle();
+	test_reset();
+	test_finisher();
+	return failures();
+}
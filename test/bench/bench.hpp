@@ -0,0 +1,40 @@
+#ifndef TEST_BENCH
+#define TEST_BENCH
+
+#include <chrono>
+#include <cstdio>
+#include <atomic>
+
+/*
+ * The benchmarks are plain programs built with the tests but not run by ctest, they
+ * print their results. Every measure is the best of a few runs.
+ */
+namespace bench {
+
+	typedef std::chrono::steady_clock clock;
+
+	/**
+	 * @return The shortest time in seconds f took over runs calls.
+	 */
+	template<class F> double best_of(int runs, F f) {
+		double best = 1e300;
+		for (int i = 0; i < runs; i++) {
+			clock::time_point start = clock::now();
+			f();
+			double s = std::chrono::duration<double>(clock::now() - start).count();
+			if (s < best) best = s;
+		}
+		return best;
+	}
+
+	/**
+	 * Keep a result alive so the work producing it is not optimized out.
+	 */
+	template<class T> void keep(const T& value) {
+		static std::atomic<size_t> sink;
+		sink.fetch_add(static_cast<size_t>(value), std::memory_order_relaxed);
+	}
+
+}
+
+#endif
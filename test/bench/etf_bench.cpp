@@ -0,0 +1,162 @@
+#include "bench.hpp"
+#include <etf.hpp>
+#include <gateway_events.hpp>
+#include <misc/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Decode time and size of the same events with encoding=json and encoding=etf, as a
+ * whole DOM and the way the bot reads them: the envelope, the strand key and, for the
+ * events that have one, the typed struct.
+ * The corpus is synthetic: MESSAGE_CREATE, GUILD_MEMBER_ADD and PRESENCE_UPDATE events
+ * shaped like the ones the gateway sends, ids as strings in JSON and integers in ETF,
+ * keys as atoms in ETF like the gateway writes them (etf::encoder writes binaries).
+ */
+namespace {
+
+	std::mt19937_64 rng(42);
+
+	std::string id() {
+		return std::to_string(80351110224678912ull + rng() % 1000000000000000ull);
+	}
+
+	std::string text(size_t n) {
+		static const char* WORDS[] = { "the", "gateway", "sends", "a", "message", "to", "every", "shard", "with", "\"quotes\"", "and", "caf\xC3\xA9" };
+		std::string s;
+		while (s.size() < n) {
+			if (!s.empty()) s += ' ';
+			s += WORDS[rng() % 12];
+		}
+		return s;
+	}
+
+	nlohmann::json user() {
+		return { {"id", id()}, {"username", text(8)}, {"discriminator", "0420"}, {"avatar", "a_1269e74af4df7417b13759eae50c83dc"}, {"bot", false} };
+	}
+
+	nlohmann::json make_event(int i) {
+		nlohmann::json d;
+		const char* t;
+		switch (i % 3) {
+		case 0:
+			t = "MESSAGE_CREATE";
+			d = { {"id", id()}, {"channel_id", id()}, {"guild_id", id()}, {"author", user()}, {"content", text(20 + rng() % 200)},
+				{"timestamp", "2020-04-01T12:00:00.000000+00:00"}, {"edited_timestamp", nullptr}, {"tts", false},
+				{"mention_everyone", false}, {"mention_roles", { id(), id() }}, {"pinned", false}, {"type", 0} };
+			break;
+		case 1:
+			t = "GUILD_MEMBER_ADD";
+			d = { {"user", user()}, {"guild_id", id()}, {"nick", nullptr}, {"roles", { id(), id(), id() }},
+				{"joined_at", "2020-04-01T12:00:00.000000+00:00"}, {"deaf", false}, {"mute", false} };
+			break;
+		default:
+			t = "PRESENCE_UPDATE";
+			d = { {"user", { {"id", id()} }}, {"guild_id", id()}, {"status", "online"},
+				{"game", { {"name", text(12)}, {"type", 0}, {"created_at", 1585742400000} }}, {"roles", { id() }} };
+			break;
+		}
+		return { {"op", 0}, {"s", i + 1}, {"t", t}, {"d", d} };
+	}
+
+	//The ETF gateway sends snowflakes as integers
+	void ids_to_integers(nlohmann::json& j) {
+		if (j.is_object()) {
+			for (auto& i : j.items()) {
+				const std::string& key = i.key();
+				bool is_id = key == "id" || (key.size() > 3 && key.compare(key.size() - 3, 3, "_id") == 0) || key == "roles" || key == "mention_roles";
+				if (is_id && i.value().is_string()) i.value() = std::stoull(i.value().get<std::string>());
+				else if (is_id && i.value().is_array()) {
+					for (nlohmann::json& e : i.value()) e = std::stoull(e.get<std::string>());
+				}
+				else ids_to_integers(i.value());
+			}
+		}
+		else if (j.is_array()) {
+			for (nlohmann::json& e : j) ids_to_integers(e);
+		}
+	}
+
+	//What the bot does with a frame that goes to a typed handler
+	size_t read_typed(const std::string& frame, bool etf) {
+		gateway_envelope env;
+		bool ok = etf ? gateway_envelope::peek_etf(frame, env) : gateway_envelope::peek(frame, env);
+		size_t n = ok ? static_cast<size_t>(event_decoder::find_id(env, "guild_id").value() & 1) : 0;
+		if (env.t == "MESSAGE_CREATE") {
+			message_event m;
+			n += event_decoder::decode(env, m) ? m.content.size() : 0;
+		}
+		else if (env.t == "GUILD_MEMBER_ADD") {
+			member_event m;
+			n += event_decoder::decode(env, m) ? m.roles.size() : 0;
+		}
+		return n;
+	}
+
+	void u32(std::string& out, uint32_t v) {
+		for (int shift = 24; shift >= 0; shift -= 8) out += static_cast<char>(v >> shift);
+	}
+
+	void gateway_term(std::string& out, const nlohmann::json& j) {
+		if (j.is_object()) {
+			out += static_cast<char>(etf::MAP_EXT);
+			u32(out, static_cast<uint32_t>(j.size()));
+			for (auto& i : j.items()) {
+				out += static_cast<char>(etf::SMALL_ATOM_UTF8_EXT);
+				out += static_cast<char>(i.key().size());
+				out += i.key();
+				gateway_term(out, i.value());
+			}
+		}
+		else if (j.is_array()) {
+			if (!j.empty()) {
+				out += static_cast<char>(etf::LIST_EXT);
+				u32(out, static_cast<uint32_t>(j.size()));
+				for (const nlohmann::json& e : j) gateway_term(out, e);
+			}
+			out += static_cast<char>(etf::NIL_EXT);
+		}
+		else {
+			//Scalars are written as etf::encoder does, without the version byte
+			out += etf::encode(j).substr(1);
+		}
+	}
+
+}
+
+int main() {
+	const int EVENTS = 30000;
+	std::vector<std::string> json_frames, etf_frames;
+	size_t json_bytes = 0, etf_bytes = 0;
+
+	for (int i = 0; i < EVENTS; i++) {
+		nlohmann::json e = make_event(i);
+		json_frames.push_back(e.dump());
+		ids_to_integers(e);
+		etf_frames.emplace_back(1, static_cast<char>(etf::FORMAT_VERSION));
+		gateway_term(etf_frames.back(), e);
+		json_bytes += json_frames.back().size();
+		etf_bytes += etf_frames.back().size();
+	}
+
+	double json_s = bench::best_of(5, [&]() {
+		for (const std::string& f : json_frames) bench::keep(nlohmann::json::parse(f).size());
+	});
+	double etf_s = bench::best_of(5, [&]() {
+		for (const std::string& f : etf_frames) bench::keep(etf::decode(f).size());
+	});
+
+	double json_typed_s = bench::best_of(5, [&]() {
+		for (const std::string& f : json_frames) bench::keep(read_typed(f, false));
+	});
+	double etf_typed_s = bench::best_of(5, [&]() {
+		for (const std::string& f : etf_frames) bench::keep(read_typed(f, true));
+	});
+
+	std::printf("%d events, DOM and typed ns/event\n", EVENTS);
+	std::printf("json  %9zu bytes  dom %8.1f ns  %7.1f MB/s  typed %7.1f ns\n", json_bytes, json_s * 1e9 / EVENTS, json_bytes / json_s / 1e6, json_typed_s * 1e9 / EVENTS);
+	std::printf("etf   %9zu bytes  dom %8.1f ns  %7.1f MB/s  typed %7.1f ns\n", etf_bytes, etf_s * 1e9 / EVENTS, etf_bytes / etf_s / 1e6, etf_typed_s * 1e9 / EVENTS);
+	std::printf("etf/json  size %.2f  dom time %.2f  typed time %.2f\n", double(etf_bytes) / json_bytes, etf_s / json_s, etf_typed_s / json_typed_s);
+	return 0;
+}
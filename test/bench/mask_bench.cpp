@@ -0,0 +1,54 @@
+#include "bench.hpp"
+#include <websocketpp/frame.cpp>
+#include <string>
+#include <vector>
+
+/*
+ * Masking throughput of the byte loop hybi13 used and of each kernel, from 16 B frames
+ * to 1 MB ones, in place and from an odd address as payloads come in a frame buffer.
+ */
+namespace {
+
+	using namespace frame;
+
+	struct kernel {
+		const char*	name;
+		mask_kernel	mask;
+	};
+
+	void byte_loop(uint8_t const * input, uint8_t * output, size_t length, uint32_t key) {
+		masking_key_type k;
+		k.i = key;
+		byte_mask(input, input + length, output, k, 0);
+	}
+
+}
+
+int main() {
+	std::vector<kernel> kernels = { { "bytes", &byte_loop }, { "scalar", &simd::mask_scalar } };
+#ifdef _WEBSOCKETPP_SIMD_MASKING_
+	kernels.push_back({ "sse2", &simd::mask_sse2 });
+	if (cpu::has_avx2()) kernels.push_back({ "avx2", &simd::mask_avx2 });
+#endif
+
+	std::printf("%8s", "size");
+	for (const kernel& k : kernels) std::printf("  %8s GB/s", k.name);
+	std::printf("\n");
+
+	std::vector<uint8_t> buffer((1 << 20) + 1, 0x5A);
+	uint8_t* data = buffer.data() + 1;
+	for (size_t size = 16; size <= (1 << 20); size *= 4) {
+		//About 64 MB per measure, the small sizes repeated
+		size_t repeat = std::max<size_t>(1, (64 << 20) / size);
+		std::printf("%8zu", size);
+		for (const kernel& k : kernels) {
+			double s = bench::best_of(3, [&]() {
+				for (size_t i = 0; i < repeat; i++) k.mask(data, data, size, 0x12345678u + static_cast<uint32_t>(i));
+			});
+			bench::keep(data[size - 1]);
+			std::printf("  %13.2f", size * repeat / s / 1e9);
+		}
+		std::printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include "bench.hpp"
+#include <member_store.h>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Memory per member of member_store against a plain map of members with their own
+ * strings and role vectors, for a million synthetic members: 20 guilds, a user in one
+ * to three of them, a third with a nickname, most with an avatar, role sets drawn
+ * from a few per guild. The plain map is measured by counting what it allocates.
+ */
+namespace {
+
+	size_t allocated = 0;
+
+}
+
+namespace {
+
+	void* allocate(size_t size) {
+		allocated += size;
+		if (void* p = std::malloc(size ? size : 1)) return p;
+		throw std::bad_alloc();
+	}
+
+	void release(void* p) noexcept {
+		std::free(p);
+	}
+
+}
+
+void* operator new(size_t size) {
+	return allocate(size);
+}
+
+void* operator new[](size_t size) {
+	return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+	release(p);
+}
+
+void operator delete[](void* p) noexcept {
+	release(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	release(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	release(p);
+}
+
+namespace {
+
+	const size_t MEMBERS = 1000000;
+
+	const int GUILDS = 20;
+
+	struct plain_member {
+		std::string				username;
+		std::string				nick;
+		std::string				avatar;
+		std::vector<snowflake>	roles;
+		uint16_t				discriminator = 0;
+		bool					bot = false;
+	};
+
+	struct synthetic {
+		snowflake				guild_id;
+		snowflake				user_id;
+		std::string				username;
+		std::string				nick;
+		std::string				avatar;
+		std::vector<snowflake>	roles;
+		uint16_t				discriminator;
+	};
+
+	std::vector<synthetic> generate() {
+		std::mt19937_64 rng(39);
+		std::vector<synthetic> members;
+		members.reserve(MEMBERS);
+		for (uint64_t user = 1; members.size() < MEMBERS; user++) {
+			std::string username = "user" + std::to_string(rng() % 100000000);
+			std::string avatar;
+			if (rng() % 10 < 8) {
+				static const char* HEX = "0123456789abcdef";
+				for (int i = 0; i < 32; i++) avatar += HEX[rng() % 16];
+			}
+			int guilds = 1 + rng() % 3;
+			for (int g = 0; g < guilds && members.size() < MEMBERS; g++) {
+				synthetic m;
+				m.guild_id = snowflake(1000 + (user + g * 7) % GUILDS);
+				m.user_id = snowflake(80351110224678912ull + user);
+				m.username = username;
+				if (rng() % 3 == 0) m.nick = "nick " + std::to_string(rng() % 50000);
+				m.avatar = avatar;
+				//Eight role sets per guild, the first for most members
+				uint64_t set = rng() % 4 == 0 ? rng() % 8 : 0;
+				for (uint64_t r = 0; r <= set % 4; r++) m.roles.push_back(snowflake(m.guild_id.value() * 100 + set + r));
+				m.discriminator = static_cast<uint16_t>(rng() % 10000);
+				members.push_back(std::move(m));
+			}
+		}
+		return members;
+	}
+
+}
+
+int main() {
+	std::vector<synthetic> members = generate();
+
+	member_store store;
+	bench::clock::time_point start = bench::clock::now();
+	for (const synthetic& m : members) {
+		member_view view;
+		view.user_id = m.user_id;
+		view.username = m.username;
+		view.nick = m.nick;
+		view.avatar = m.avatar;
+		view.roles = m.roles.data();
+		view.role_count = m.roles.size();
+		view.discriminator = m.discriminator;
+		store.restore(m.guild_id, view);
+	}
+	double store_s = std::chrono::duration<double>(bench::clock::now() - start).count();
+
+	size_t before = allocated;
+	std::unordered_map<member_key, plain_member, member_key_hash> plain;
+	start = bench::clock::now();
+	for (const synthetic& m : members) {
+		plain_member& p = plain[member_key{ m.guild_id, m.user_id }];
+		p.username = m.username;
+		p.nick = m.nick;
+		p.avatar = m.avatar;
+		p.roles = m.roles;
+		p.discriminator = m.discriminator;
+	}
+	double plain_s = std::chrono::duration<double>(bench::clock::now() - start).count();
+	size_t plain_bytes = allocated - before;
+
+	std::printf("%zu members in %d guilds\n", store.size(), GUILDS);
+	std::printf("member_store  %6.1f MB  %5.1f bytes/member  %5.0f ns/insert\n", store.memory_usage() / 1e6, double(store.memory_usage()) / store.size(), store_s * 1e9 / store.size());
+	std::printf("plain map     %6.1f MB  %5.1f bytes/member  %5.0f ns/insert\n", plain_bytes / 1e6, double(plain_bytes) / plain.size(), plain_s * 1e9 / plain.size());
+	return 0;
+}
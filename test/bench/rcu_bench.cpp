@@ -0,0 +1,109 @@
+#include "bench.hpp"
+#include <rcu_map.hpp>
+#include <snowflake.hpp>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Read throughput of an rcu_map from 1 to 32 threads while a writer keeps replacing
+ * values, against the shared_mutex guarded map the cache read through before. Readers
+ * look up random channels of a 10k channel map and read a field of the value, as the
+ * visit_ methods do. Scaling needs as many cores as readers.
+ */
+namespace {
+
+	const int KEYS = 10000;
+
+	const std::chrono::milliseconds DURATION(300);
+
+	struct channel {
+		snowflake		id;
+		snowflake		guild_id;
+		std::string		name;
+		uint64_t		position = 0;
+	};
+
+	channel make(int i, uint64_t version) {
+		return channel{ snowflake(1000 + i), snowflake(1), "channel-" + std::to_string(i), version };
+	}
+
+	struct locked_map {
+		mutable std::shared_mutex					lock;
+		std::unordered_map<snowflake, channel>		map;
+	};
+
+	/**
+	 * @return Reads per second over all readers, with one writer running meanwhile.
+	 */
+	template<class Read, class Write> double measure(int readers, Read read, Write write) {
+		std::atomic<bool> stop(false);
+		std::atomic<uint64_t> reads(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < readers; t++) {
+			threads.emplace_back([&, t]() {
+				uint64_t x = 0x9E3779B97F4A7C15ULL * (t + 1), n = 0, sum = 0;
+				while (!stop.load(std::memory_order_relaxed)) {
+					for (int i = 0; i < 256; i++) {
+						x ^= x << 13;
+						x ^= x >> 7;
+						x ^= x << 17;
+						sum += read(snowflake(1000 + x % KEYS));
+					}
+					n += 256;
+				}
+				reads += n;
+				bench::keep(sum);
+			});
+		}
+		std::thread writer([&]() {
+			for (uint64_t version = 0; !stop.load(std::memory_order_relaxed); version++) write(static_cast<int>(version % KEYS), version);
+		});
+		bench::clock::time_point start = bench::clock::now();
+		std::this_thread::sleep_for(DURATION);
+		stop = true;
+		for (std::thread& t : threads) t.join();
+		writer.join();
+		return reads / std::chrono::duration<double>(bench::clock::now() - start).count();
+	}
+
+}
+
+int main() {
+	rcu_map<snowflake, channel> rcu_channels;
+	locked_map locked;
+	for (int i = 0; i < KEYS; i++) {
+		rcu_channels.assign(snowflake(1000 + i), make(i, 0));
+		locked.map[snowflake(1000 + i)] = make(i, 0);
+	}
+
+	std::printf("%u hardware threads, one writer\n", std::thread::hardware_concurrency());
+	std::printf("%7s  %14s  %16s\n", "readers", "rcu Mreads/s", "locked Mreads/s");
+	for (int readers = 1; readers <= 32; readers *= 2) {
+		double rcu_rate = measure(readers, [&](snowflake id) -> uint64_t {
+			rcu::read_guard guard;
+			const channel* c = rcu_channels.find(id);
+			return c != nullptr ? c->position : 0;
+		}, [&](int i, uint64_t version) {
+			rcu_channels.assign(snowflake(1000 + i), make(i, version));
+			if (version % 64 == 0) rcu::reclaim();
+		});
+		rcu::reclaim();
+
+		double locked_rate = measure(readers, [&](snowflake id) -> uint64_t {
+			std::shared_lock<std::shared_mutex> guard(locked.lock);
+			auto it = locked.map.find(id);
+			return it != locked.map.end() ? it->second.position : 0;
+		}, [&](int i, uint64_t version) {
+			std::unique_lock<std::shared_mutex> guard(locked.lock);
+			locked.map[snowflake(1000 + i)] = make(i, version);
+		});
+
+		std::printf("%7d  %14.1f  %16.1f\n", readers, rcu_rate / 1e6, locked_rate / 1e6);
+	}
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include "bench.hpp"
+#include <cache_snapshot.h>
+#include <entity_cache.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Cold start of a cache of 500k entities: 50 guilds of 150 channels, 50 roles and 9800
+ * members. Loading the snapshot file against applying the GUILD_CREATE events the
+ * gateway would send otherwise, parsing included.
+ */
+namespace {
+
+	const int GUILDS = 50;
+
+	const int CHANNELS = 150;
+
+	const int ROLES = 50;
+
+	const int MEMBERS = 9800;
+
+	std::string id(uint64_t n) {
+		return std::to_string(80351110224678912ull + n);
+	}
+
+	std::string guild_create(int g) {
+		uint64_t base = static_cast<uint64_t>(g) * 100000;
+		nlohmann::json d = { {"id", id(base)}, {"name", "guild " + std::to_string(g)}, {"owner_id", id(base + 99999)}, {"member_count", MEMBERS} };
+		nlohmann::json& roles = d["roles"] = nlohmann::json::array();
+		for (int r = 0; r < ROLES; r++) {
+			roles.push_back({ {"id", r == 0 ? id(base) : id(base + 1 + r)}, {"name", "role " + std::to_string(r)}, {"permissions", "104324673"}, {"color", r * 1000}, {"position", r} });
+		}
+		nlohmann::json& channels = d["channels"] = nlohmann::json::array();
+		for (int c = 0; c < CHANNELS; c++) {
+			nlohmann::json overwrites = { { {"id", id(base + 1 + c % ROLES)}, {"type", "role"}, {"allow", "1024"}, {"deny", "2048"} } };
+			channels.push_back({ {"id", id(base + 1000 + c)}, {"name", "channel-" + std::to_string(c)}, {"type", 0}, {"position", c}, {"permission_overwrites", overwrites} });
+		}
+		nlohmann::json& members = d["members"] = nlohmann::json::array();
+		for (int m = 0; m < MEMBERS; m++) {
+			uint64_t user = 10000000 + (static_cast<uint64_t>(g) * 7919 + m * 31) % 400000;
+			nlohmann::json member = { {"user", { {"id", id(user)}, {"username", "user" + std::to_string(user)}, {"discriminator", "0420"}, {"avatar", nullptr} }},
+				{"roles", { id(base + 1 + m % 5) }}, {"joined_at", "2020-04-01T12:00:00.000000+00:00"}, {"deaf", false}, {"mute", false} };
+			if (m % 3 == 0) member["nick"] = "nick " + std::to_string(m);
+			members.push_back(member);
+		}
+		return d.dump();
+	}
+
+}
+
+int main() {
+	std::vector<std::string> events;
+	size_t event_bytes = 0;
+	for (int g = 0; g < GUILDS; g++) {
+		events.push_back(guild_create(g));
+		event_bytes += events.back().size();
+	}
+	const int ENTITIES = GUILDS * (1 + CHANNELS + ROLES + MEMBERS);
+
+	double events_s = bench::best_of(3, [&]() {
+		std::unique_ptr<entity_cache> cache(new entity_cache());
+		for (const std::string& e : events) cache->update(event::GUILD_CREATE, nlohmann::json::parse(e));
+		bench::keep(cache->get_memory_stats().members);
+	});
+
+	std::unique_ptr<entity_cache> cache(new entity_cache());
+	for (const std::string& e : events) cache->update(event::GUILD_CREATE, nlohmann::json::parse(e));
+	const std::string path = "snapshot_bench.bin";
+	cache_snapshot check;
+	if (!cache_snapshot::save(path, cache.get(), "session", 1, 0, 1) || !check.open(path, 0, 1)) {
+		std::printf("could not write %s\n", path.c_str());
+		return 1;
+	}
+	check.close();
+	size_t members = cache->get_memory_stats().members;
+
+	long file_bytes = 0;
+	if (FILE* f = std::fopen(path.c_str(), "rb")) {
+		std::fseek(f, 0, SEEK_END);
+		file_bytes = std::ftell(f);
+		std::fclose(f);
+	}
+	double load_s = bench::best_of(5, [&]() {
+		std::unique_ptr<entity_cache> loaded(new entity_cache());
+		cache_snapshot snapshot;
+		snapshot.open(path, 0, 1);
+		snapshot.load(*loaded);
+		bench::keep(loaded->get_memory_stats().members);
+	});
+	std::remove(path.c_str());
+
+	std::printf("%d entities, %zu members\n", ENTITIES, members);
+	std::printf("GUILD_CREATE events  %7.1f MB  %7.1f ms  %6.0f ns/entity\n", event_bytes / 1e6, events_s * 1e3, events_s * 1e9 / ENTITIES);
+	std::printf("snapshot load        %7.1f MB  %7.1f ms  %6.0f ns/entity\n", file_bytes / 1e6, load_s * 1e3, load_s * 1e9 / ENTITIES);
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include "bench.hpp"
+#include <gateway_events.hpp>
+#include <misc/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Decode time of the "d" of the hot events into their typed struct, straight with
+ * json_scanner against parsing a DOM first and reading the struct from it as the
+ * handlers did. The corpus is synthetic MESSAGE_CREATE, GUILD_MEMBER_ADD and
+ * MESSAGE_REACTION_ADD data shaped like the gateway's.
+ */
+namespace {
+
+	std::mt19937_64 rng(30);
+
+	std::string id() {
+		return std::to_string(80351110224678912ull + rng() % 1000000000000000ull);
+	}
+
+	std::string text(size_t n) {
+		static const char* WORDS[] = { "the", "gateway", "sends", "a", "message", "to", "every", "shard", "with", "\"quotes\"", "and", "caf\xC3\xA9" };
+		std::string s;
+		while (s.size() < n) {
+			if (!s.empty()) s += ' ';
+			s += WORDS[rng() % 12];
+		}
+		return s;
+	}
+
+	nlohmann::json user() {
+		return { {"id", id()}, {"username", text(8)}, {"discriminator", "0420"}, {"avatar", "a_1269e74af4df7417b13759eae50c83dc"}, {"bot", false} };
+	}
+
+	nlohmann::json message() {
+		return { {"id", id()}, {"channel_id", id()}, {"guild_id", id()}, {"author", user()}, {"content", text(20 + rng() % 200)},
+			{"timestamp", "2020-04-01T12:00:00.000000+00:00"}, {"edited_timestamp", nullptr}, {"tts", false},
+			{"mention_everyone", false}, {"mentions", nlohmann::json::array({ user() })}, {"mention_roles", { id(), id() }},
+			{"attachments", nlohmann::json::array()}, {"embeds", nlohmann::json::array()}, {"pinned", false}, {"type", 0} };
+	}
+
+	nlohmann::json member() {
+		return { {"user", user()}, {"guild_id", id()}, {"nick", nullptr}, {"roles", { id(), id(), id() }},
+			{"joined_at", "2020-04-01T12:00:00.000000+00:00"}, {"premium_since", nullptr}, {"deaf", false}, {"mute", false} };
+	}
+
+	nlohmann::json reaction() {
+		return { {"user_id", id()}, {"channel_id", id()}, {"message_id", id()}, {"guild_id", id()},
+			{"member", member()}, {"emoji", { {"id", nullptr}, {"name", "\xF0\x9F\x91\x8D"} }} };
+	}
+
+	//The DOM baseline, reading the struct from a parsed "d" as the handlers did
+
+	std::string_view text(const nlohmann::json& j, const char* key) {
+		if (!j.is_object() || !j.count(key) || !j[key].is_string()) return std::string_view();
+		return j[key].get_ref<const std::string&>();
+	}
+
+	snowflake id(const nlohmann::json& j, const char* key) {
+		if (!j.is_object() || !j.count(key)) return snowflake();
+		return j[key].get<snowflake>();
+	}
+
+	void decode_user_dom(const nlohmann::json& j, user_view& user) {
+		user.id = id(j, "id");
+		user.username = text(j, "username");
+		user.discriminator = text(j, "discriminator");
+		user.avatar = text(j, "avatar");
+		user.bot = j.is_object() && j.count("bot") && j["bot"].is_boolean() && j["bot"].get<bool>();
+	}
+
+	bool decode_dom(const nlohmann::json& d, message_event& m) {
+		if (!d.is_object()) return false;
+		m.id = id(d, "id");
+		m.channel_id = id(d, "channel_id");
+		m.guild_id = id(d, "guild_id");
+		m.content = text(d, "content");
+		m.timestamp = text(d, "timestamp");
+		if (d.count("author")) decode_user_dom(d["author"], m.author);
+		return true;
+	}
+
+	bool decode_dom(const nlohmann::json& d, member_event& m) {
+		if (!d.is_object()) return false;
+		m.guild_id = id(d, "guild_id");
+		m.nick = text(d, "nick");
+		m.joined_at = text(d, "joined_at");
+		if (d.count("user")) decode_user_dom(d["user"], m.user);
+		if (d.count("roles") && d["roles"].is_array()) {
+			for (const nlohmann::json& role : d["roles"]) m.roles.push_back(role.get<snowflake>());
+		}
+		return true;
+	}
+
+	bool decode_dom(const nlohmann::json& d, reaction_event& r) {
+		if (!d.is_object()) return false;
+		r.user_id = id(d, "user_id");
+		r.channel_id = id(d, "channel_id");
+		r.message_id = id(d, "message_id");
+		r.guild_id = id(d, "guild_id");
+		if (d.count("emoji")) {
+			r.emoji_id = id(d["emoji"], "id");
+			r.emoji_name = text(d["emoji"], "name");
+		}
+		return true;
+	}
+
+	template<class T> void run(const char* name, nlohmann::json (*make)()) {
+		const int EVENTS = 20000;
+		std::vector<std::string> frames;
+		size_t bytes = 0;
+		for (int i = 0; i < EVENTS; i++) {
+			frames.push_back(make().dump());
+			bytes += frames.back().size();
+		}
+
+		double dom_s = bench::best_of(5, [&]() {
+			for (const std::string& f : frames) {
+				nlohmann::json d = nlohmann::json::parse(f);
+				T decoded;
+				bench::keep(decode_dom(d, decoded));
+			}
+		});
+		double typed_s = bench::best_of(5, [&]() {
+			for (const std::string& f : frames) {
+				T decoded;
+				bench::keep(event_decoder::decode(std::string_view(f), decoded));
+			}
+		});
+
+		std::printf("%-9s %4zu bytes  dom %7.0f ns  typed %6.0f ns  %5.1fx\n", name, bytes / EVENTS,
+			dom_s * 1e9 / EVENTS, typed_s * 1e9 / EVENTS, dom_s / typed_s);
+	}
+
+}
+
+int main() {
+	std::printf("Per event, average size and decode time\n");
+	run<message_event>("message", &message);
+	run<member_event>("member", &member);
+	run<reaction_event>("reaction", &reaction);
+	return 0;
+}
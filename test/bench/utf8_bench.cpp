@@ -0,0 +1,95 @@
+#include "bench.hpp"
+#include <websocketpp/utf8_validator.cpp>
+#include <random>
+#include <string>
+
+/*
+ * UTF-8 validation throughput of the block validator against the byte at a time DFA,
+ * on 1 MB of ASCII, of mixed text (mostly ASCII with accented letters, CJK and emoji)
+ * and of CJK, whole and in 4 KB fragments as frames arrive.
+ */
+namespace {
+
+	const size_t SIZE = 1 << 20;
+
+	std::mt19937 rng(49);
+
+	void append(std::string& s, uint32_t c) {
+		if (c < 0x80) {
+			s += static_cast<char>(c);
+		}
+		else if (c < 0x800) {
+			s += static_cast<char>(0xC0 | (c >> 6));
+			s += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			s += static_cast<char>(0xE0 | (c >> 12));
+			s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			s += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else {
+			s += static_cast<char>(0xF0 | (c >> 18));
+			s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			s += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+
+	std::string ascii() {
+		std::string s;
+		while (s.size() < SIZE) append(s, 0x20 + rng() % 0x5F);
+		return s;
+	}
+
+	std::string mixed() {
+		std::string s;
+		while (s.size() < SIZE) {
+			unsigned r = rng() % 100;
+			if (r < 85) append(s, 0x20 + rng() % 0x5F);
+			else if (r < 93) append(s, 0xC0 + rng() % 0x40);
+			else if (r < 98) append(s, 0x4E00 + rng() % 0x5000);
+			else append(s, 0x1F600 + rng() % 0x50);
+		}
+		return s;
+	}
+
+	std::string cjk() {
+		std::string s;
+		while (s.size() < SIZE) append(s, 0x4E00 + rng() % 0x5000);
+		return s;
+	}
+
+	bool dfa(const std::string& s) {
+		uint32_t state = utf8_validator::utf8_accept, codepoint = 0;
+		for (char c : s) {
+			if (utf8_validator::decode(&state, &codepoint, static_cast<uint8_t>(c)) == utf8_validator::utf8_reject) return false;
+		}
+		return state == utf8_validator::utf8_accept;
+	}
+
+	bool fragments(const std::string& s) {
+		utf8_validator::validator v;
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(s.data());
+		for (size_t at = 0; at < s.size(); at += 4096) {
+			if (!v.decode(p + at, p + std::min(s.size(), at + 4096))) return false;
+		}
+		return v.complete();
+	}
+
+	void run(const char* name, const std::string& s) {
+		double dfa_s = bench::best_of(5, [&]() { bench::keep(dfa(s)); });
+		double block_s = bench::best_of(20, [&]() { bench::keep(utf8_validator::validate(s)); });
+		double fragment_s = bench::best_of(20, [&]() { bench::keep(fragments(s)); });
+		std::printf("%-6s  dfa %7.2f GB/s  blocks %7.2f GB/s  4 KB fragments %7.2f GB/s\n", name,
+			s.size() / dfa_s / 1e9, s.size() / block_s / 1e9, s.size() / fragment_s / 1e9);
+	}
+
+}
+
+int main() {
+	std::printf("1 MB inputs, AVX2 %s\n", cpu::has_avx2() ? "used" : "not available");
+	run("ascii", ascii());
+	run("mixed", mixed());
+	run("cjk", cjk());
+	return 0;
+}
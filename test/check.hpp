@@ -0,0 +1,23 @@
+#ifndef TEST_CHECK
+#define TEST_CHECK
+
+#include <cstdio>
+
+/*
+ * The tests are plain programs run by ctest. CHECK reports a failed condition and
+ * main() returns failures(), a test passes when nothing failed.
+ */
+inline int& failures() {
+	static int count = 0;
+	return count;
+}
+
+#define CHECK(condition)																	\
+	do {																					\
+		if (!(condition)) {																	\
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);	\
+			failures()++;																	\
+		}																					\
+	} while (0)
+
+#endif
@@ -0,0 +1,220 @@
+#include "check.hpp"
+#include <etf.hpp>
+#include <gateway_envelope.hpp>
+#include <gateway_events.hpp>
+#include <string>
+
+/*
+ * A READY payload as the gateway sends it with encoding=etf, written byte by byte,
+ * must decode to the same objects as its encoding=json counterpart, and a
+ * MESSAGE_CREATE to the same typed struct.
+ */
+namespace {
+
+	class term_writer {
+
+	public:
+
+		term_writer() : m_out(1, static_cast<char>(etf::FORMAT_VERSION)) {}
+
+		term_writer& map(uint32_t arity) { u8(etf::MAP_EXT); return u32(arity); }
+
+		term_writer& atom(const std::string& name) {
+			u8(etf::SMALL_ATOM_UTF8_EXT);
+			u8(static_cast<uint8_t>(name.size()));
+			m_out += name;
+			return *this;
+		}
+
+		term_writer& binary(const std::string& s) {
+			u8(etf::BINARY_EXT);
+			u32(static_cast<uint32_t>(s.size()));
+			m_out += s;
+			return *this;
+		}
+
+		term_writer& small(uint8_t v) { u8(etf::SMALL_INTEGER_EXT); return u8(v); }
+
+		term_writer& integer(int32_t v) { u8(etf::INTEGER_EXT); return u32(static_cast<uint32_t>(v)); }
+
+		//A snowflake, Erlang sends integers over 32 bits as SMALL_BIG_EXT, little endian
+		term_writer& big(uint64_t v) {
+			u8(etf::SMALL_BIG_EXT);
+			u8(8);
+			u8(0);
+			for (int i = 0; i < 8; i++) u8(static_cast<uint8_t>(v >> (8 * i)));
+			return *this;
+		}
+
+		//A list of bytes, Erlang encodes it as STRING_EXT
+		term_writer& string_list(const std::string& bytes) {
+			u8(etf::STRING_EXT);
+			u8(static_cast<uint8_t>(bytes.size() >> 8));
+			u8(static_cast<uint8_t>(bytes.size()));
+			m_out += bytes;
+			return *this;
+		}
+
+		term_writer& nil() { return u8(etf::NIL_EXT); }
+
+		const std::string& str() const { return m_out; }
+
+	private:
+
+		term_writer& u8(uint8_t v) {
+			m_out += static_cast<char>(v);
+			return *this;
+		}
+
+		term_writer& u32(uint32_t v) {
+			u8(static_cast<uint8_t>(v >> 24));
+			u8(static_cast<uint8_t>(v >> 16));
+			u8(static_cast<uint8_t>(v >> 8));
+			return u8(static_cast<uint8_t>(v));
+		}
+
+		std::string m_out;
+
+	};
+
+	const char* READY_JSON = R"({
+		"op": 0, "s": 1, "t": "READY",
+		"d": {
+			"v": 6,
+			"session_id": "7e1a9b7c5d2f4e3a",
+			"shard": [0, 1],
+			"user": { "id": "80351110224678912", "username": "Nelly", "bot": true, "avatar": null },
+			"guilds": [],
+			"heartbeat_interval": 41250,
+			"_trace": [200]
+		}
+	})";
+
+	std::string ready_etf() {
+		term_writer w;
+		w.map(4)
+			.atom("op").small(0)
+			.atom("s").small(1)
+			.atom("t").atom("READY")
+			.atom("d").map(7)
+				.atom("v").small(6)
+				.atom("session_id").binary("7e1a9b7c5d2f4e3a")
+				.atom("shard").string_list(std::string("\x00\x01", 2))
+				.atom("user").map(4)
+					.atom("id").big(80351110224678912ull)
+					.atom("username").binary("Nelly")
+					.atom("bot").atom("true")
+					.atom("avatar").atom("nil")
+				.atom("guilds").nil()
+				.atom("heartbeat_interval").integer(41250)
+				.atom("_trace").string_list("\xC8");
+		return w.str();
+	}
+
+	void test_ready_matches_json() {
+		nlohmann::json expected = nlohmann::json::parse(READY_JSON);
+		std::string frame = ready_etf();
+		etf::decoder decoder(frame.data(), frame.size());
+		nlohmann::json decoded = decoder.decode();
+
+		CHECK(decoder.ok());
+		CHECK(decoded == expected);
+		CHECK(decoded["d"]["shard"].is_array());
+		CHECK(decoded["d"]["_trace"][0] == 200);
+	}
+
+	void test_envelope() {
+		std::string frame = ready_etf();
+		gateway_envelope env;
+
+		CHECK(gateway_envelope::peek_etf(frame, env));
+		CHECK(env.etf);
+		CHECK(env.op == 0);
+		CHECK(env.has_sequence && env.sequence == 1);
+		CHECK(env.t == "READY");
+		CHECK(env.data() == nlohmann::json::parse(READY_JSON)["d"]);
+	}
+
+	std::string message_etf() {
+		term_writer w;
+		w.map(4)
+			.atom("d").map(6)
+				.atom("id").big(80351110224678913ull)
+				.atom("channel_id").big(80351110224678914ull)
+				.atom("guild_id").atom("nil")
+				.atom("content").binary("caf\xC3\xA9 \"quoted\"")
+				.atom("mention_roles").map(0)
+				.atom("author").map(3)
+					.atom("id").small(7)
+					.atom("username").binary("Nelly")
+					.atom("bot").atom("false")
+			.atom("op").small(0)
+			.atom("s").integer(1000)
+			.atom("t").atom("MESSAGE_CREATE");
+		return w.str();
+	}
+
+	void test_typed_matches_json() {
+		const char* json = R"({"op":0,"s":1000,"t":"MESSAGE_CREATE","d":{"id":"80351110224678913",
+			"channel_id":"80351110224678914","guild_id":null,"content":"caf\u00e9 \"quoted\"","mention_roles":{},
+			"author":{"id":"7","username":"Nelly","bot":false}}})";
+		gateway_envelope json_env, etf_env;
+		message_event from_json, from_etf;
+		std::string frame = message_etf();
+
+		CHECK(gateway_envelope::peek(json, json_env));
+		CHECK(gateway_envelope::peek_etf(frame, etf_env));
+		CHECK(etf_env.etf && etf_env.t == "MESSAGE_CREATE" && etf_env.sequence == 1000);
+		CHECK(event_decoder::decode(json_env, from_json));
+		CHECK(event_decoder::decode(etf_env, from_etf));
+		CHECK(from_etf.id == from_json.id && from_etf.id == snowflake(80351110224678913ull));
+		CHECK(from_etf.channel_id == from_json.channel_id);
+		CHECK(!from_etf.guild_id && !from_json.guild_id);
+		CHECK(from_etf.content == from_json.content);
+		CHECK(from_etf.author.id == snowflake(7) && from_etf.author.username == "Nelly");
+		CHECK(event_decoder::find_id(etf_env, "channel_id") == snowflake(80351110224678914ull));
+		CHECK(!event_decoder::find_id(etf_env, "guild_id"));
+		CHECK(etf_env.data() == json_env.data());
+	}
+
+	void test_id_fields() {
+		term_writer w;
+		w.map(2)
+			.atom("id").small(7)
+			.atom("permissions").big(1ull << 40);
+		nlohmann::json j = etf::decode(w.str());
+
+		CHECK(j["id"] == "7");
+		CHECK(j["permissions"] == 1ull << 40);
+	}
+
+	void test_round_trip() {
+		nlohmann::json expected = nlohmann::json::parse(READY_JSON);
+		CHECK(etf::decode(etf::encode(expected)) == expected);
+	}
+
+	void test_truncated() {
+		std::string frame = ready_etf();
+		for (size_t n = 0; n < frame.size(); n++) {
+			etf::decoder decoder(frame.data(), n);
+			decoder.decode();
+			CHECK(!decoder.ok());
+		}
+		frame = message_etf();
+		for (size_t n = 0; n < frame.size(); n++) {
+			gateway_envelope env;
+			CHECK(!gateway_envelope::peek_etf(frame.substr(0, n), env));
+		}
+	}
+
+}
+
+int main() {
+	test_ready_matches_json();
+	test_envelope();
+	test_typed_matches_json();
+	test_id_fields();
+	test_round_trip();
+	test_truncated();
+	return failures();
+}
@@ -0,0 +1,100 @@
+#include "check.hpp"
+#include <event_executor.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/*
+ * A bot that owns its workers destroys them before its caches: the executor runs the
+ * dispatches still queued and joins, only then may what they update go. A bot sharing
+ * the workers drains its own dispatches instead.
+ */
+namespace {
+
+	struct cache {
+		std::atomic<int>	updates{ 0 };
+		bool				alive = true;
+	};
+
+	//Tears down like ~discord_bot: the workers first, then the caches
+	struct owner {
+		event_executor*		executor = new event_executor(2);
+		cache*				c = new cache();
+
+		~owner() {
+			delete executor;
+			c->alive = false;
+			delete c;
+		}
+	};
+
+	void test_destroy_with_queued_dispatches() {
+		std::atomic<int> ran(0), dead(0);
+		{
+			owner bot;
+			cache* c = bot.c;
+			for (int i = 0; i < 400; i++) {
+				bot.executor->post(snowflake(1 + i % 4), [c, &ran, &dead]() {
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+					if (!c->alive) dead++;
+					c->updates++;
+					ran++;
+				});
+			}
+		}
+		CHECK(ran == 400);
+		CHECK(dead == 0);
+	}
+
+	//Two bots of a runtime on shared workers, one destroyed while its dispatches are queued
+	void test_drain_shared() {
+		event_executor::group first, second;
+		std::atomic<bool> first_alive(true);
+		std::atomic<int> after_drain(0), first_ran(0), second_ran(0);
+		{
+			event_executor executor(2);
+			for (int i = 0; i < 400; i++) {
+				//Both bots see the same guilds, their tasks share strands
+				snowflake key(1 + i % 4);
+				executor.post(key, [&]() {
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+					if (!first_alive) after_drain++;
+					first_ran++;
+				}, first);
+				executor.post(key, [&]() { second_ran++; }, second);
+			}
+			executor.drain(first);
+			first_alive = false;
+			executor.post(snowflake(1), [&]() { after_drain++; }, first);
+		}
+		CHECK(after_drain == 0);
+		CHECK(first_ran < 400);
+		//The other bot's dispatches all ran
+		CHECK(second_ran == 400);
+	}
+
+	void test_strand_order() {
+		std::atomic<int> out_of_order(0);
+		int last[4] = { -1, -1, -1, -1 };
+		{
+			event_executor executor(4);
+			for (int i = 0; i < 2000; i++) {
+				int key = i % 4;
+				executor.post(snowflake(1 + key), [&last, &out_of_order, key, i]() {
+					if (last[key] > i) out_of_order++;
+					last[key] = i;
+				});
+			}
+		}
+		CHECK(out_of_order == 0);
+		CHECK(last[3] == 1999);
+	}
+
+}
+
+int main() {
+	test_destroy_with_queued_dispatches();
+	test_drain_shared();
+	test_strand_order();
+	return failures();
+}
@@ -0,0 +1,56 @@
+#include "check.hpp"
+#include <gateway_queue.h>
+#include <thread>
+
+/*
+ * The gateway allows LIMIT commands in any PERIOD, a full burst must not be followed
+ * by more commands before its period is over.
+ */
+namespace {
+
+	void test_window() {
+		sliding_window window(10, std::chrono::milliseconds(200));
+		for (int i = 0; i < 10; i++) CHECK(window.try_take());
+		CHECK(!window.try_take());
+		CHECK(window.time_until_available() > std::chrono::milliseconds(0));
+
+		//Half the period later nothing left the window yet
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		CHECK(!window.try_take());
+
+		std::this_thread::sleep_until(sliding_window::clock::now() + window.time_until_available());
+		CHECK(window.try_take());
+	}
+
+	void test_reserved() {
+		sliding_window window(10, std::chrono::milliseconds(60000));
+		for (int i = 0; i < 7; i++) CHECK(window.try_take(3));
+		CHECK(!window.try_take(3));
+		for (int i = 0; i < 3; i++) CHECK(window.try_take());
+		CHECK(!window.try_take());
+	}
+
+	void test_queue_burst() {
+		gateway_queue queue;
+		gateway_queue::command c;
+		unsigned int sent = 0;
+
+		for (unsigned int i = 0; i < 2 * gateway_queue::LIMIT; i++) queue.push("{}", false, gateway_queue::NORMAL);
+		while (queue.pop(c)) sent++;
+		CHECK(sent == gateway_queue::LIMIT - gateway_queue::RESERVED);
+
+		//The reserved commands are left for heartbeats, then nothing goes out in this period
+		for (unsigned int i = 0; i < gateway_queue::RESERVED; i++) CHECK(queue.take_direct());
+		CHECK(!queue.take_direct());
+		queue.push("{}", false, gateway_queue::HIGH);
+		CHECK(!queue.pop(c));
+	}
+
+}
+
+int main() {
+	test_window();
+	test_reserved();
+	test_queue_burst();
+	return failures();
+}
@@ -0,0 +1,96 @@
+#include "check.hpp"
+#include <member_request.h>
+#include <stdexcept>
+#include <string>
+
+/*
+ * Chunks are matched to their request by nonce in either encoding, and a chunk that can
+ * not be read ends its request with an error rather than leaving it waiting.
+ */
+namespace {
+
+	const char* MEMBER = R"({"user":{"id":"5","username":"sasanqua","bot":false},"nick":null,"roles":["9"]})";
+
+	std::string chunk(const std::string& nonce, int index, int count, const std::string& members) {
+		return R"({"op":0,"s":3,"t":"GUILD_MEMBERS_CHUNK","d":{"guild_id":"1","nonce":)" + nonce
+			+ R"(,"chunk_index":)" + std::to_string(index) + R"(,"chunk_count":)" + std::to_string(count)
+			+ R"(,"members":)" + members + "}}";
+	}
+
+	void test_nonce() {
+		std::string nonce;
+		gateway_envelope env;
+		std::string frame = chunk("\"17\"", 0, 1, "[]");
+		CHECK(gateway_envelope::peek(frame, env));
+		CHECK(member_request::find_nonce(env, nonce) && nonce == "17");
+
+		frame = chunk("17", 0, 1, "[]");
+		env = gateway_envelope();
+		CHECK(gateway_envelope::peek(frame, env));
+		CHECK(member_request::find_nonce(env, nonce) && nonce == "17");
+
+		frame = chunk(R"("a\"b")", 0, 1, "[]");
+		env = gateway_envelope();
+		CHECK(gateway_envelope::peek(frame, env));
+		CHECK(member_request::find_nonce(env, nonce) && nonce == "a\"b");
+
+		frame = R"({"op":0,"s":3,"t":"GUILD_MEMBERS_CHUNK","d":{"guild_id":"1","members":[]}})";
+		env = gateway_envelope();
+		CHECK(gateway_envelope::peek(frame, env));
+		CHECK(!member_request::find_nonce(env, nonce));
+
+		std::string etf_frame = etf::encode(nlohmann::json::parse(chunk("\"17\"", 0, 1, "[]")));
+		env = gateway_envelope();
+		CHECK(gateway_envelope::peek_etf(etf_frame, env));
+		CHECK(member_request::find_nonce(env, nonce) && nonce == "17");
+	}
+
+	void test_chunks() {
+		size_t streamed = 0;
+		member_request request([&streamed](const member_list& list, size_t first) { streamed += list.size() - first; });
+		std::future<member_list> members = request.get_future();
+
+		std::string first = chunk("\"1\"", 0, 2, std::string("[") + MEMBER + "," + MEMBER + "]");
+		std::string last = chunk("\"1\"", 1, 2, std::string("[") + MEMBER + "]");
+		gateway_envelope env;
+		CHECK(gateway_envelope::peek(first, env));
+		CHECK(!request.on_chunk(env));
+		env = gateway_envelope();
+		CHECK(gateway_envelope::peek(last, env));
+		CHECK(request.on_chunk(env));
+
+		member_list list = members.get();
+		CHECK(list.size() == 3);
+		CHECK(streamed == 3);
+		CHECK(list.username(2) == "sasanqua");
+		CHECK(list.role_count(0) == 1 && list.roles(0)[0] == snowflake(9));
+	}
+
+	void test_malformed_chunk() {
+		member_request request(nullptr);
+		std::future<member_list> members = request.get_future();
+
+		//The first of two chunks, its members are not an array
+		std::string frame = chunk("\"1\"", 0, 2, "5");
+		gateway_envelope env;
+		CHECK(gateway_envelope::peek(frame, env));
+		CHECK(request.on_chunk(env));
+
+		bool failed = false;
+		try {
+			members.get();
+		}
+		catch (const std::runtime_error&) {
+			failed = true;
+		}
+		CHECK(failed);
+	}
+
+}
+
+int main() {
+	test_nonce();
+	test_chunks();
+	test_malformed_chunk();
+	return failures();
+}
@@ -0,0 +1,89 @@
+#include "check.hpp"
+#include <message_cache.h>
+#include <string>
+
+/*
+ * The budget bounds content, rings and index together, and channels left without
+ * messages give their ring back.
+ */
+namespace {
+
+	const size_t BUDGET = 256 * 1024;
+
+	nlohmann::json message(uint64_t id, uint64_t channel_id, const std::string& content) {
+		return nlohmann::json{ { "id", std::to_string(id) }, { "channel_id", std::to_string(channel_id) }, { "guild_id", "1" }, { "content", content } };
+	}
+
+	size_t footprint(const message_cache& cache) {
+		message_cache::stats s = cache.get_stats();
+		return s.used_bytes + s.overhead_bytes;
+	}
+
+	void test_find() {
+		message_cache cache(BUDGET, 4);
+		cache.update(event::MESSAGE_CREATE, message(10, 2, std::string(200, 'a')));
+		cached_message m;
+		CHECK(cache.find(snowflake(10), m));
+		CHECK(m.content == std::string(200, 'a'));
+		CHECK(m.channel_id == snowflake(2));
+
+		cache.update(event::MESSAGE_UPDATE, nlohmann::json{ { "id", "10" }, { "content", "b" } });
+		CHECK(cache.find(snowflake(10), m) && m.content == "b");
+		cache.update(event::MESSAGE_DELETE, nlohmann::json{ { "id", "10" } });
+		CHECK(!cache.find(snowflake(10), m));
+	}
+
+	void test_rings_counted() {
+		//Messages without content in many channels, only their rings and index fill the budget
+		message_cache cache(BUDGET, 64);
+		for (uint64_t i = 1; i <= 2000; i++) {
+			cache.update(event::MESSAGE_CREATE, message(100000 + i, i, ""));
+			CHECK(footprint(cache) <= BUDGET);
+		}
+		message_cache::stats s = cache.get_stats();
+		CHECK(s.channels < 2000);
+		CHECK(s.channels == s.messages);
+		CHECK(s.overhead_bytes > s.used_bytes);
+
+		cached_message m;
+		CHECK(cache.find(snowflake(100000 + 2000), m));
+	}
+
+	void test_empty_channels_dropped() {
+		message_cache cache(BUDGET, 64);
+		for (uint64_t i = 1; i <= 100; i++) cache.update(event::MESSAGE_CREATE, message(100000 + i, i, "x"));
+		for (uint64_t i = 1; i <= 100; i++) cache.update(event::MESSAGE_DELETE, nlohmann::json{ { "id", std::to_string(100000 + i) } });
+		CHECK(cache.get_stats().channels == 100);
+
+		//New channels need the room the deleted ones still hold
+		for (uint64_t i = 1; i <= 5000; i++) {
+			cache.update(event::MESSAGE_CREATE, message(200000 + i, 1000 + i % 50, std::string(300, 'c')));
+			CHECK(footprint(cache) <= BUDGET);
+		}
+		message_cache::stats s = cache.get_stats();
+		CHECK(s.channels <= 50);
+		CHECK(s.evicted > 0);
+	}
+
+	void test_fair_share() {
+		message_cache cache(BUDGET, 64);
+		cache.update(event::MESSAGE_CREATE, message(1, 1, std::string(1000, 'q')));
+		for (uint64_t i = 1; i <= 5000; i++) {
+			cache.update(event::MESSAGE_CREATE, message(1000 + i, 2 + i % 8, std::string(1000, 'b')));
+		}
+		//The quiet channel holds less than its share, the busy ones are evicted first
+		cached_message m;
+		CHECK(cache.find(snowflake(1), m) && m.content.size() == 1000);
+		CHECK(footprint(cache) <= BUDGET);
+		CHECK(cache.get_stats().evicted > 0);
+	}
+
+}
+
+int main() {
+	test_find();
+	test_rings_counted();
+	test_empty_channels_dropped();
+	test_fair_share();
+	return failures();
+}
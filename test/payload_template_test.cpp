@@ -0,0 +1,113 @@
+#include "check.hpp"
+#include <gateway_templates.hpp>
+#include <cstdlib>
+#include <new>
+
+/*
+ * The bot's own gateway templates render what the gateway expects and, once warmed up,
+ * rendering a heartbeat does not allocate: every allocation of the program goes through
+ * the counting operator new below.
+ */
+namespace {
+
+	size_t allocations = 0;
+
+}
+
+namespace {
+
+	void* allocate(size_t size) {
+		allocations++;
+		if (void* p = std::malloc(size ? size : 1)) return p;
+		throw std::bad_alloc();
+	}
+
+	void release(void* p) noexcept {
+		std::free(p);
+	}
+
+}
+
+//Every form goes through allocate and release, a delete never frees what it did not allocate
+void* operator new(size_t size) {
+	return allocate(size);
+}
+
+void* operator new[](size_t size) {
+	return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+	release(p);
+}
+
+void operator delete[](void* p) noexcept {
+	release(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	release(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	release(p);
+}
+
+namespace {
+
+	using namespace gateway_templates;
+
+	void test_identify() {
+		payload_template t = identify(false);
+		CHECK(t.slot_count() == 3);
+		t.set(IDENTIFY_TOKEN, "a\"b");
+		t.set(IDENTIFY_INTENTS, 513);
+		t.set(IDENTIFY_CREATED_AT, static_cast<int64_t>(1600000000));
+		nlohmann::json rendered = nlohmann::json::parse(t.render());
+		CHECK(rendered["op"] == 2);
+		CHECK(rendered["d"]["token"] == "a\"b");
+		CHECK(rendered["d"]["intents"] == 513);
+		CHECK(rendered["d"]["presence"]["game"]["created_at"] == 1600000000);
+		CHECK(rendered["d"]["properties"]["$browser"] == "Abby");
+		CHECK(!rendered["d"].contains("shard"));
+
+		payload_template sharded = identify(true);
+		CHECK(sharded.slot_count() == 4);
+		sharded.set(IDENTIFY_TOKEN, "t");
+		sharded.set(IDENTIFY_INTENTS, 1);
+		sharded.set(IDENTIFY_CREATED_AT, 0);
+		sharded.set_raw(IDENTIFY_SHARD, "[1,4]");
+		rendered = nlohmann::json::parse(sharded.render());
+		CHECK(rendered["d"]["shard"] == nlohmann::json::array({ 1, 4 }));
+	}
+
+	void test_heartbeat_allocations() {
+		payload_template heartbeat = gateway_templates::heartbeat();
+		heartbeat.set_null(HEARTBEAT_SEQUENCE);
+		CHECK(heartbeat.render() == "{\"d\":null,\"op\":1,\"s\":null,\"t\":null}");
+
+		//The longest sequence a session reaches sizes the buffer
+		heartbeat.set(HEARTBEAT_SEQUENCE, static_cast<int64_t>(1) << 40);
+		heartbeat.render();
+
+		size_t before = allocations;
+		//Building the template went through the counter
+		CHECK(before > 0);
+		for (int64_t sequence = 1; sequence <= 100000; sequence++) {
+			if (sequence % 100 == 0) heartbeat.set_null(HEARTBEAT_SEQUENCE);
+			else heartbeat.set(HEARTBEAT_SEQUENCE, sequence);
+			heartbeat.render();
+		}
+		CHECK(allocations == before);
+
+		heartbeat.set(HEARTBEAT_SEQUENCE, 42);
+		CHECK(heartbeat.render() == "{\"d\":42,\"op\":1,\"s\":null,\"t\":null}");
+	}
+
+}
+
+int main() {
+	test_identify();
+	test_heartbeat_allocations();
+	return failures();
+}
@@ -0,0 +1,171 @@
+#include "check.hpp"
+#include <permission_cache.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+ * Invalidated entries must never be found again, the table must stay bounded as members
+ * come and go, and lookups racing stores must only see whole entries.
+ */
+namespace {
+
+	const snowflake GUILD(1000), OTHER_GUILD(1001), CHANNEL(2000);
+
+	bool cached(permission_cache& cache, snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t& perms) {
+		permission_cache::stamp s;
+		return cache.find(guild_id, user_id, channel_id, perms, s);
+	}
+
+	void put(permission_cache& cache, snowflake guild_id, snowflake user_id, snowflake channel_id, uint64_t perms) {
+		uint64_t old;
+		permission_cache::stamp s;
+		cache.find(guild_id, user_id, channel_id, old, s);
+		cache.store(guild_id, user_id, channel_id, perms, s);
+	}
+
+	void test_generations() {
+		permission_cache cache;
+		uint64_t perms = 0;
+		put(cache, GUILD, snowflake(1), snowflake(), 7);
+		put(cache, GUILD, snowflake(2), snowflake(), 8);
+		put(cache, GUILD, snowflake(1), CHANNEL, 9);
+		CHECK(cached(cache, GUILD, snowflake(1), snowflake(), perms) && perms == 7);
+		CHECK(cached(cache, GUILD, snowflake(1), CHANNEL, perms) && perms == 9);
+
+		cache.invalidate_member(GUILD, snowflake(1));
+		CHECK(!cached(cache, GUILD, snowflake(1), snowflake(), perms));
+		CHECK(!cached(cache, GUILD, snowflake(1), CHANNEL, perms));
+		CHECK(cached(cache, GUILD, snowflake(2), snowflake(), perms) && perms == 8);
+
+		cache.invalidate_channel(CHANNEL);
+		put(cache, GUILD, snowflake(2), CHANNEL, 10);
+		CHECK(cached(cache, GUILD, snowflake(2), CHANNEL, perms) && perms == 10);
+		cache.invalidate_guild(GUILD);
+		CHECK(!cached(cache, GUILD, snowflake(2), snowflake(), perms));
+		CHECK(!cached(cache, GUILD, snowflake(2), CHANNEL, perms));
+	}
+
+	void test_stale_store() {
+		permission_cache cache;
+		uint64_t perms = 0;
+		permission_cache::stamp s;
+		CHECK(!cache.find(GUILD, snowflake(1), snowflake(), perms, s));
+		cache.invalidate_member(GUILD, snowflake(1));
+		cache.store(GUILD, snowflake(1), snowflake(), 7, s);
+		CHECK(cache.size() == 0);
+		CHECK(!cached(cache, GUILD, snowflake(1), snowflake(), perms));
+	}
+
+	void test_member_leaves() {
+		permission_cache cache;
+		uint64_t perms = 0;
+		put(cache, GUILD, snowflake(1), snowflake(), 7);
+		put(cache, GUILD, snowflake(1), CHANNEL, 9);
+		cache.invalidate_member(GUILD, snowflake(1));
+
+		CHECK(cache.size() == 0);
+		CHECK(!cached(cache, GUILD, snowflake(1), snowflake(), perms));
+		CHECK(!cached(cache, GUILD, snowflake(1), CHANNEL, perms));
+
+		//Back in the guild, cached again
+		put(cache, GUILD, snowflake(1), snowflake(), 8);
+		CHECK(cached(cache, GUILD, snowflake(1), snowflake(), perms) && perms == 8);
+	}
+
+	void test_channel_and_guild_deleted() {
+		permission_cache cache;
+		uint64_t perms = 0;
+		put(cache, GUILD, snowflake(1), CHANNEL, 9);
+		put(cache, GUILD, snowflake(2), snowflake(), 8);
+		put(cache, OTHER_GUILD, snowflake(2), snowflake(), 6);
+		cache.invalidate_channel(CHANNEL);
+		CHECK(!cached(cache, GUILD, snowflake(1), CHANNEL, perms));
+		cache.invalidate_guild(GUILD);
+
+		CHECK(cache.size() == 1);
+		CHECK(!cached(cache, GUILD, snowflake(2), snowflake(), perms));
+		CHECK(cached(cache, OTHER_GUILD, snowflake(2), snowflake(), perms) && perms == 6);
+	}
+
+	void test_bounded() {
+		permission_cache cache;
+		//Members joining, checked and leaving, their stale slots are taken again
+		for (uint64_t user = 1; user <= 100000; user++) {
+			cache.invalidate_member(GUILD, snowflake(user));
+			put(cache, GUILD, snowflake(user), snowflake(), user);
+			put(cache, GUILD, snowflake(user), CHANNEL, user);
+			cache.invalidate_member(GUILD, snowflake(user));
+		}
+		CHECK(cache.size() == 0);
+		CHECK(cache.capacity() < 20000);
+	}
+
+	void test_grow() {
+		permission_cache cache;
+		uint64_t perms = 0;
+		for (uint64_t user = 1; user <= 20000; user++) put(cache, GUILD, snowflake(user), snowflake(), user);
+		size_t hits = 0;
+		for (uint64_t user = 1; user <= 20000; user++) hits += cached(cache, GUILD, snowflake(user), snowflake(), perms) && perms == user;
+		//A set may fill before the others, its newest entries are kept
+		CHECK(hits > 19000);
+		CHECK(cache.capacity() >= 20000 && cache.capacity() <= permission_cache::MAX_ENTRIES);
+
+		cache.clear();
+		CHECK(cache.size() == 0);
+		CHECK(!cached(cache, GUILD, snowflake(1), snowflake(), perms));
+	}
+
+	void test_shared_generations() {
+		permission_cache cache;
+		uint64_t perms = 0;
+		for (uint64_t guild = 1; guild <= 100; guild++) put(cache, snowflake(guild), snowflake(guild), snowflake(), guild);
+		//Updates of many other channels take no room, only the guilds hashed to the slot
+		//of one of them miss
+		for (uint64_t id = 1; id <= 20000; id++) cache.invalidate_channel(snowflake(CHANNEL.value() + id));
+		size_t hits = 0;
+		for (uint64_t guild = 1; guild <= 100; guild++) hits += cached(cache, snowflake(guild), snowflake(guild), snowflake(), perms) && perms == guild;
+		CHECK(hits > 70);
+		CHECK(cache.size() == hits);
+	}
+
+	void test_concurrent_reads() {
+		permission_cache cache;
+		std::atomic<bool> done(false);
+		std::atomic<size_t> torn(0);
+		//A hit must never mix the fields of two writes, the perms of a user are its id
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 3; r++) {
+			readers.emplace_back([&cache, &done, &torn]() {
+				uint64_t perms;
+				permission_cache::stamp s;
+				while (!done) {
+					for (uint64_t user = 1; user <= 64; user++) {
+						if (cache.find(GUILD, snowflake(user), CHANNEL, perms, s) && perms != user) torn++;
+					}
+				}
+			});
+		}
+		for (int i = 0; i < 20000; i++) {
+			uint64_t user = 1 + i % 64;
+			put(cache, GUILD, snowflake(user), CHANNEL, user);
+			if (i % 7 == 0) cache.invalidate_member(GUILD, snowflake(user));
+		}
+		done = true;
+		for (std::thread& t : readers) t.join();
+		CHECK(torn == 0);
+	}
+
+}
+
+int main() {
+	test_generations();
+	test_stale_store();
+	test_member_leaves();
+	test_channel_and_guild_deleted();
+	test_bounded();
+	test_grow();
+	test_shared_generations();
+	test_concurrent_reads();
+	return failures();
+}
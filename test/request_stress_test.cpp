@@ -0,0 +1,60 @@
+#include "check.hpp"
+#include <events.h>
+#include <rest/request.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Threads build and render requests at once from the shared, read only templates, as
+ * create_message does. Each request must hold its own thread's values only. Configure
+ * with -DSANITIZE_THREAD=ON to run it under ThreadSanitizer.
+ */
+namespace {
+
+	const int THREADS = 8;
+
+	const int REQUESTS = 20000;
+
+	bool contains(const std::string& s, const std::string& part) {
+		return s.find(part) != std::string::npos;
+	}
+
+	void build(int thread, std::atomic<int>& wrong) {
+		std::string token = "Bot token-" + std::to_string(thread);
+		for (int i = 0; i < REQUESTS; i++) {
+			nlohmann::json body = event_payload::message.get_data();
+			body["content"] = "message " + std::to_string(thread) + "/" + std::to_string(i);
+
+			request_builder request(event_payload::message_headers.get_data());
+			request.header("Authorization", token).body(body);
+			const std::string& data = handle_request(REST_POST, "discord.com", "/api/channels/1/messages", request.get_headers(), request.get_body());
+
+			std::string content = body.dump();
+			bool right = data.rfind("POST /api/channels/1/messages HTTP/1.1\r\nHost: discord.com\r\n", 0) == 0
+				&& contains(data, "Authorization: " + token + "\r\n")
+				&& contains(data, "Content-Length: " + std::to_string(content.size()) + "\r\n")
+				&& data.size() >= content.size() && data.compare(data.size() - content.size(), content.size(), content) == 0;
+			if (!right) wrong++;
+		}
+	}
+
+	void test_threads() {
+		std::atomic<int> wrong(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < THREADS; t++) threads.emplace_back(build, t, std::ref(wrong));
+		for (std::thread& t : threads) t.join();
+		CHECK(wrong == 0);
+
+		//The shared templates are as they were built
+		CHECK(event_payload::message_headers.get_data()["Authorization"] == "");
+		CHECK(event_payload::message.get_data()["content"] == "");
+	}
+
+}
+
+int main() {
+	test_threads();
+	return failures();
+}
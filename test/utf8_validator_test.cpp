@@ -0,0 +1,144 @@
+#include "check.hpp"
+#include <websocketpp/utf8_validator.cpp>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * The block validator must agree with the byte at a time DFA on any input, whole and
+ * split into fragments at any point. Built twice, the second time without SIMD.
+ */
+namespace {
+
+	//The reference: the DFA over every byte, returns whether the input is valid so far
+	bool dfa(const std::string& s, size_t end, uint32_t& state) {
+		uint32_t codepoint = 0;
+		state = utf8_validator::utf8_accept;
+		for (size_t i = 0; i < end; i++) {
+			if (utf8_validator::decode(&state, &codepoint, static_cast<uint8_t>(s[i])) == utf8_validator::utf8_reject) return false;
+		}
+		return true;
+	}
+
+	void append(std::string& s, uint32_t c) {
+		if (c < 0x80) {
+			s += static_cast<char>(c);
+		}
+		else if (c < 0x800) {
+			s += static_cast<char>(0xC0 | (c >> 6));
+			s += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000) {
+			s += static_cast<char>(0xE0 | (c >> 12));
+			s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			s += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else {
+			s += static_cast<char>(0xF0 | (c >> 18));
+			s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+			s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			s += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+
+	//Mostly valid text of every length of code point, with runs of ASCII to cross blocks
+	//and now and then a broken one: a random byte, a surrogate, an overlong or too large
+	//code point, a sequence cut short
+	std::string random_input(std::mt19937& rng) {
+		std::string s;
+		size_t length = rng() % 300;
+		int errors = rng() % 3 == 0 ? 0 : 1 + rng() % 3;
+		while (s.size() < length) {
+			switch (rng() % 8) {
+			case 0:
+			case 1:
+				s.append(rng() % 40, static_cast<char>('a' + rng() % 26));
+				break;
+			case 2:
+				append(s, 0x80 + rng() % 0x780);
+				break;
+			case 3:
+				append(s, 0x800 + rng() % 0xD000);
+				break;
+			case 4:
+				append(s, 0x4E00 + rng() % 0x5000);
+				break;
+			case 5:
+				append(s, 0x10000 + rng() % 0x100000);
+				break;
+			default:
+				if (errors == 0 || rng() % 4 != 0) {
+					append(s, rng() % 0x80);
+					break;
+				}
+				errors--;
+				switch (rng() % 5) {
+				case 0:
+					s += static_cast<char>(rng() & 0xFF);
+					break;
+				case 1:
+					append(s, 0xD800 + rng() % 0x800);
+					break;
+				case 2:
+					s += "\xC0\xAF";
+					break;
+				case 3:
+					s += "\xF4\x90\x80\x80";
+					break;
+				default: {
+					std::string c;
+					append(c, 0x800 + rng() % 0x10000);
+					s.append(c, 0, 1 + rng() % (c.size() - 1));
+					break;
+				}
+				}
+			}
+		}
+		return s;
+	}
+
+	void test_fuzz() {
+		std::mt19937 rng(49);
+		int whole = 0, fragmented = 0, valid_inputs = 0;
+		for (int n = 0; n < 200000; n++) {
+			std::string s = random_input(rng);
+			uint32_t state;
+			bool valid = dfa(s, s.size(), state) && state == utf8_validator::utf8_accept;
+			if (utf8_validator::validate(s) != valid) whole++;
+			if (valid) valid_inputs++;
+
+			//The same input in fragments, each decode agreeing with the DFA up to there
+			utf8_validator::validator v;
+			bool ok = true;
+			for (size_t at = 0; at < s.size() && ok;) {
+				size_t end = std::min(s.size(), at + 1 + rng() % 64);
+				const uint8_t* p = reinterpret_cast<const uint8_t*>(s.data());
+				ok = v.decode(p + at, p + end);
+				if (ok != dfa(s, end, state)) fragmented++;
+				at = end;
+			}
+			if (ok && v.complete() != valid) fragmented++;
+		}
+		CHECK(whole == 0);
+		CHECK(fragmented == 0);
+		//Both outcomes are well covered
+		CHECK(valid_inputs > 50000 && valid_inputs < 150000);
+	}
+
+	void test_known() {
+		CHECK(utf8_validator::validate(""));
+		CHECK(utf8_validator::validate("plain ASCII that spans more than one block of sixteen bytes"));
+		CHECK(utf8_validator::validate("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E \xF0\x9F\x98\x80"));
+		CHECK(!utf8_validator::validate("\xED\xA0\x80"));
+		CHECK(!utf8_validator::validate("\xC0\xAF"));
+		CHECK(!utf8_validator::validate("\xF4\x90\x80\x80"));
+		CHECK(!utf8_validator::validate("\xE6\x97"));
+	}
+
+}
+
+int main() {
+	test_known();
+	test_fuzz();
+	return failures();
+}